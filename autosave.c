@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "autosave.h"
+#include "follow.h"
+#include "event.h"
+
+/**
+ * Write all of data[0..len) (false on an error)
+ */
+static bool autosave_write_all(int fd, char *data, int len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * Pool job: copies the snapshot to the temporary file in AUTOSAVE_WRITE_SIZE blocks,
+ * syncs it and renames it over the autosave file
+ * Only reads the snapshot; the main thread collects the result in autosave_poll()
+ */
+static void autosave_worker(WorkerJob *job) {
+    Autosave *autosave = job->group->data;
+    RopeSnapshot *snap = &autosave->snapshot;
+
+    char *block = malloc(AUTOSAVE_WRITE_SIZE);
+    int fd = block ? open(autosave->temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600) : -1;
+    bool ok = fd != -1;
+
+    int used = 0;
+    for (int i = 0; ok && i < snap->count; i++) {
+        char *text = rope_snapshot_text(&snap->spans[i]);
+        int len = snap->spans[i].len;
+        while (ok && len > 0) {
+            int n = AUTOSAVE_WRITE_SIZE - used < len ? AUTOSAVE_WRITE_SIZE - used : len;
+            memcpy(block + used, text, n);
+            used += n;
+            text += n;
+            len -= n;
+            if (used == AUTOSAVE_WRITE_SIZE) {
+                ok = autosave_write_all(fd, block, used);
+                worker_group_advance(job->group, used);
+                used = 0;
+            }
+        }
+    }
+    if (ok)
+        ok = autosave_write_all(fd, block, used);
+
+    // The rename only replaces the previous autosave once this one is complete on disk
+    if (fd != -1) {
+        if (ok)
+            ok = fsync(fd) == 0;
+        close(fd);
+        if (ok)
+            ok = rename(autosave->temp_path, autosave->path) == 0;
+        if (!ok)
+            unlink(autosave->temp_path);
+    }
+    free(block);
+    autosave->ok = ok;
+}
+
+/**
+ * Initialize with the default triggers
+ * The autosave of "dir/name" is "dir/.name.tim2.autosave" (a buffer without a file has none)
+ */
+void autosave_init(Autosave *autosave, char *filename) {
+    memset(autosave, 0, sizeof(Autosave));
+    autosave->idle_seconds = AUTOSAVE_IDLE_SECONDS;
+    autosave->edit_limit = AUTOSAVE_EDITS;
+    if (!filename)
+        return;
+
+    autosave->path = file_sidecar_path(filename, "autosave");
+    autosave->temp_path = malloc(strlen(autosave->path) + 5);
+    if (!autosave->temp_path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(autosave->temp_path, "%s.tmp", autosave->path);
+}
+
+/**
+ * Wait for a running save, then free the autosave's memory
+ * The autosave file stays: it holds the edits of a buffer quit without saving
+ */
+void autosave_free(Autosave *autosave) {
+    if (autosave->running) {
+        worker_group_wait(&autosave->group);
+        worker_group_free(&autosave->group);
+        autosave->running = false;
+        rope_snapshot_release(&autosave->snapshot);
+        if (autosave->stale)
+            unlink(autosave->path);
+    }
+    free(autosave->path);
+    free(autosave->temp_path);
+}
+
+/**
+ * Change the triggers (0 turns one off)
+ */
+void autosave_configure(Autosave *autosave, int idle_seconds, int edit_limit) {
+    autosave->idle_seconds = idle_seconds > 0 ? idle_seconds : 0;
+    autosave->edit_limit = edit_limit > 0 ? edit_limit : 0;
+}
+
+/**
+ * Count an edit and restart the idle timer
+ */
+void autosave_note_edit(Autosave *autosave) {
+    autosave->edits++;
+    autosave->dirty = true;
+    autosave->last_edit = event_now_ms();
+}
+
+/**
+ * Check whether a save should start: there are edits the autosave file lacks, none is being
+ * written, and either enough edits were made or none came for idle_seconds
+ */
+bool autosave_due(Autosave *autosave) {
+    if (!autosave->path || !autosave->dirty || autosave->running)
+        return false;
+    if (autosave->edit_limit > 0 && autosave->edits >= autosave->edit_limit)
+        return true;
+    return autosave->idle_seconds > 0 &&
+           event_now_ms() - autosave->last_edit >= autosave->idle_seconds * 1000.0;
+}
+
+/**
+ * Milliseconds until the main loop should look at the autosave again
+ */
+int autosave_timeout(Autosave *autosave) {
+    if (autosave->running)
+        return WORKER_PROGRESS_MS;
+    if (!autosave->path || !autosave->dirty || autosave->idle_seconds == 0)
+        return -1;
+
+    double wait = autosave->last_edit + autosave->idle_seconds * 1000.0 - event_now_ms();
+    return wait > 0 ? (int)wait + 1 : 0;
+}
+
+/**
+ * Queue the write of snapshot on the worker pool
+ * Edits made from now on are dirty again (they are not in this snapshot)
+ */
+void autosave_start(Autosave *autosave, RopeSnapshot *snapshot) {
+    autosave->snapshot = *snapshot;
+    autosave->ok = false;
+    autosave->stale = false;
+
+    worker_group_init(&autosave->group, NULL, autosave);
+    worker_group_set_total(&autosave->group, snapshot->total);
+    autosave->job.run = autosave_worker;
+    worker_submit(&autosave->group, &autosave->job);
+
+    autosave->running = true;
+    autosave->dirty = false;
+    autosave->edits = 0;
+}
+
+/**
+ * Collect a finished save and release its snapshot
+ * A failed save leaves the buffer dirty so the next trigger tries again
+ */
+bool autosave_poll(Autosave *autosave) {
+    if (!autosave->running || !worker_group_done(&autosave->group))
+        return false;
+
+    worker_group_free(&autosave->group);
+    autosave->running = false;
+    rope_snapshot_release(&autosave->snapshot);
+
+    if (autosave->stale) {
+        unlink(autosave->path);
+    } else if (autosave->ok) {
+        autosave->failed = false;
+        autosave->last_saved = event_now_ms();
+    } else {
+        autosave->failed = true;
+        autosave->dirty = true;
+        autosave->last_edit = event_now_ms();
+    }
+    return true;
+}
+
+/**
+ * Percentage of the running save written so far
+ */
+int autosave_progress(Autosave *autosave) {
+    return worker_group_percent(&autosave->group);
+}
+
+/**
+ * Seconds since the last autosave finished (-1 if there is no autosave file)
+ */
+int autosave_age(Autosave *autosave) {
+    if (autosave->last_saved == 0)
+        return -1;
+    return (int)((event_now_ms() - autosave->last_saved) / 1000);
+}
+
+/**
+ * Delete the autosave file: the buffer was saved or reloaded
+ * A save still being written is deleted when it finishes
+ */
+void autosave_discard(Autosave *autosave) {
+    autosave->dirty = false;
+    autosave->edits = 0;
+    autosave->last_saved = 0;
+    autosave->failed = false;
+    if (!autosave->path)
+        return;
+
+    if (autosave->running)
+        autosave->stale = true;
+    unlink(autosave->path);
+}
@@ -0,0 +1,78 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <stdbool.h>
+#include "rope.h"
+#include "worker.h"
+
+// Default triggers: seconds since the last edit, or edits since the last autosave (0 = off)
+#define AUTOSAVE_IDLE_SECONDS 30
+#define AUTOSAVE_EDITS 300
+
+// Bytes gathered from the snapshot for each write()
+#define AUTOSAVE_WRITE_SIZE (1024 * 1024)
+
+// Periodic background copy of a buffer's text to ".<name>.tim2.autosave" beside the file
+// The main thread takes a snapshot of the rope (pointers into its leaves, nothing copied) and a
+// worker pool job writes it to a temporary file that is renamed over the autosave when complete,
+// so the buffer keeps taking keys while the file is written.
+typedef struct {
+    char *path;              // Autosave file name (NULL: buffer without a file, never autosaved)
+    char *temp_path;         // Written here, then renamed to path
+    int idle_seconds;        // Save once no edit came for this long (0 = never)
+    int edit_limit;          // Save after this many edits (0 = never)
+    int edits;               // Edits since the last autosave started
+    bool dirty;              // Edits the autosave file does not hold yet
+    double last_edit;        // Time of the last edit (ms, monotonic clock)
+    double last_saved;       // Time the last autosave finished (0 = no autosave file)
+    bool failed;             // Last autosave could not be written
+    bool stale;              // Discarded while being written: delete the file it produces
+
+    // Save in progress (the job reads snapshot, reports bytes written to group and sets ok)
+    bool running;
+    WorkerGroup group;       // Progress and completion of the one job (data = this autosave)
+    WorkerJob job;
+    RopeSnapshot snapshot;
+    bool ok;                 // Read once the group is done
+} Autosave;
+
+// ========== Lifecycle ==========
+
+// Initialize with the default triggers; filename NULL never autosaves
+void autosave_init(Autosave *autosave, char *filename);
+
+// Wait for a save being written, then free the autosave's memory (its file is kept)
+void autosave_free(Autosave *autosave);
+
+// Change the triggers (0 turns one off)
+void autosave_configure(Autosave *autosave, int idle_seconds, int edit_limit);
+
+// ========== Triggers ==========
+
+// Count an edit (the buffer now differs from the autosave file)
+void autosave_note_edit(Autosave *autosave);
+
+// Check whether a save should start now
+bool autosave_due(Autosave *autosave);
+
+// Milliseconds until a save is due or its progress needs redrawing (-1 = nothing to wait for)
+int autosave_timeout(Autosave *autosave);
+
+// ========== Background save ==========
+
+// Queue a job writing snapshot on the worker pool (the autosave takes the snapshot over)
+void autosave_start(Autosave *autosave, RopeSnapshot *snapshot);
+
+// Collect a finished save (releasing its snapshot); returns true if one finished
+bool autosave_poll(Autosave *autosave);
+
+// Percentage of the running save written so far
+int autosave_progress(Autosave *autosave);
+
+// Seconds since the autosave file was last written (-1 if there is none)
+int autosave_age(Autosave *autosave);
+
+// Delete the autosave file (the file itself now holds the buffer)
+void autosave_discard(Autosave *autosave);
+
+#endif
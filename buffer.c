@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "buffer.h"
+
+/**
+ * Create a buffer list for the given files
+ * Files are loaded lazily by buffer_list_current()
+ */
+BufferList *buffer_list_create(char **filenames, int count) {
+    BufferList *buffers = calloc(1, sizeof(BufferList));
+    if (!buffers) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    buffers->filenames = malloc(count * sizeof(char *));
+    buffers->editors = calloc(count, sizeof(EditorState *));
+    if (!buffers->filenames || !buffers->editors) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < count; i++)
+        buffers->filenames[i] = string_copy(filenames[i]);
+    buffers->count = count;
+    buffers->current = 0;
+
+    return buffers;
+}
+
+/**
+ * Free every buffer (loaded or not) and the list itself
+ */
+void buffer_list_free(BufferList *buffers) {
+    if (!buffers)
+        return;
+
+    for (int i = 0; i < buffers->count; i++) {
+        editor_free(buffers->editors[i]);
+        free(buffers->filenames[i]);
+    }
+    free(buffers->editors);
+    free(buffers->filenames);
+    free(buffers);
+}
+
+/**
+ * Get the editor state of the current buffer
+ * The file is read the first time the buffer is shown
+ */
+EditorState *buffer_list_current(BufferList *buffers) {
+    EditorState **editor = &buffers->editors[buffers->current];
+    if (!*editor)
+        *editor = editor_create(buffers->filenames[buffers->current]);
+    return *editor;
+}
+
+/**
+ * Switch to the buffer delta positions away, wrapping around the list
+ * Each buffer keeps its own cursor, search pattern and unsaved edits
+ */
+void buffer_list_switch(BufferList *buffers, int delta) {
+    if (buffers->count <= 1)
+        return;
+
+    // The main loop only commits the journal of the buffer on screen: settle this one first
+    EditorState *previous = buffers->editors[buffers->current];
+    if (previous) {
+        journal_write(&previous->journal);
+        journal_sync(&previous->journal);
+    }
+
+    buffers->current = ((buffers->current + delta) % buffers->count + buffers->count) % buffers->count;
+
+    EditorState *editor = buffer_list_current(buffers);
+
+    // A warning set while loading (invalid UTF-8) takes precedence
+    if (editor->message[0] == '\0') {
+        editor_set_message(editor, "Buffer %d of %d: %s", buffers->current + 1, buffers->count,
+                           buffers->filenames[buffers->current]);
+    }
+}
+
+/**
+ * Collect finished autosaves and compressions of every loaded buffer
+ * Work started before a buffer switch finishes in the background; collecting it releases
+ * its snapshot (until then, leaf texts freed by any buffer are set aside)
+ */
+bool buffer_list_poll(BufferList *buffers) {
+    bool changed = false;
+    for (int i = 0; i < buffers->count; i++) {
+        EditorState *editor = buffers->editors[i];
+        if (!editor)
+            continue;
+        bool saved = editor_autosave_poll(editor);
+        bool compressed = editor_compress_poll(editor);
+        if ((saved || compressed) && i == buffers->current)
+            changed = true;
+    }
+    return changed;
+}
@@ -0,0 +1,38 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "editor.h"
+
+// Files opened in one session (tim2 a b c)
+// Each buffer is a complete editor state; the ropes of all buffers share the rope node pool.
+// A buffer's file is loaded the first time it is shown, so files never switched to cost no memory.
+typedef struct {
+    char **filenames;        // File of each buffer
+    EditorState **editors;   // Editor state of each buffer (NULL until first shown)
+    int count;               // Number of buffers
+    int current;             // Buffer on screen
+} BufferList;
+
+// ========== Lifecycle ==========
+
+// Create a buffer list for the given files (nothing is loaded yet)
+BufferList *buffer_list_create(char **filenames, int count);
+
+// Free every buffer and the list itself
+void buffer_list_free(BufferList *buffers);
+
+// ========== Switching ==========
+
+// Get the editor state of the current buffer, loading its file on first use
+EditorState *buffer_list_current(BufferList *buffers);
+
+// Show the buffer delta positions away (negative = backward), wrapping around
+void buffer_list_switch(BufferList *buffers, int delta);
+
+// ========== Background work ==========
+
+// Collect finished autosaves and compressions of every buffer; returns true if the current
+// buffer's status bar changed
+bool buffer_list_poll(BufferList *buffers);
+
+#endif
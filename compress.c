@@ -0,0 +1,186 @@
+#include <string.h>
+#include <stdint.h>
+#include "compress.h"
+
+// Bytes at the end of a block that are always literals, and the least distance from the end
+// at which a match may start (format rules that let a decoder copy in whole words)
+#define COMPRESS_LAST_LITERALS 5
+#define COMPRESS_MATCH_LIMIT 12
+
+// Longer runs without a match are probed at growing steps (text that does not compress is
+// passed over quickly)
+#define COMPRESS_SKIP_SHIFT 6
+
+/**
+ * Read 4 bytes at p (unaligned)
+ */
+static uint32_t compress_read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Hash table slot of the 4 bytes at a position (multiplicative hash)
+ */
+static int compress_hash(uint32_t v) {
+    return (int)((v * 2654435761u) >> (32 - COMPRESS_HASH_BITS));
+}
+
+/**
+ * Write the bytes of a length that did not fit in its 4-bit token field (15 or more)
+ */
+static unsigned char *compress_write_length(unsigned char *op, int len) {
+    len -= 15;
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+/**
+ * Write one sequence: lit_len literals, then a match of match_len bytes offset back
+ * (match_len 0 = the last sequence, which has literals only)
+ */
+static unsigned char *compress_sequence(unsigned char *op, const char *lit, int lit_len,
+                                        int offset, int match_len) {
+    unsigned char *token = op++;
+    *token = (unsigned char)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15)
+        op = compress_write_length(op, lit_len);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0)
+        return op;
+
+    *op++ = (unsigned char)(offset & 0xff);
+    *op++ = (unsigned char)(offset >> 8);
+    int len = match_len - COMPRESS_MIN_MATCH;
+    *token |= (unsigned char)(len < 15 ? len : 15);
+    if (len >= 15)
+        op = compress_write_length(op, len);
+    return op;
+}
+
+/**
+ * Largest compressed size of len bytes
+ */
+int compress_bound(int len) {
+    return len + len / 255 + 16;
+}
+
+/**
+ * Compress src[0..len) into dst
+ * Greedy: each position is looked up in a hash table of the last position its 4 bytes were
+ * seen at; a hit is extended forward and backward and emitted, a miss becomes a literal
+ */
+int compress_block(const char *src, int len, char *dst) {
+    int table[1 << COMPRESS_HASH_BITS];
+    for (int i = 0; i < (1 << COMPRESS_HASH_BITS); i++)
+        table[i] = -1;
+
+    unsigned char *op = (unsigned char *)dst;
+    int anchor = 0;  // First byte not emitted yet
+    int pos = 0;
+    int match_end = len - COMPRESS_LAST_LITERALS;
+    while (pos < len - COMPRESS_MATCH_LIMIT) {
+        uint32_t seq = compress_read32(src + pos);
+        int h = compress_hash(seq);
+        int ref = table[h];
+        table[h] = pos;
+
+        if (ref < 0 || pos - ref > COMPRESS_MAX_OFFSET || compress_read32(src + ref) != seq) {
+            pos += 1 + ((pos - anchor) >> COMPRESS_SKIP_SHIFT);
+            continue;
+        }
+
+        // Extend backward over literals, then forward as far as the format allows
+        while (pos > anchor && ref > 0 && src[pos - 1] == src[ref - 1]) {
+            pos--;
+            ref--;
+        }
+        int match = COMPRESS_MIN_MATCH;
+        while (pos + match < match_end && src[ref + match] == src[pos + match])
+            match++;
+
+        op = compress_sequence(op, src + anchor, pos - anchor, pos - ref, match);
+        pos += match;
+        anchor = pos;
+
+        // Remember a position inside the match too (repetitive text finds its next match sooner)
+        if (pos < len - COMPRESS_MATCH_LIMIT)
+            table[compress_hash(compress_read32(src + pos - 2))] = pos - 2;
+    }
+
+    op = compress_sequence(op, src + anchor, len - anchor, 0, 0);
+    return (int)(op - (unsigned char *)dst);
+}
+
+/**
+ * Read the rest of a length whose 4-bit token field was 15
+ * Returns false if the input ends first
+ */
+static bool decompress_length(const unsigned char **ip, const unsigned char *end, int *len) {
+    unsigned char b;
+    do {
+        if (*ip >= end)
+            return false;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ * Decompress src[0..size) into dst[0..len)
+ * Every length and offset is checked against both buffers, so corrupt input fails instead of
+ * reading or writing out of bounds
+ */
+bool decompress_block(const char *src, int size, char *dst, int len) {
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *end = ip + size;
+    int out = 0;
+
+    while (ip < end) {
+        int token = *ip++;
+
+        int lit = token >> 4;
+        if (lit == 15 && !decompress_length(&ip, end, &lit))
+            return false;
+        if (lit > end - ip || lit > len - out)
+            return false;
+        memcpy(dst + out, ip, lit);
+        ip += lit;
+        out += lit;
+
+        // The last sequence has no match
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        int offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        int match = token & 15;
+        if (match == 15 && !decompress_length(&ip, end, &match))
+            return false;
+        match += COMPRESS_MIN_MATCH;
+        if (offset == 0 || offset > out || match > len - out)
+            return false;
+
+        // A match may overlap the bytes it produces (a repeated run): copy forward byte by byte
+        char *d = dst + out;
+        if (offset >= match) {
+            memcpy(d, d - offset, match);
+        } else {
+            for (int i = 0; i < match; i++)
+                d[i] = d[i - offset];
+        }
+        out += match;
+    }
+
+    return out == len;
+}
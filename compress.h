@@ -0,0 +1,29 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+
+// Fast LZ77 block codec in the LZ4 block format: a sequence is a token (literal and match
+// lengths), the literals, and a match copied from up to COMPRESS_MAX_OFFSET bytes back.
+// Built for speed over ratio: one hash probe per position, no entropy coding.
+
+// Shortest match worth encoding (a match costs at least 3 bytes)
+#define COMPRESS_MIN_MATCH 4
+
+// Farthest back a match may start (the offset is stored in 2 bytes)
+#define COMPRESS_MAX_OFFSET 65535
+
+// Positions remembered by the match finder (1 << bits entries)
+#define COMPRESS_HASH_BITS 12
+
+// Largest compressed size of len bytes (text that does not compress grows slightly)
+int compress_bound(int len);
+
+// Compress src[0..len) into dst (at least compress_bound(len) bytes); returns the compressed size
+int compress_block(const char *src, int len, char *dst);
+
+// Decompress src[0..size) into dst, which receives exactly len bytes
+// Returns false if the data is corrupt or does not decompress to len bytes
+bool decompress_block(const char *src, int size, char *dst, int len);
+
+#endif
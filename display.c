@@ -8,6 +8,13 @@
 
 static struct termios orig_termios;
 
+// Terminal size, queried at startup and after each resize rather than on every frame
+static int term_rows = 24;
+static int term_cols = 80;
+
+// Frame output is collected here and written with the fflush() that ends display_editor()
+static char output_buffer[DISPLAY_OUTPUT_BUFFER_SIZE];
+
 void term_init(void) {
     tcgetattr(STDIN_FILENO, &orig_termios);
     struct termios raw = orig_termios;
@@ -15,7 +22,10 @@ void term_init(void) {
     raw.c_cc[VMIN] = 1;  // Wait for at least 1 character
     raw.c_cc[VTIME] = 0; // No timeout - immediate response
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+    term_update_size();
     term_hide_cursor();
+    fflush(stdout);
 }
 
 void term_cleanup(void) {
@@ -23,163 +33,272 @@ void term_cleanup(void) {
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
     term_clear();
     term_move_cursor(0, 0);
+    fflush(stdout);
 }
 
+// Terminal escape sequences are buffered like the text around them (no flush per sequence)
 void term_clear(void) {
     printf("\033[2J");
-    fflush(stdout);
 }
 
 void term_move_cursor(int row, int col) {
     printf("\033[%d;%dH", row + 1, col + 1);
-    fflush(stdout);
 }
 
 void term_hide_cursor(void) {
     printf("\033[?25l");
-    fflush(stdout);
 }
 
 void term_show_cursor(void) {
     printf("\033[?25h");
-    fflush(stdout);
 }
 
-void get_terminal_size(int *rows, int *cols) {
+void term_update_size(void) {
     struct winsize ws;
     if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-        *rows = 24;
-        *cols = 80;
+        term_rows = 24;
+        term_cols = 80;
     } else {
-        *rows = ws.ws_row;
-        *cols = ws.ws_col;
+        term_rows = ws.ws_row;
+        term_cols = ws.ws_col;
     }
 }
 
-// Calculate display width of a character (1 for regular, 4 for tab)
-int char_display_width(char c) {
-    if (c == '\t')
-        return 4;
-    return 1;
+void get_terminal_size(int *rows, int *cols) {
+    *rows = term_rows;
+    *cols = term_cols;
+}
+
+// Calculate display width of the character starting at s (TAB_WIDTH for tab, 2 for wide, 0 for combining)
+int char_display_width(char *s, int len) {
+    return char_width(s, len);
 }
 
 // Calculate display column from character position in a string
 int get_display_col(char *str, int char_pos) {
     int display_col = 0;
     for (int i = 0; i < char_pos && str[i] != '\0' && str[i] != '\n'; i++) {
-        display_col += char_display_width(str[i]);
+        display_col += char_display_width(str + i, char_pos - i);
     }
     return display_col;
 }
 
 // Calculate display column from rope position on a line
+// Uses the rope's width metadata: O(log n) regardless of how many tabs precede it
 int get_display_col_from_rope(EditorState *editor, int line, int char_col) {
     if (!editor || !editor->rope)
         return char_col;
 
-    int line_start = get_line_start(editor->rope, line);
-    int display_col = 0;
+    int line_start = editor_line_start(editor, line);
+    return get_display_offset(editor->rope, line_start + char_col) -
+           get_display_offset(editor->rope, line_start);
+}
 
-    for (int i = 0; i < char_col; i++) {
-        char c = char_at(editor->rope, line_start + i);
-        if (c == '\0' || c == '\n')
-            break;
-        display_col += char_display_width(c);
-    }
+// Print one byte with tab expansion, tracking the displayed width
+// width = columns of the character the byte starts (0 for UTF-8 continuation bytes)
+// Returns false without printing if the character does not fit before the screen edge
+bool display_char(char c, int width, int *displayed, int cols) {
+    // Continuation bytes always complete a lead byte that was printed
+    if (!utf8_is_continuation(c) && *displayed + (c == '\t' ? 1 : width) > cols)
+        return false;
 
-    return display_col;
+    if (c == '\t')
+        printf("%*s", TAB_WIDTH, "");
+    else if (c != '\0')
+        putchar(c);
+    *displayed += width;
+    return true;
 }
 
-// Helper to get a line from the insert buffer
-void get_buffer_line(char *buffer, int buffer_len, int line_offset, char *output, int max_len) {
-    int current_line = 0;
-    int start_idx = 0;
+// Print a byte that is not valid UTF-8 as a highlighted '?' (one column, like U+FFFD)
+// Stray continuation bytes have no width of their own and are not drawn
+bool display_invalid_byte(char c, int *displayed, int cols) {
+    if (utf8_is_continuation(c))
+        return true;
+    if (*displayed + 1 > cols)
+        return false;
+
+    printf("\033[7m?\033[m");
+    *displayed += 1;
+    return true;
+}
 
-    // Find the start of the desired line in buffer
-    for (int i = 0; i < buffer_len; i++) {
-        if (buffer[i] == '\n') {
-            if (current_line == line_offset) {
-                break;
+// Print rope characters in [from, to), stopping at a newline or the screen edge
+// Walks the leaves with an iterator instead of one char_at descent per character
+// (leaves never split a UTF-8 sequence, so each character is decoded within its leaf)
+void display_rope_range(RopeNode *rope, int from, int to, int *displayed, int cols) {
+    RopeIter it;
+    for (rope_iter_init(&it, rope, from); it.leaf && it.leaf_start < to; rope_iter_next(&it)) {
+        char *str = rope_leaf_text(it.leaf);
+        int len = it.leaf->total_len;
+        int i = from > it.leaf_start ? from - it.leaf_start : 0;
+        while (i < len && it.leaf_start + i < to) {
+            if (str[i] == '\n')
+                return;
+
+            // Malformed input: never send the raw byte to the terminal
+            int cp;
+            int n = (unsigned char)str[i] < 0x80 ? 1 : utf8_decode(str + i, len - i, &cp);
+            if (n == 1 && (unsigned char)str[i] >= 0x80) {
+                if (!display_invalid_byte(str[i], displayed, cols))
+                    return;
+                i++;
+                continue;
             }
-            current_line++;
-            start_idx = i + 1;
+
+            if (!display_char(str[i], char_width(str + i, len - i), displayed, cols))
+                return;
+            for (int k = 1; k < n; k++)
+                putchar(str[i + k]);
+            i += n;
         }
     }
+}
 
-    // If we haven't found enough lines, return empty
-    if (current_line < line_offset) {
-        output[0] = '\0';
-        return;
+// Display width of the character starting at logical index b of the insert buffer
+int buffer_char_width(EditorState *editor, int b) {
+    char seq[4];
+    int n = 0;
+    while (n < 4 && b + n < editor->insert_buffer_len) {
+        seq[n] = editor_insert_buffer_char(editor, b + n);
+        n++;
     }
+    return char_width(seq, n);
+}
+
+// Find start index of a line inside the insert buffer (0 = first line)
+int get_buffer_line_start(EditorState *editor, int line_offset) {
+    if (line_offset == 0)
+        return 0;
 
-    // Copy the line
-    int out_idx = 0;
-    for (int i = start_idx; i < buffer_len && buffer[i] != '\n' && out_idx < max_len - 1; i++) {
-        output[out_idx++] = buffer[i];
+    int current_line = 0;
+    for (int i = 0; i < editor->insert_buffer_len; i++) {
+        if (editor_insert_buffer_char(editor, i) == '\n') {
+            current_line++;
+            if (current_line == line_offset)
+                return i + 1;
+        }
     }
-    output[out_idx] = '\0';
+    return editor->insert_buffer_len;
 }
 
-// Count newlines in buffer
-int count_buffer_newlines(char *buffer, int buffer_len) {
+// Count newlines in the insert buffer
+int count_buffer_newlines(EditorState *editor) {
     int count = 0;
-    for (int i = 0; i < buffer_len; i++) {
-        if (buffer[i] == '\n')
+    for (int i = 0; i < editor->insert_buffer_len; i++) {
+        if (editor_insert_buffer_char(editor, i) == '\n')
             count++;
     }
     return count;
 }
 
-void display_content(EditorState *editor, int rows, int cols) {
-    if (!editor)
-        return;
+// Blank the rest of a view row (spaces rather than \033[K, which would also erase views to the right)
+void display_pad(int displayed, int cols) {
+    if (displayed < cols)
+        printf("%*s", cols - displayed, "");
+}
 
-    // Handle empty rope
-    if (!editor->rope || editor->rope->total_len == 0) {
-        if (editor->mode == MODE_INSERT && editor->insert_buffer_len > 0) {
-            // Display buffer content even with empty rope
-            int line = 0;
-            int idx = 0;
-            term_move_cursor(0, 0);
-
-            while (idx < editor->insert_buffer_len && line < rows - 1) {
-                int col = 0;
-                while (idx < editor->insert_buffer_len && col < cols) {
-                    if (editor->insert_buffer[idx] == '\n') {
-                        printf("\033[K");
-                        idx++;
-                        line++;
-                        if (line < rows - 1)
-                            term_move_cursor(line, 0);
-                        break;
-                    } else {
-                        if (editor->insert_buffer[idx] == '\t') {
-                            printf("    ");
-                            col += 4;
-                        } else {
-                            putchar(editor->insert_buffer[idx]);
-                            col++;
-                        }
-                        idx++;
-                    }
-                }
-                if (col < cols && idx >= editor->insert_buffer_len) {
-                    printf("\033[K");
-                    line++;
-                }
-            }
+// Hide the first *skip columns of rope range [from, to) on a row scrolled to the right
+// Seeks with the width metadata instead of walking the hidden text: O(log n) however long the line
+// A tab or wide character cut by the left edge shows as blanks; returns where drawing resumes
+int display_rope_skip(RopeNode *rope, int from, int to, int *skip, int *displayed, int cols) {
+    if (*skip <= 0 || from >= to)
+        return from;
+
+    int base = get_display_offset(rope, from);
+    int pos = find_display_offset(rope, base + *skip);
+    if (pos >= to) {
+        // The whole range lies left of the view
+        *skip -= get_display_offset(rope, to) - base;
+        return to;
+    }
 
-            // Fill remaining lines with tildes
-            for (int i = line; i < rows - 1; i++) {
-                term_move_cursor(i, 0);
-                printf("~\033[K");
-            }
+    int start = get_display_offset(rope, pos);
+    int cut = base + *skip - start;
+    *skip = 0;
+    if (cut == 0)
+        return pos;
+
+    int next = rope_next_char(rope, pos);
+    int blanks = get_display_offset(rope, next) - start - cut;
+    display_pad(0, blanks < cols - *displayed ? blanks : cols - *displayed);
+    *displayed += blanks;
+    return next;
+}
+
+// Hide the first *skip columns of the insert buffer line starting at b (same as display_rope_skip)
+// Returns the buffer index where drawing resumes
+int display_buffer_skip(EditorState *editor, int b, int *skip, int *displayed, int cols) {
+    if (*skip <= 0)
+        return b;
+
+    while (*skip > 0 && b < editor->insert_buffer_len && editor_insert_buffer_char(editor, b) != '\n') {
+        int width = buffer_char_width(editor, b++);
+        if (width > *skip) {
+            int blanks = width - *skip;
+            display_pad(0, blanks < cols - *displayed ? blanks : cols - *displayed);
+            *displayed += blanks;
+            *skip = 0;
         } else {
-            // Empty file, show tildes
-            for (int i = 0; i < rows - 1; i++) {
-                term_move_cursor(i, 0);
-                printf("~\033[K");
-            }
+            *skip -= width;
+        }
+    }
+
+    // Continuation bytes and combining marks belong to the hidden character before them
+    while (b < editor->insert_buffer_len && editor_insert_buffer_char(editor, b) != '\n' &&
+           buffer_char_width(editor, b) == 0)
+        b++;
+    return b;
+}
+
+// Display column of the focused view's cursor within its line
+// In INSERT mode the cursor sits at the gap of the insert buffer
+int display_cursor_col(EditorState *editor) {
+    if (editor->mode != MODE_INSERT)
+        return get_display_col_from_rope(editor, editor->cursor_line, editor->cursor_col);
+
+    int line_start_in_buffer = 0;
+    for (int i = editor->insert_gap - 1; i >= 0; i--) {
+        if (editor->insert_buffer[i] == '\n') {
+            line_start_in_buffer = i + 1;
+            break;
+        }
+    }
+
+    // On the first line of insertion: rope before insert + buffer content before the gap
+    int display_col = 0;
+    if (editor->cursor_line == editor->insert_start_line)
+        display_col = get_display_col_from_rope(editor, editor->insert_start_line, editor->insert_start_col);
+
+    // Buffer content between the start of this line and the gap
+    for (int i = line_start_in_buffer; i < editor->insert_gap; i++)
+        display_col += char_display_width(editor->insert_buffer + i, editor->insert_gap - i);
+    return display_col;
+}
+
+// Render the rope into one view's screen rectangle
+// The focused view uses the editor's cursor and shows pending INSERT/DELETE text;
+// other views show the rope as it is, from their saved position
+void display_content(EditorState *editor, ViewNode *view) {
+    if (!editor)
+        return;
+
+    bool active = view == editor->active_view;
+    EditorMode mode = active ? editor->mode : MODE_NORMAL;
+    int cursor_line = active ? editor->cursor_line : view->cursor_line;
+    int *top_line = active ? &editor->top_line : &view->top_line;
+    int *left_col = active ? &editor->left_col : &view->left_col;
+    int rows = view->height;
+    int cols = view->width;
+
+    // Handle empty rope (pending insert text is rendered by the normal path)
+    if ((!editor->rope || editor->rope->total_len == 0) &&
+        !(mode == MODE_INSERT && editor->insert_buffer_len > 0)) {
+        // Empty file, show tildes
+        for (int i = 0; i < rows; i++) {
+            term_move_cursor(view->row + i, view->col);
+            printf("~");
+            display_pad(1, cols);
         }
         return;
     }
@@ -187,181 +306,124 @@ void display_content(EditorState *editor, int rows, int cols) {
     int total_lines = count_total_lines(editor->rope);
 
     // Adjust top_line for scrolling
-    if (editor->cursor_line < editor->top_line) {
-        editor->top_line = editor->cursor_line;
+    if (cursor_line < *top_line) {
+        *top_line = cursor_line;
     }
-    if (editor->cursor_line >= editor->top_line + rows - 1) {
-        editor->top_line = editor->cursor_line - rows + 2;
+    if (cursor_line >= *top_line + rows) {
+        *top_line = cursor_line - rows + 1;
     }
 
-    if (editor->top_line < 0)
-        editor->top_line = 0;
+    if (*top_line < 0)
+        *top_line = 0;
+
+    // Adjust left_col so the cursor's column stays in view: a cursor leaving either side
+    // lands mid-view, so moving along a long line scrolls half a screen at a time
+    int cursor_col = active ? display_cursor_col(editor)
+                            : get_display_col_from_rope(editor, cursor_line, view->cursor_col);
+    if (cursor_col < *left_col || cursor_col >= *left_col + cols)
+        *left_col = cursor_col - cols / 2 > 0 ? cursor_col - cols / 2 : 0;
 
     // In INSERT mode, calculate how many extra lines the buffer adds
     int buffer_newlines = 0;
     int insert_rope_line = 0;
 
-    if (editor->mode == MODE_INSERT) {
-        buffer_newlines = count_buffer_newlines(editor->insert_buffer, editor->insert_buffer_len);
-        // Find which line in the rope the insert started
-        if (editor->insert_start_pos >= 0 && editor->insert_start_pos <= editor->rope->total_len) {
-            int pos = 0;
-            insert_rope_line = 0;
-            while (pos < editor->insert_start_pos) {
-                char c = char_at(editor->rope, pos);
-                if (c == '\n')
-                    insert_rope_line++;
-                pos++;
-            }
-        }
+    if (mode == MODE_INSERT) {
+        buffer_newlines = count_buffer_newlines(editor);
+        insert_rope_line = editor->insert_start_line;
     }
 
-    // Display lines
-    for (int i = 0; i < rows - 1; i++) {
-        int line_num = editor->top_line + i;
-        term_move_cursor(i, 0);
+    // In DELETE mode, a pending range hides text and joins lines
+    bool delete_pending = mode == MODE_DELETE && editor->delete_end > editor->delete_start;
+    int delete_line = cursor_line;
+    int deleted_newlines = delete_pending ? editor->delete_end_line - delete_line : 0;
+
+    // Rope line following the last rendered one, and where it starts
+    int next_line = -1;
+    int next_line_start = 0;
+
+    // Display lines; each row seeks straight to its first visible column, so a frame costs
+    // the same on a multi-megabyte line as on a short one
+    for (int i = 0; i < rows; i++) {
+        int line_num = *top_line + i;
+        int skip = *left_col;
+        term_move_cursor(view->row + i, view->col);
 
         // In INSERT mode, check if this line is affected by the buffer
-        if (editor->mode == MODE_INSERT && line_num >= insert_rope_line &&
-            line_num < insert_rope_line + buffer_newlines + 1) {
+        if (mode == MODE_INSERT && line_num >= insert_rope_line &&
+            line_num <= insert_rope_line + buffer_newlines) {
 
             int buffer_line_offset = line_num - insert_rope_line;
+            int line_end = rope_line_end(editor->rope, editor->insert_start_pos);
+            int displayed = 0;
 
+            // First line: rope content before the insert point
             if (buffer_line_offset == 0) {
-                // First line: show rope content before insert + buffer content (may span multiple display lines)
-                int line_start = get_line_start(editor->rope, insert_rope_line);
-                int line_end = line_start + get_line_length(editor->rope, insert_rope_line);
-                int insert_offset = editor->insert_start_pos - line_start;
+                int line_start = editor_line_start(editor, insert_rope_line);
+                int from = display_rope_skip(editor->rope, line_start, editor->insert_start_pos,
+                                             &skip, &displayed, cols);
+                display_rope_range(editor->rope, from, editor->insert_start_pos, &displayed, cols);
+            }
 
-                int displayed = 0;
+            // Buffer content for this line (up to the next newline or end of buffer)
+            int b = get_buffer_line_start(editor, buffer_line_offset);
+            b = display_buffer_skip(editor, b, &skip, &displayed, cols);
+            for (; b < editor->insert_buffer_len; b++) {
+                char c = editor_insert_buffer_char(editor, b);
+                if (c == '\n' || !display_char(c, buffer_char_width(editor, b), &displayed, cols))
+                    break;
+            }
 
-                // Content before insert point
-                for (int j = 0; j < insert_offset && line_start + j < editor->rope->total_len && displayed < cols; j++) {
-                    char c = char_at(editor->rope, line_start + j);
-                    if (c == '\n')
-                        break;
-                    if (c == '\t') {
-                        printf("    ");
-                        displayed += 4;
-                    } else if (c != '\0') {
-                        putchar(c);
-                        displayed++;
-                    }
-                }
-
-                // Buffer content for this line (only up to first newline or end of buffer)
-                for (int b = 0; b < editor->insert_buffer_len && displayed < cols; b++) {
-                    if (editor->insert_buffer[b] == '\n')
-                        break;
-                    if (editor->insert_buffer[b] == '\t') {
-                        printf("    ");
-                        displayed += 4;
-                    } else {
-                        putchar(editor->insert_buffer[b]);
-                        displayed++;
-                    }
-                }
-
-                // Check if buffer contains newline - determines if we show rest of line
-                int first_newline_pos = -1;
-                for (int b = 0; b < editor->insert_buffer_len; b++) {
-                    if (editor->insert_buffer[b] == '\n') {
-                        first_newline_pos = b;
-                        break;
-                    }
-                }
-
-                // If no newline in buffer, show content after insert point from original line
-                if (first_newline_pos == -1) {
-                    for (int j = insert_offset; line_start + j < line_end && displayed < cols; j++) {
-                        char c = char_at(editor->rope, line_start + j);
-                        if (c == '\n')
-                            break;
-                        if (c == '\t') {
-                            printf("    ");
-                            displayed += 4;
-                        } else if (c != '\0') {
-                            putchar(c);
-                            displayed++;
-                        }
-                    }
-                }
-
-                printf("\033[K");
-            } else {
-                // Lines created by newlines in the buffer
-                char line_buffer[1024];
-                get_buffer_line(editor->insert_buffer, editor->insert_buffer_len,
-                               buffer_line_offset, line_buffer, sizeof(line_buffer));
+            // Last buffer line: remainder of the original line after the insert point
+            if (buffer_line_offset == buffer_newlines) {
+                int from = display_rope_skip(editor->rope, editor->insert_start_pos, line_end,
+                                             &skip, &displayed, cols);
+                display_rope_range(editor->rope, from, line_end, &displayed, cols);
+            }
 
-                int displayed = 0;
+            display_pad(displayed, cols);
+        } else if (delete_pending && line_num == delete_line) {
+            // Line joined by the pending deletion: text before the range + text after it
+            int line_start = editor_line_start(editor, delete_line);
+            int end_line_end = rope_line_end(editor->rope, editor->delete_end);
+            int displayed = 0;
 
-                // Display buffer line content
-                for (int j = 0; line_buffer[j] != '\0' && displayed < cols; j++) {
-                    if (line_buffer[j] == '\t') {
-                        printf("    ");
-                        displayed += 4;
-                    } else {
-                        putchar(line_buffer[j]);
-                        displayed++;
-                    }
-                }
-
-                // If this is the last buffer line and buffer doesn't end with newline,
-                // show the rest of the original line
-                int last_buffer_line = buffer_line_offset;
-                int actual_buffer_newlines = count_buffer_newlines(editor->insert_buffer, editor->insert_buffer_len);
-
-                if (last_buffer_line == actual_buffer_newlines) {
-                    // This is the last line from buffer
-                    // Show remainder of original line
-                    int line_start = get_line_start(editor->rope, insert_rope_line);
-                    int line_end = line_start + get_line_length(editor->rope, insert_rope_line);
-                    int insert_offset = editor->insert_start_pos - line_start;
-
-                    for (int j = insert_offset; line_start + j < line_end && displayed < cols; j++) {
-                        char c = char_at(editor->rope, line_start + j);
-                        if (c == '\n')
-                            break;
-                        if (c == '\t') {
-                            printf("    ");
-                            displayed += 4;
-                        } else if (c != '\0') {
-                            putchar(c);
-                            displayed++;
-                        }
-                    }
-                }
-
-                printf("\033[K");
-            }
+            int from = display_rope_skip(editor->rope, line_start, editor->delete_start, &skip, &displayed, cols);
+            display_rope_range(editor->rope, from, editor->delete_start, &displayed, cols);
+            from = display_rope_skip(editor->rope, editor->delete_end, end_line_end, &skip, &displayed, cols);
+            display_rope_range(editor->rope, from, end_line_end, &displayed, cols);
+
+            display_pad(displayed, cols);
         } else {
             // Normal line display
             int actual_line = line_num;
 
             // Adjust line number if we're past the insert point
-            if (editor->mode == MODE_INSERT && line_num > insert_rope_line) {
+            if (mode == MODE_INSERT && line_num > insert_rope_line) {
                 actual_line = line_num - buffer_newlines;
             }
 
+            // Adjust line number if we're past the pending deletion
+            if (delete_pending && line_num > delete_line) {
+                actual_line = line_num + deleted_newlines;
+            }
+
             if (actual_line >= 0 && actual_line < total_lines) {
-                int line_start = get_line_start(editor->rope, actual_line);
-                int line_len = get_line_length(editor->rope, actual_line);
+                // Consecutive rows continue after the previous row's newline,
+                // so only the first visible line needs an index lookup
+                int line_start = (actual_line == next_line) ? next_line_start
+                                                             : editor_line_start(editor, actual_line);
+                int line_end = rope_line_end(editor->rope, line_start);
 
                 int displayed = 0;
-                for (int j = 0; j < line_len && displayed < cols; j++) {
-                    char c = char_at(editor->rope, line_start + j);
-                    if (c == '\t') {
-                        printf("    ");
-                        displayed += 4;
-                    } else if (c != '\0') {
-                        putchar(c);
-                        displayed++;
-                    }
-                }
-                printf("\033[K");
+                int from = display_rope_skip(editor->rope, line_start, line_end, &skip, &displayed, cols);
+                display_rope_range(editor->rope, from, line_end, &displayed, cols);
+                display_pad(displayed, cols);
+
+                next_line = actual_line + 1;
+                next_line_start = line_end + 1;
             } else {
-                printf("~\033[K");
+                printf("~");
+                display_pad(1, cols);
             }
         }
     }
@@ -370,6 +432,13 @@ void display_content(EditorState *editor, int rows, int cols) {
 void display_status_bar(EditorState *editor, int rows, int cols) {
     term_move_cursor(rows - 1, 0);
 
+    // SEARCH mode turns the status bar into the prompt line
+    if (editor->mode == MODE_SEARCH || editor->mode == MODE_COMMAND) {
+        char lead = editor->mode == MODE_COMMAND ? ':' : editor->search_backward ? '?' : '/';
+        printf("%c%s\033[K", lead, editor->prompt);
+        return;
+    }
+
     // Set inverted colors for status bar
     printf("\033[7m");
 
@@ -383,8 +452,18 @@ void display_status_bar(EditorState *editor, int rows, int cols) {
         case MODE_INSERT:
             strcpy(mode_str, "INSERT");
             break;
+        case MODE_SEARCH:
+            strcpy(mode_str, "SEARCH");
+            break;
+        case MODE_COMMAND:
+            strcpy(mode_str, "COMMAND");
+            break;
         case MODE_DELETE:
-            strcpy(mode_str, "DELETE");
+            // Show the pending count prefix, e.g. "DELETE 500"
+            if (editor->delete_repeat > 0)
+                snprintf(mode_str, sizeof(mode_str), "DELETE %d", editor->delete_repeat);
+            else
+                strcpy(mode_str, "DELETE");
             break;
     }
 
@@ -393,90 +472,118 @@ void display_status_bar(EditorState *editor, int rows, int cols) {
 
     snprintf(status, sizeof(status), " %s %c | %s | Line %d, Col %d ",
              filename, modified_indicator, mode_str,
-             editor->cursor_line + 1, editor->cursor_col + 1);
+             editor->cursor_line + 1, editor_get_char_col(editor) + 1);
+
+    // Autosave progress, or the age of the last autosave
+    Autosave *autosave = &editor->autosave;
+    int age = autosave_age(autosave);
+    int len = strlen(status);
+    if (autosave->running)
+        snprintf(status + len, sizeof(status) - len, "| Autosaving %d%% ", autosave_progress(autosave));
+    else if (autosave->failed)
+        snprintf(status + len, sizeof(status) - len, "| Autosave failed ");
+    else if (age >= 0 && age < 60)
+        snprintf(status + len, sizeof(status) - len, "| Autosaved %ds ago ", age);
+    else if (age >= 60)
+        snprintf(status + len, sizeof(status) - len, "| Autosaved %dm ago ", age / 60);
+
+    // Progress of the rest of a large file loading in the background
+    if (rope_load_active(&editor->loader)) {
+        len = strlen(status);
+        snprintf(status + len, sizeof(status) - len, "| Loading %d%% ", rope_load_progress(&editor->loader));
+    }
+
+    // Progress of text being compressed in the background
+    if (editor->freeze) {
+        len = strlen(status);
+        snprintf(status + len, sizeof(status) - len, "| Compressing %d%% ", rope_freeze_progress(editor->freeze));
+    }
+
+    // Progress of a count running in the background
+    if (editor->count.running) {
+        len = strlen(status);
+        snprintf(status + len, sizeof(status) - len, "| Counting %d%% ",
+                 snapshot_count_progress(&editor->count));
+    }
+
+    // Append one-shot message (search results etc.)
+    if (editor->message[0] != '\0') {
+        len = strlen(status);
+        snprintf(status + len, sizeof(status) - len, "| %s ", editor->message);
+    }
 
     printf("%-*s", cols, status);
 
     // Reset colors
     printf("\033[0m");
-    fflush(stdout);
+}
+
+// Render every view of a layout subtree, then the separator between its halves
+// (separators come last so that no view row can overwrite them)
+void display_layout(EditorState *editor, ViewNode *node) {
+    if (node->split == SPLIT_NONE) {
+        display_content(editor, node);
+        return;
+    }
+
+    display_layout(editor, node->first);
+    display_layout(editor, node->second);
+
+    if (node->split == SPLIT_HORIZONTAL) {
+        term_move_cursor(node->first->row + node->first->height, node->col);
+        for (int i = 0; i < node->width; i++)
+            putchar('-');
+    } else {
+        for (int i = 0; i < node->height; i++) {
+            term_move_cursor(node->row + i, node->first->col + node->first->width);
+            putchar('|');
+        }
+    }
 }
 
 void display_editor(EditorState *editor) {
     int rows, cols;
     get_terminal_size(&rows, &cols);
 
+    // Views share the screen above the status bar
+    ViewNode *view = editor->active_view;
+    view_layout(editor->views, 0, 0, rows - 1, cols);
+
+    term_hide_cursor();
     term_clear();
-    display_content(editor, rows, cols);
+    display_layout(editor, editor->views);
     display_status_bar(editor, rows, cols);
 
-    // Position cursor
+    // Position cursor inside the focused view
     int screen_row = editor->cursor_line - editor->top_line;
 
     // Clamp screen position
+    if (screen_row >= view->height)
+        screen_row = view->height - 1;
     if (screen_row < 0)
         screen_row = 0;
-    if (screen_row >= rows - 1)
-        screen_row = rows - 2;
+    screen_row += view->row;
 
-    // Calculate display column accounting for tabs
-    int display_col = 0;
+    // Display column accounting for tabs, relative to the view's horizontal scroll
+    int display_col = display_cursor_col(editor) - editor->left_col;
 
-    if (editor->mode == MODE_INSERT) {
-        // In insert mode, we need to account for both rope and buffer
-        int insert_line = 0;
-        int pos = 0;
-
-        // Find which line the insert started on
-        if (editor->rope && editor->insert_start_pos >= 0 && editor->insert_start_pos <= editor->rope->total_len) {
-            while (pos < editor->insert_start_pos) {
-                if (char_at(editor->rope, pos) == '\n')
-                    insert_line++;
-                pos++;
-            }
-        }
-
-        if (editor->cursor_line == insert_line) {
-            // On the first line of insertion
-            // Display col = rope before insert + buffer content
-            int line_start = get_line_start(editor->rope, insert_line);
-            int insert_offset = editor->insert_start_pos - line_start;
-
-            display_col = get_display_col_from_rope(editor, insert_line, insert_offset);
-            display_col += get_display_col(editor->insert_buffer, editor->insert_buffer_len);
-        } else if (editor->cursor_line > insert_line) {
-            // On a new line created in buffer
-            int buffer_line_offset = editor->cursor_line - insert_line;
-
-            // Find the start of this line in the buffer
-            int newline_count = 0;
-            int line_start_in_buffer = 0;
-            for (int i = 0; i < editor->insert_buffer_len; i++) {
-                if (editor->insert_buffer[i] == '\n') {
-                    newline_count++;
-                    if (newline_count == buffer_line_offset) {
-                        line_start_in_buffer = i + 1;
-                        break;
-                    }
-                }
-            }
-
-            // Calculate display column from that point
-            display_col = get_display_col(editor->insert_buffer + line_start_in_buffer,
-                                         editor->insert_buffer_len - line_start_in_buffer);
-        }
-    } else {
-        // In normal or delete mode, just calculate from rope
-        display_col = get_display_col_from_rope(editor, editor->cursor_line, editor->cursor_col);
-    }
-
-    if (display_col >= cols)
-        display_col = cols - 1;
+    if (display_col >= view->width)
+        display_col = view->width - 1;
     if (display_col < 0)
         display_col = 0;
+    display_col += view->col;
+
+    // While typing a pattern the cursor sits on the prompt line
+    if (editor->mode == MODE_SEARCH || editor->mode == MODE_COMMAND) {
+        screen_row = rows - 1;
+        display_col = editor->prompt_len + 1;
+        if (display_col >= cols)
+            display_col = cols - 1;
+    }
 
     term_move_cursor(screen_row, display_col);
     term_show_cursor();
 
+    // The whole frame goes out in one write
     fflush(stdout);
 }
@@ -3,6 +3,9 @@
 
 #include "editor.h"
 
+// Output buffered per frame (a full screen of text and escape sequences fits)
+#define DISPLAY_OUTPUT_BUFFER_SIZE (256 * 1024)
+
 // ========== Terminal control ==========
 
 // Initialize terminal in raw mode for immediate input
@@ -31,18 +34,24 @@ void display_editor(EditorState *editor);
 // Render status bar at bottom of screen
 void display_status_bar(EditorState *editor, int rows, int cols);
 
-// Render text content area
-void display_content(EditorState *editor, int rows, int cols);
+// Render one view of the rope into its screen rectangle
+void display_content(EditorState *editor, ViewNode *view);
+
+// Render every view of a layout subtree and the separators between them
+void display_layout(EditorState *editor, ViewNode *node);
 
 // ========== Terminal size ==========
 
-// Get current terminal dimensions
+// Query the terminal size again (at startup and after SIGWINCH)
+void term_update_size(void);
+
+// Get terminal dimensions as of the last term_update_size()
 void get_terminal_size(int *rows, int *cols);
 
-// ========== Helper functions for tab handling ==========
+// ========== Helper functions for tab and UTF-8 handling ==========
 
-// Calculate display width of a character (4 for tab, 1 for others)
-int char_display_width(char c);
+// Calculate display width of the character starting at s (TAB_WIDTH for tab, 2 for wide, 0 for combining)
+int char_display_width(char *s, int len);
 
 // Calculate display column from character position in string
 int get_display_col(char *str, int char_pos);
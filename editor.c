@@ -1,7 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
 #include "editor.h"
+#include "event.h"
+
+/**
+ * Say how many bytes of the loaded file are invalid UTF-8 and where the first one is
+ */
+static void editor_warn_utf8(EditorState *editor, int count, int first) {
+    if (count > 0)
+        editor_set_message(editor, "Warning: %d invalid UTF-8 byte%s (first on line %d)",
+                           count, count == 1 ? "" : "s", get_line_from_pos(editor->rope, first) + 1);
+}
 
 /**
  * Create a new editor state
@@ -18,32 +31,99 @@ EditorState *editor_create(char *filename) {
     // Copy filename if provided
     editor->filename = filename ? string_copy(filename) : NULL;
 
-    // Load file into rope if filename exists
-    editor->rope = filename ? load_file(filename) : NULL;
+    // Load file into rope if filename exists (stamped first, so a write during loading counts as a change)
+    // A large file shows its start at once and loads the rest in the background, unless a
+    // journal left by a crash is to be replayed onto the whole file
+    Utf8Errors utf8_errors = {0, -1};
+    journal_init(&editor->journal, filename);
+    autosave_init(&editor->autosave, filename);
+    editor->loader.fd = -1;
+    editor->load_start = event_now_ms();
+    if (filename) {
+        file_stamp_read(&editor->disk, filename);
+        editor->rope = journal_exists(&editor->journal)
+                           ? load_file(filename, &utf8_errors)
+                           : load_file_lazy(filename, &editor->loader, &utf8_errors);
+    }
 
     // If file is empty or doesn't exist, create empty rope
     if (!editor->rope) {
         editor->rope = build_rope("");
     }
 
+    // Invalid bytes are kept as they are (drawn highlighted); a file still loading reports them at the end
+    if (!rope_load_active(&editor->loader))
+        editor_warn_utf8(editor, utf8_errors.count, utf8_errors.first);
+
+    // Line index is built on first lookup
+    line_index_init(&editor->line_index);
+
     // Initialize cursor at top-left
     editor->cursor_line = 0;
     editor->cursor_col = 0;
     editor->top_line = 0;
+    editor->left_col = 0;
+
+    // One view covering the screen
+    editor->views = view_create();
+    editor->active_view = editor->views;
+
+    // Line metrics are computed on first cursor query; edit generation 0 means "never"
+    editor->line_cache_valid = false;
+    editor->edits = 1;
 
     // File starts unmodified
     editor->modified = false;
 
+
     // Start in NORMAL mode
     editor->mode = MODE_NORMAL;
 
-    // Clear insert buffer
-    editor->insert_buffer[0] = '\0';
+    // Allocate an empty insert gap buffer (the whole buffer is gap)
+    editor->insert_buffer = malloc(INSERT_BUFFER_INITIAL_SIZE);
+    if (!editor->insert_buffer) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    editor->insert_buffer_cap = INSERT_BUFFER_INITIAL_SIZE;
     editor->insert_buffer_len = 0;
+    editor->insert_gap = 0;
     editor->insert_start_pos = 0;
+    editor->insert_start_line = 0;
+    editor->insert_start_col = 0;
+
+    // No pending deletion
+    editor->delete_start = 0;
+    editor->delete_end = 0;
+    editor->delete_end_line = 0;
+    editor->delete_repeat = 0;
+
+    // Edits journaled by a session that did not exit are replayed onto the file
+    if (filename) {
+        double start = event_now_ms();
+        int recovered = journal_recover(&editor->journal, filename, &editor->disk, &editor->rope);
+        if (recovered > 0) {
+            editor->modified = true;
+            autosave_note_edit(&editor->autosave);
+            editor_set_message(editor, "Recovered %d edit%s from %s (%.0f ms)", recovered,
+                               recovered == 1 ? "" : "s", editor->journal.path, event_now_ms() - start);
+        } else if (recovered == -1) {
+            editor_set_message(editor, "Journal %s does not match the file; moved to %s.old",
+                               editor->journal.path, editor->journal.path);
+        }
+        if (!editor->rope)
+            editor->rope = build_rope("");
+    }
 
-    // Reset delete counter
-    editor->delete_count = 0;
+    // A sidecar left by an earlier session replaces the index (if it still matches the file)
+    // and is kept up to date from now on
+    if (filename) {
+        editor->index_path = line_index_sidecar_path(filename);
+        editor->index_keep = access(editor->index_path, F_OK) == 0;
+        if (editor->index_keep && !editor->modified &&
+            line_index_load(&editor->line_index, editor->index_path, filename, &editor->disk))
+            editor->index_stamp = editor->disk;
+    }
 
     return editor;
 }
@@ -55,32 +135,151 @@ void editor_free(EditorState *editor) {
     if (!editor)
         return;
 
+    // Stop loading the rest of the file
+    rope_load_cancel(&editor->loader);
+
+    // Stop compressing
+    if (editor->freeze)
+        rope_freeze_cancel(editor->freeze);
+
     // Free rope structure
     if (editor->rope)
         free_rope(editor->rope);
 
+    // Free line index
+    line_index_free(&editor->line_index);
+
+    // Free window layout
+    view_free(editor->views);
+
+    // Stop following
+    if (editor->following)
+        file_watch_close(&editor->follow);
+
+    // Quitting gives up unsaved edits, so their journal goes too
+    journal_discard(&editor->journal);
+    journal_free(&editor->journal);
+
+    // A save still being written is finished first (the leaf texts it reads were set aside above)
+    autosave_free(&editor->autosave);
+
+    // A count still running is stopped (it reads the same set-aside texts)
+    snapshot_count_abort(&editor->count);
+
+    // Free last search pattern
+    if (editor->search_pattern)
+        free(editor->search_pattern);
+
+    // Free compiled regex
+    free(editor->regex_source);
+    regexp_free(editor->regex);
+
     // Free filename string
     if (editor->filename)
         free(editor->filename);
+    free(editor->index_path);
+
+    // Free insert gap buffer
+    if (editor->insert_buffer)
+        free(editor->insert_buffer);
 
     // Free editor state itself
     free(editor);
 }
 
+/**
+ * Drop cached cursor line metrics
+ * Must be called whenever the rope changes
+ */
+void editor_invalidate_line_cache(EditorState *editor) {
+    editor->line_cache_valid = false;
+    editor->edits++;
+}
+
+/**
+ * Get starting position of a line
+ * Uses the sparse line index instead of a full newline descent
+ */
+int editor_line_start(EditorState *editor, int line) {
+    return line_index_line_start(&editor->line_index, editor->rope, line);
+}
+
+/**
+ * Get line number containing a rope position
+ */
+int editor_line_from_pos(EditorState *editor, int pos) {
+    return line_index_line_from_pos(&editor->line_index, editor->rope, pos);
+}
+
+/**
+ * Move cursor to an absolute rope position
+ */
+void editor_move_to_pos(EditorState *editor, int pos) {
+    editor->cursor_line = editor_line_from_pos(editor, pos);
+    editor->cursor_col = pos - editor_line_start(editor, editor->cursor_line);
+}
+
+/**
+ * Set one-shot status bar message
+ * Shown until the next key press
+ */
+void editor_set_message(EditorState *editor, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(editor->message, sizeof(editor->message), fmt, args);
+    va_end(args);
+}
+
+/**
+ * Make line cache describe the cursor line
+ * Moving to an adjacent line reuses the cached boundary, so each step
+ * needs only one lookup instead of get_line_start + get_line_length
+ */
+static void editor_update_line_cache(EditorState *editor) {
+    int line = editor->cursor_line;
+
+    if (editor->line_cache_valid && editor->line_cache_line == line)
+        return;
+
+    int start, end;
+    if (!editor->rope) {
+        // Empty document: single empty line
+        start = 0;
+        end = 0;
+    } else if (editor->line_cache_valid && editor->line_cache_line == line - 1) {
+        // Next line starts right after the cached line's newline
+        start = editor->line_cache_start + editor->line_cache_len + 1;
+        end = rope_line_end(editor->rope, start);
+    } else if (editor->line_cache_valid && editor->line_cache_line == line + 1) {
+        // Previous line ends right before the cached line's start
+        start = editor_line_start(editor, line);
+        end = editor->line_cache_start - 1;
+    } else {
+        // Distant line: full lookup
+        start = editor_line_start(editor, line);
+        end = rope_line_end(editor->rope, start);
+    }
+
+    editor->line_cache_line = line;
+    editor->line_cache_start = start;
+    editor->line_cache_len = end - start;
+    editor->line_cache_valid = true;
+}
+
 /**
  * Get absolute character position of cursor in rope
- * Converts (line, column) to single index
+ * Converts (line, column) to single index using the cached line start
  */
 int editor_get_cursor_position(EditorState *editor) {
-    if (!editor || !editor->rope)
+    if (!editor)
         return 0;
 
-    // Handle empty rope
-    if (editor->rope->total_len == 0)
+    // Get starting position of current line
+    editor_update_line_cache(editor);
+    if (!editor->rope || editor->rope->total_len == 0)
         return 0;
 
-    // Get starting position of current line
-    int pos = get_line_start(editor->rope, editor->cursor_line);
+    int pos = editor->line_cache_start;
 
     // Add column offset
     pos += editor->cursor_col;
@@ -102,7 +301,34 @@ int editor_get_current_line_length(EditorState *editor) {
     if (editor->rope->total_len == 0)
         return 0;
 
-    return get_line_length(editor->rope, editor->cursor_line);
+    editor_update_line_cache(editor);
+    return editor->line_cache_len;
+}
+
+/**
+ * Get cursor column counted in codepoints (cursor_col counts bytes)
+ * In INSERT mode the pending text typed before the cursor is included
+ */
+int editor_get_char_col(EditorState *editor) {
+    if (editor->mode == MODE_INSERT) {
+        // Codepoints of pending text between the start of the cursor line and the gap
+        int count = 0;
+        int i = editor->insert_gap - 1;
+        for (; i >= 0 && editor->insert_buffer[i] != '\n'; i--)
+            if (!utf8_is_continuation(editor->insert_buffer[i]))
+                count++;
+
+        // Cursor line started inside the pending text
+        if (i >= 0)
+            return count;
+
+        int start = editor_line_start(editor, editor->insert_start_line);
+        return count + get_char_offset(editor->rope, editor->insert_start_pos) -
+               get_char_offset(editor->rope, start);
+    }
+
+    int pos = editor_get_cursor_position(editor);
+    return get_char_offset(editor->rope, pos) - get_char_offset(editor->rope, editor->line_cache_start);
 }
 
 /**
@@ -134,42 +360,63 @@ void editor_clamp_cursor(EditorState *editor) {
         editor->cursor_col = 0;
     if (editor->cursor_col > line_len)
         editor->cursor_col = line_len;
+
+    // Never rest inside a UTF-8 sequence
+    int pos = editor->line_cache_start + editor->cursor_col;
+    editor->cursor_col = rope_char_start(editor->rope, pos) - editor->line_cache_start;
+}
+
+/**
+ * Move cursor to another line keeping its codepoint column
+ * (cursor_col counts bytes, so the column is converted through the rope's codepoint counts)
+ */
+static void editor_move_vertical(EditorState *editor, int line) {
+    int pos = editor_get_cursor_position(editor);
+    int char_col = get_char_offset(editor->rope, pos) -
+                   get_char_offset(editor->rope, editor->line_cache_start);
+
+    editor->cursor_line = line;
+    editor_update_line_cache(editor);
+    int start = editor->line_cache_start;
+    int target = find_char_offset(editor->rope, get_char_offset(editor->rope, start) + char_col);
+
+    // Shorter line: clamp to its end
+    editor->cursor_col = target - start;
+    if (editor->cursor_col > editor->line_cache_len)
+        editor->cursor_col = editor->line_cache_len;
 }
 
 /**
  * Move cursor up one line
- * Preserves column if possible, otherwise clamps to line length
+ * Preserves the codepoint column if possible, otherwise clamps to line length
  */
 void editor_move_up(EditorState *editor) {
-    if (editor->cursor_line > 0) {
-        editor->cursor_line--;
-        editor_clamp_cursor(editor);  // Adjust column if new line is shorter
-    }
+    if (editor->cursor_line > 0)
+        editor_move_vertical(editor, editor->cursor_line - 1);
 }
 
 /**
  * Move cursor down one line
- * Preserves column if possible, otherwise clamps to line length
+ * Preserves the codepoint column if possible, otherwise clamps to line length
  */
 void editor_move_down(EditorState *editor) {
     int total_lines = count_total_lines(editor->rope);
     if (total_lines == 0)
         total_lines = 1;
 
-    if (editor->cursor_line < total_lines - 1) {
-        editor->cursor_line++;
-        editor_clamp_cursor(editor);  // Adjust column if new line is shorter
-    }
+    if (editor->cursor_line < total_lines - 1)
+        editor_move_vertical(editor, editor->cursor_line + 1);
 }
 
 /**
- * Move cursor left one character
+ * Move cursor left one character (a whole UTF-8 sequence plus its combining marks)
  * Wraps to end of previous line if at beginning of line
  */
 void editor_move_left(EditorState *editor) {
     if (editor->cursor_col > 0) {
         // Move within current line
-        editor->cursor_col--;
+        int pos = editor_get_cursor_position(editor);
+        editor->cursor_col = rope_prev_char(editor->rope, pos) - editor->line_cache_start;
     } else if (editor->cursor_line > 0) {
         // Wrap to end of previous line
         editor->cursor_line--;
@@ -178,7 +425,7 @@ void editor_move_left(EditorState *editor) {
 }
 
 /**
- * Move cursor right one character
+ * Move cursor right one character (a whole UTF-8 sequence plus its combining marks)
  * Wraps to beginning of next line if at end of line
  */
 void editor_move_right(EditorState *editor) {
@@ -186,7 +433,10 @@ void editor_move_right(EditorState *editor) {
 
     if (editor->cursor_col < line_len) {
         // Move within current line
-        editor->cursor_col++;
+        int pos = editor_get_cursor_position(editor);
+        editor->cursor_col = rope_next_char(editor->rope, pos) - editor->line_cache_start;
+        if (editor->cursor_col > line_len)
+            editor->cursor_col = line_len;
     } else {
         // Wrap to beginning of next line
         int total_lines = count_total_lines(editor->rope);
@@ -200,16 +450,321 @@ void editor_move_right(EditorState *editor) {
     }
 }
 
+/**
+ * Move cursor to the start of its line
+ */
+void editor_move_line_start(EditorState *editor) {
+    editor->cursor_col = 0;
+}
+
+/**
+ * Move cursor to the end of its line
+ * The line length is cached from the rope's newline counts, so a multi-megabyte line is not scanned
+ */
+void editor_move_line_end(EditorState *editor) {
+    editor->cursor_col = editor_get_current_line_length(editor);
+}
+
+/**
+ * Move cursor to the start of a line (clamped to the document)
+ * The line start comes from the line index and the line count from the root's newline
+ * count, so the distance jumped does not matter. A line off screen is shown mid-view;
+ * lines past the part of a large file loaded so far wait for the rest of it
+ */
+void editor_goto_line(EditorState *editor, int line) {
+    if (line >= count_total_lines(editor->rope))
+        editor_load_wait(editor);
+    int total_lines = count_total_lines(editor->rope);
+    if (line >= total_lines)
+        line = total_lines - 1;
+    if (line < 0)
+        line = 0;
+
+    editor->cursor_line = line;
+    editor->cursor_col = 0;
+
+    int rows = editor->active_view->height > 0 ? editor->active_view->height : 1;
+    if (line < editor->top_line || line >= editor->top_line + rows)
+        editor->top_line = line - rows / 2 > 0 ? line - rows / 2 : 0;
+}
+
+/**
+ * Move cursor to the line 'percent' percent of the way through the document
+ * (the whole file is needed to know where that is)
+ */
+void editor_goto_percent(EditorState *editor, int percent) {
+    editor_load_wait(editor);
+    if (percent > 100)
+        percent = 100;
+    long line = (long)count_total_lines(editor->rope) * percent / 100;
+    editor_goto_line(editor, percent > 0 && line > 0 ? (int)line - 1 : 0);
+}
+
+/**
+ * Scroll one screen down (direction 1) or up (-1), keeping two lines of the old screen
+ * The cursor moves as far, keeping its column, and stays on screen
+ */
+void editor_page(EditorState *editor, int direction) {
+    int rows = editor->active_view->height > 0 ? editor->active_view->height : 1;
+    int step = rows > 2 ? rows - 2 : 1;
+    int total_lines = count_total_lines(editor->rope);
+
+    int top = editor->top_line + direction * step;
+    if (top > total_lines - 1)
+        top = total_lines - 1;
+    if (top < 0)
+        top = 0;
+
+    int line = editor->cursor_line + (top - editor->top_line);
+    if (top == editor->top_line)
+        line = direction > 0 ? total_lines - 1 : 0;
+    if (line < top)
+        line = top;
+    if (line > top + rows - 1)
+        line = top + rows - 1;
+    if (line > total_lines - 1)
+        line = total_lines - 1;
+
+    editor->top_line = top;
+    if (line != editor->cursor_line)
+        editor_move_vertical(editor, line);
+}
+
+/**
+ * Get the journal ready for an edit that is about to change the rope
+ * The first edit after loading or saving starts a journal stamped with the file it applies to
+ */
+static bool editor_journal_ready(EditorState *editor) {
+    Journal *journal = &editor->journal;
+    if (!editor->filename || journal->failed)
+        return false;
+    if (journal_active(journal))
+        return true;
+
+    // Records only replay onto the file as saved, so a journal can't start after an unjournaled edit
+    // (the text still loading counts: recovery replays onto the whole file)
+    if (editor->modified)
+        return false;
+    int base_len = (editor->rope ? editor->rope->total_len : 0) + (int)rope_load_pending(&editor->loader);
+    if (!journal_begin(journal, &editor->disk, base_len)) {
+        editor_set_message(editor, "Cannot create %s: edits are not crash-safe", journal->path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Shift the views without focus after an insertion at (line, col)
+ * len bytes with 'newlines' newlines were inserted; 'tail' bytes follow the last of them
+ * Only positions are adjusted (O(views)); the rope is not consulted
+ */
+static void editor_views_insert(EditorState *editor, int line, int col, int len, int newlines, int tail) {
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view)) {
+        if (view == editor->active_view)
+            continue;
+
+        if (view->cursor_line > line) {
+            view->cursor_line += newlines;
+        } else if (view->cursor_line == line && view->cursor_col >= col) {
+            // Cursor on the insertion line, after the insertion point: it moves with the text
+            if (newlines == 0) {
+                view->cursor_col += len;
+            } else {
+                view->cursor_line += newlines;
+                view->cursor_col = view->cursor_col - col + tail;
+            }
+        }
+
+        if (view->top_line > line)
+            view->top_line += newlines;
+    }
+}
+
+/**
+ * Shift the views without focus after deleting the text from (line, col) to (end_line, end_col)
+ * A cursor inside the deleted range lands on its start
+ */
+static void editor_views_delete(EditorState *editor, int line, int col, int end_line, int end_col) {
+    int newlines = end_line - line;
+
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view)) {
+        if (view == editor->active_view)
+            continue;
+
+        if (view->cursor_line > end_line) {
+            view->cursor_line -= newlines;
+        } else if (view->cursor_line == end_line && view->cursor_col >= end_col) {
+            view->cursor_line = line;
+            view->cursor_col = col + view->cursor_col - end_col;
+        } else if (view->cursor_line > line || (view->cursor_line == line && view->cursor_col > col)) {
+            view->cursor_line = line;
+            view->cursor_col = col;
+        }
+
+        if (view->top_line > end_line)
+            view->top_line -= newlines;
+        else if (view->top_line > line)
+            view->top_line = line;
+    }
+}
+
+/**
+ * Rope positions of every view's cursor and first line (two per view, in view order)
+ * Taken before a replace-all so the views without focus can be moved onto the new text
+ */
+static int *editor_views_save(EditorState *editor) {
+    int count = 0;
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view))
+        count++;
+    int *saved = malloc(2 * count * sizeof(int));
+    if (!saved) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int len = editor->rope ? editor->rope->total_len : 0;
+    int i = 0;
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view), i += 2) {
+        int pos = editor_line_start(editor, view->cursor_line) + view->cursor_col;
+        saved[i] = pos < len ? pos : len;
+        saved[i + 1] = editor_line_start(editor, view->top_line);
+    }
+    return saved;
+}
+
+/**
+ * Map a position to the text after replacing the sorted ranges [starts[i], ends[i]) with
+ * rlen bytes each; a position inside a replaced range lands on the start of its replacement
+ */
+static int editor_replaced_pos(int *starts, int *ends, int count, int rlen, int pos) {
+    long shift = 0;
+    int i = 0;
+    for (; i < count && ends[i] <= pos; i++)
+        shift += rlen - (ends[i] - starts[i]);
+    if (i < count && starts[i] < pos)
+        pos = starts[i];
+    return (int)(pos + shift);
+}
+
+/**
+ * Move the views without focus onto the text after a replace-all (positions from editor_views_save)
+ */
+static void editor_views_replace(EditorState *editor, int *saved, int *starts, int *ends, int count, int rlen) {
+    int i = 0;
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view), i += 2) {
+        if (view == editor->active_view)
+            continue;
+
+        int pos = editor_replaced_pos(starts, ends, count, rlen, saved[i]);
+        view->cursor_line = editor_line_from_pos(editor, pos);
+        view->cursor_col = pos - editor_line_start(editor, view->cursor_line);
+        view->top_line = editor_line_from_pos(editor, editor_replaced_pos(starts, ends, count, rlen, saved[i + 1]));
+    }
+}
+
+/**
+ * Grow the insert gap buffer so that the gap holds at least 'needed' bytes
+ * Text after the gap is moved to the end of the new allocation
+ */
+static void editor_insert_buffer_reserve(EditorState *editor, int needed) {
+    int gap_len = editor->insert_buffer_cap - editor->insert_buffer_len;
+    if (gap_len >= needed)
+        return;
+
+    // Double capacity until the gap is large enough
+    int new_cap = editor->insert_buffer_cap;
+    while (new_cap - editor->insert_buffer_len < needed)
+        new_cap *= 2;
+
+    char *buf = realloc(editor->insert_buffer, new_cap);
+    if (!buf) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // Move the text after the gap to the end of the enlarged buffer
+    int tail_len = editor->insert_buffer_len - editor->insert_gap;
+    memmove(buf + new_cap - tail_len, buf + editor->insert_buffer_cap - tail_len, tail_len);
+
+    editor->insert_buffer = buf;
+    editor->insert_buffer_cap = new_cap;
+}
+
+/**
+ * Get character at logical index of the insert buffer
+ * Indices at or after the gap are mapped past it
+ */
+char editor_insert_buffer_char(EditorState *editor, int idx) {
+    if (idx < 0 || idx >= editor->insert_buffer_len)
+        return '\0';
+
+    if (idx < editor->insert_gap)
+        return editor->insert_buffer[idx];
+
+    int gap_len = editor->insert_buffer_cap - editor->insert_buffer_len;
+    return editor->insert_buffer[idx + gap_len];
+}
+
+/**
+ * Advance live cursor over a character of pending text
+ */
+static void editor_insert_cursor_advance(EditorState *editor, char c) {
+    if (c == '\n') {
+        // Newline: move to next line, column 0
+        editor->cursor_line++;
+        editor->cursor_col = 0;
+    } else {
+        // Regular character: advance column
+        editor->cursor_col++;
+    }
+}
+
+/**
+ * Move live cursor back over a character of pending text
+ * Must be called after the gap has been moved before the character
+ */
+static void editor_insert_cursor_retreat(EditorState *editor, char c) {
+    if (c != '\n') {
+        // Regular character: just move back one column
+        if (editor->cursor_col > 0)
+            editor->cursor_col--;
+        return;
+    }
+
+    // Newline: move back to previous line
+    editor->cursor_line--;
+
+    // Column = characters after the last newline before the gap,
+    // or the original column plus everything typed before the gap
+    int last_newline = -1;
+    for (int i = editor->insert_gap - 1; i >= 0; i--) {
+        if (editor->insert_buffer[i] == '\n') {
+            last_newline = i;
+            break;
+        }
+    }
+
+    if (last_newline >= 0)
+        editor->cursor_col = editor->insert_gap - last_newline - 1;
+    else
+        editor->cursor_col = editor->insert_start_col + editor->insert_gap;
+}
+
 /**
  * Flush insert buffer to rope structure
- * This performs the actual insertion into the rope data structure
+ * The whole pending text is built into one rope and spliced in with a single insert_at
  */
 void editor_flush_insert_buffer(EditorState *editor) {
     // Nothing to flush if buffer is empty
     if (editor->insert_buffer_len == 0)
         return;
 
-    // Null-terminate buffer
+    // Close the gap by moving it to the end, then null-terminate the text
+    editor_insert_buffer_reserve(editor, 1);
+    int gap_len = editor->insert_buffer_cap - editor->insert_buffer_len;
+    int tail_len = editor->insert_buffer_len - editor->insert_gap;
+    memmove(editor->insert_buffer + editor->insert_gap,
+            editor->insert_buffer + editor->insert_gap + gap_len, tail_len);
     editor->insert_buffer[editor->insert_buffer_len] = '\0';
 
     // Validate insert position
@@ -218,169 +773,186 @@ void editor_flush_insert_buffer(EditorState *editor) {
     if (editor->rope && editor->insert_start_pos > editor->rope->total_len)
         editor->insert_start_pos = editor->rope->total_len;
 
-    // Insert entire buffer at once (efficient batched operation)
+    // Journal the edit, then insert entire buffer at once (efficient batched operation)
+    if (editor_journal_ready(editor))
+        journal_insert(&editor->journal, editor->insert_start_pos, editor->insert_buffer, editor->insert_buffer_len);
+    int newlines = count_newlines(editor->insert_buffer);
     editor->rope = insert_at(editor->rope, editor->insert_start_pos, editor->insert_buffer);
+    line_index_insert(&editor->line_index, editor->insert_start_pos, editor->insert_buffer_len, newlines);
+    editor_invalidate_line_cache(editor);
+
+    // Other views of this rope move with the text after the insertion point
+    char *last_newline = strrchr(editor->insert_buffer, '\n');
+    int tail = last_newline ? editor->insert_buffer_len - (int)(last_newline - editor->insert_buffer) - 1
+                            : editor->insert_buffer_len;
+    editor_views_insert(editor, editor->insert_start_line, editor->insert_start_col,
+                        editor->insert_buffer_len, newlines, tail);
 
     // Clear buffer (cursor position already updated during live typing)
     editor->insert_buffer_len = 0;
-    editor->insert_buffer[0] = '\0';
+    editor->insert_gap = 0;
 
     // Mark as modified
     editor->modified = true;
 }
 
 /**
- * Add character to insert buffer
+ * Add character to insert buffer at the gap
  * Updates cursor position for live display but doesn't modify rope yet
  */
 void editor_insert_char(EditorState *editor, char c) {
-    // Flush buffer if it's getting full
-    if (editor->insert_buffer_len >= MAX_BUFFER_SIZE - 1) {
-        editor_flush_insert_buffer(editor);
-        // Reset start position after flush
-        editor->insert_start_pos = editor_get_cursor_position(editor);
-    }
+    // Make room in the gap (keeps one spare byte for the flush terminator)
+    editor_insert_buffer_reserve(editor, 2);
 
     // Add character to buffer
-    editor->insert_buffer[editor->insert_buffer_len++] = c;
+    editor->insert_buffer[editor->insert_gap++] = c;
+    editor->insert_buffer_len++;
 
     // Update cursor position for live display
-    if (c == '\n') {
-        // Newline: move to next line, column 0
-        editor->cursor_line++;
-        editor->cursor_col = 0;
-    } else {
-        // Regular character: advance column
-        editor->cursor_col++;
-    }
+    editor_insert_cursor_advance(editor, c);
+    autosave_note_edit(&editor->autosave);
 }
 
 /**
- * Delete character from insert buffer (backspace in INSERT mode)
+ * Delete character before the gap (backspace in INSERT mode)
  * Removes from buffer without touching rope
  */
 void editor_delete_buffer_char(EditorState *editor) {
-    if (editor->insert_buffer_len > 0) {
-        // Remove last character from buffer
+    // Widen the gap over the previous character (every byte of a UTF-8 sequence)
+    while (editor->insert_gap > 0) {
+        char deleted_char = editor->insert_buffer[--editor->insert_gap];
         editor->insert_buffer_len--;
-        char deleted_char = editor->insert_buffer[editor->insert_buffer_len];
-        editor->insert_buffer[editor->insert_buffer_len] = '\0';
 
         // Update cursor based on what was deleted
-        if (deleted_char == '\n') {
-            // Deleted a newline: move back to previous line
-            if (editor->cursor_line > 0) {
-                editor->cursor_line--;
-
-                // Find column position on previous line
-                // Need to look at buffer to see where we should be
-                int col = 0;
-                int last_newline = -1;
-
-                // Find last newline in remaining buffer
-                for (int i = editor->insert_buffer_len - 1; i >= 0; i--) {
-                    if (editor->insert_buffer[i] == '\n') {
-                        last_newline = i;
-                        break;
-                    }
-                }
-
-                if (last_newline >= 0) {
-                    // There's a newline in buffer, count chars after it
-                    col = editor->insert_buffer_len - last_newline - 1;
-                } else {
-                    // No newline in buffer, add buffer length to original line length
-                    int orig_line_len = 0;
-
-                    if (editor->rope && editor->rope->total_len > 0 &&
-                        editor->insert_start_pos >= 0 && editor->insert_start_pos <= editor->rope->total_len) {
-                        // Find which line insert started on
-                        int insert_line = 0;
-                        int pos = 0;
-                        while (pos < editor->insert_start_pos && pos < editor->rope->total_len) {
-                            if (char_at(editor->rope, pos) == '\n')
-                                insert_line++;
-                            pos++;
-                        }
-
-                        // Get original line length up to insert point
-                        if (insert_line < count_total_lines(editor->rope)) {
-                            int line_start = get_line_start(editor->rope, insert_line);
-                            orig_line_len = editor->insert_start_pos - line_start;
-                        }
-                    }
-
-                    col = orig_line_len + editor->insert_buffer_len;
-                }
-
-                editor->cursor_col = col;
-            }
-        } else {
-            // Regular character deletion: just move back one column
-            if (editor->cursor_col > 0)
-                editor->cursor_col--;
+        editor_insert_cursor_retreat(editor, deleted_char);
+        if (!utf8_is_continuation(deleted_char)) {
+            autosave_note_edit(&editor->autosave);
+            break;
         }
     }
 }
 
 /**
- * Flush delete operations (placeholder)
- * Currently just resets counter since deletes happen immediately
+ * Move cursor left inside the pending insert text
+ * Shifts one character from before the gap to after it
+ */
+void editor_insert_move_left(EditorState *editor) {
+    int gap_len = editor->insert_buffer_cap - editor->insert_buffer_len;
+
+    // Move every byte of a UTF-8 sequence
+    while (editor->insert_gap > 0) {
+        char c = editor->insert_buffer[--editor->insert_gap];
+        editor->insert_buffer[editor->insert_gap + gap_len] = c;
+
+        editor_insert_cursor_retreat(editor, c);
+        if (!utf8_is_continuation(c))
+            break;
+    }
+}
+
+/**
+ * Move cursor right inside the pending insert text
+ * Shifts one character from after the gap to before it
+ */
+void editor_insert_move_right(EditorState *editor) {
+    if (editor->insert_gap >= editor->insert_buffer_len)
+        return;
+
+    int gap_len = editor->insert_buffer_cap - editor->insert_buffer_len;
+
+    // Move the lead byte and then any continuation bytes of its sequence
+    do {
+        char c = editor->insert_buffer[editor->insert_gap + gap_len];
+        editor->insert_buffer[editor->insert_gap++] = c;
+
+        editor_insert_cursor_advance(editor, c);
+    } while (editor->insert_gap < editor->insert_buffer_len &&
+             utf8_is_continuation(editor->insert_buffer[editor->insert_gap + gap_len]));
+}
+
+/**
+ * Flush pending deletion range to rope structure
+ * The whole range is removed with a single delete_at
  */
 void editor_flush_delete_buffer(EditorState *editor) {
-    if (editor->delete_count == 0)
+    // Nothing pending (count prefix without backspace is dropped)
+    editor->delete_repeat = 0;
+    if (editor->delete_end <= editor->delete_start)
         return;
 
-    // Reset counter
-    editor->delete_count = 0;
+    // Other views of this rope move back over the range (column of its end taken before the edit)
+    int end_col = editor->delete_end - editor_line_start(editor, editor->delete_end_line);
+    editor_views_delete(editor, editor->cursor_line, editor->cursor_col, editor->delete_end_line, end_col);
+
+    // Journal the edit, then delete entire range at once (efficient batched operation)
+    if (editor_journal_ready(editor))
+        journal_delete(&editor->journal, editor->delete_start, editor->delete_end - editor->delete_start);
+    editor->rope = delete_at(editor->rope, editor->delete_start,
+                             editor->delete_end - editor->delete_start);
+    line_index_delete(&editor->line_index, editor->delete_start, editor->delete_end - editor->delete_start,
+                      editor->delete_end_line - editor->cursor_line);
+    editor_invalidate_line_cache(editor);
+
+    // Collapse range at the cursor (cursor position already updated during live deletion)
+    editor->delete_end = editor->delete_start;
+    editor->delete_end_line = editor->cursor_line;
+
+    // Mark as modified
     editor->modified = true;
 }
 
 /**
- * Delete character from rope (backspace in DELETE mode)
- * Deletes immediately from rope structure (not buffered)
+ * Extend pending deletion range by n characters before the cursor
+ * Updates cursor position for live display but doesn't modify rope yet
  */
-void editor_delete_char(EditorState *editor) {
+void editor_delete_chars(EditorState *editor, int n) {
     // Can't delete from empty rope
-    if (!editor->rope || editor->rope->total_len == 0)
+    if (!editor->rope || editor->rope->total_len == 0 || n <= 0)
         return;
 
-    // Get current position
-    int pos = editor_get_cursor_position(editor);
+    // Anchor a new range at the cursor if none is pending
+    if (editor->delete_end <= editor->delete_start) {
+        editor->delete_start = editor_get_cursor_position(editor);
+        editor->delete_end = editor->delete_start;
+        editor->delete_end_line = editor->cursor_line;
+    }
 
     // Can only delete if there's something before cursor
-    if (pos > 0) {
-        // Get character that will be deleted
-        char prev_char = char_at(editor->rope, pos - 1);
-
-        // If deleting newline, capture previous line length BEFORE merge
-        int prev_line_end_col = 0;
-        if (prev_char == '\n' && editor->cursor_line > 0) {
-            prev_line_end_col = get_line_length(editor->rope, editor->cursor_line - 1);
-        }
+    if (editor->delete_start == 0)
+        return;
 
-        // Perform deletion
-        editor->rope = delete_at(editor->rope, pos - 1, 1);
+    // Grow range to the left by n codepoints, clamped to start of rope
+    int chars = get_char_offset(editor->rope, editor->delete_start);
+    editor->delete_start = find_char_offset(editor->rope, chars > n ? chars - n : 0);
+    autosave_note_edit(&editor->autosave);
 
-        // Update cursor based on what was deleted
-        if (prev_char == '\n') {
-            // Deleted newline: lines merged, go to end of previous line
-            if (editor->cursor_line > 0) {
-                editor->cursor_line--;
-                editor->cursor_col = prev_line_end_col;  // Use captured length
-            } else {
-                editor->cursor_col = 0;
-            }
-        } else {
-            // Regular character: just move back one column
-            if (editor->cursor_col > 0)
-                editor->cursor_col--;
-        }
+    // Cursor moves to start of range (may cross newlines)
+    editor->cursor_line = editor_line_from_pos(editor, editor->delete_start);
+    editor_update_line_cache(editor);
+    editor->cursor_col = editor->delete_start - editor->line_cache_start;
+}
 
-        // Track deletion and mark as modified
-        editor->delete_count++;
-        editor->modified = true;
-    }
+/**
+ * Backspace in DELETE mode
+ * Deletes one character, or the typed count prefix worth of characters
+ */
+void editor_delete_char(EditorState *editor) {
+    int n = editor->delete_repeat > 0 ? editor->delete_repeat : 1;
+    editor->delete_repeat = 0;
+    editor_delete_chars(editor, n);
+}
+
+/**
+ * Append a digit to the DELETE mode count prefix (e.g. "500" then backspace)
+ */
+void editor_delete_count_digit(EditorState *editor, int digit) {
+    int limit = editor->rope ? editor->rope->chars : 0;
+
+    editor->delete_repeat = editor->delete_repeat * 10 + digit;
+
+    // No point counting past the document size (also prevents overflow)
+    if (editor->delete_repeat > limit)
+        editor->delete_repeat = limit;
 }
 
 /**
@@ -390,18 +962,23 @@ void editor_delete_char(EditorState *editor) {
 void editor_enter_insert_mode(EditorState *editor) {
     editor->mode = MODE_INSERT;
     editor->insert_buffer_len = 0;
-    editor->insert_buffer[0] = '\0';
+    editor->insert_gap = 0;
     // Remember where insert mode started for batched insertion
     editor->insert_start_pos = editor_get_cursor_position(editor);
+    editor->insert_start_line = editor->cursor_line;
+    editor->insert_start_col = editor->insert_start_pos - editor->line_cache_start;
 }
 
 /**
  * Enter DELETE mode
- * Resets deletion counter
+ * Starts with an empty deletion range at the cursor
  */
 void editor_enter_delete_mode(EditorState *editor) {
     editor->mode = MODE_DELETE;
-    editor->delete_count = 0;
+    editor->delete_start = editor_get_cursor_position(editor);
+    editor->delete_end = editor->delete_start;
+    editor->delete_end_line = editor->cursor_line;
+    editor->delete_repeat = 0;
 }
 
 /**
@@ -413,7 +990,7 @@ void editor_enter_normal_mode(EditorState *editor) {
         // Flush insert buffer to rope
         editor_flush_insert_buffer(editor);
     } else if (editor->mode == MODE_DELETE) {
-        // Flush delete operations (currently just resets counter)
+        // Apply pending deletion range to rope
         editor_flush_delete_buffer(editor);
     }
 
@@ -424,17 +1001,1053 @@ void editor_enter_normal_mode(EditorState *editor) {
 }
 
 /**
- * Save current rope contents to file
- * Returns true on success, false on failure
+ * Prepare pattern for searching
+ * Literal patterns need no compilation (*re = NULL) and use the fast substring search
+ * Otherwise the compiled regex is cached until the pattern changes
+ * Returns false (with a message) if the pattern is not a valid regex
  */
-bool editor_save(EditorState *editor) {
-    // Need filename to save
-    if (!editor->filename)
-        return false;
+static bool editor_prepare_pattern(EditorState *editor, char *pattern, Regexp **re) {
+    *re = NULL;
+    if (regexp_is_literal(pattern))
+        return true;
 
-    // Write rope to file
-    if (save_file(editor->rope, editor->filename)) {
-        editor->modified = false;  // Clear modified flag
+    if (!editor->regex_source || strcmp(editor->regex_source, pattern) != 0) {
+        const char *error = NULL;
+        regexp_free(editor->regex);
+        free(editor->regex_source);
+        editor->regex_source = NULL;
+        editor->regex = regexp_compile(pattern, &error);
+        if (!editor->regex) {
+            editor_set_message(editor, "Invalid pattern: %s", error);
+            return false;
+        }
+        editor->regex_source = string_copy(pattern);
+    }
+
+    *re = editor->regex;
+    return true;
+}
+
+/**
+ * Find first match at or after pos (backward: last match starting before pos)
+ * Uses the regex engine when re is set, substring search otherwise
+ */
+static int editor_find_match(EditorState *editor, char *pattern, Regexp *re, int pos, bool backward) {
+    int end;
+
+    if (re)
+        return backward ? regexp_rfind(re, editor->rope, pos, &end)
+                        : regexp_find(re, editor->rope, pos, &end);
+
+    return backward ? rope_rfind(editor->rope, pattern, pos)
+                    : search_find_first(editor->rope, pattern, pos);
+}
+
+/**
+ * Find a match of pattern from the cursor in the given direction
+ * Wraps around the end (or start) of the document once
+ * Returns match position or -1 (-2 if the pattern is invalid)
+ */
+static int editor_search_from(EditorState *editor, char *pattern, int pos, bool backward) {
+    // Incremental search looks at what is loaded; an accepted search sees the whole file
+    if (editor->mode != MODE_SEARCH)
+        editor_load_wait(editor);
+
+    Regexp *re;
+    if (!editor_prepare_pattern(editor, pattern, &re))
+        return -2;
+
+    int match = editor_find_match(editor, pattern, re, pos, backward);
+    if (match == -1 && editor->rope) {
+        int len = editor->rope->total_len;
+        match = editor_find_match(editor, pattern, re, backward ? len + 1 : 0, backward);
+        if (match != -1)
+            editor_set_message(editor, backward ? "search hit TOP, continuing at BOTTOM"
+                                                : "search hit BOTTOM, continuing at TOP");
+    }
+
+    return match;
+}
+
+/**
+ * Remove the last character (a whole UTF-8 sequence) from the prompt
+ */
+static void editor_prompt_delete_char(EditorState *editor) {
+    while (editor->prompt_len > 0 && utf8_is_continuation(editor->prompt[editor->prompt_len - 1]))
+        editor->prompt_len--;
+    if (editor->prompt_len > 0)
+        editor->prompt_len--;
+    editor->prompt[editor->prompt_len] = '\0';
+}
+
+/**
+ * Enter SEARCH mode
+ * Remembers the cursor so the search can be cancelled
+ */
+void editor_enter_search_mode(EditorState *editor, bool backward) {
+    editor->mode = MODE_SEARCH;
+    editor->search_backward = backward;
+    editor->search_origin = editor_get_cursor_position(editor);
+    editor->prompt_len = 0;
+    editor->prompt[0] = '\0';
+}
+
+/**
+ * Jump to the first match of the prompt text from the search origin
+ * Called after every prompt edit for incremental search
+ */
+static void editor_search_incremental(EditorState *editor) {
+    int start = editor->search_backward ? editor->search_origin : editor->search_origin + 1;
+    int match = editor_search_from(editor, editor->prompt, start, editor->search_backward);
+
+    // No match (or pattern still incomplete): stay at the origin
+    editor_move_to_pos(editor, match >= 0 ? match : editor->search_origin);
+}
+
+/**
+ * Add character to search prompt
+ */
+void editor_search_insert_char(EditorState *editor, char c) {
+    if (editor->prompt_len >= PROMPT_MAX - 1)
+        return;
+
+    editor->prompt[editor->prompt_len++] = c;
+    editor->prompt[editor->prompt_len] = '\0';
+
+    editor_search_incremental(editor);
+}
+
+/**
+ * Remove last character of search prompt
+ * Backspace on an empty prompt cancels the search (like Vim)
+ */
+void editor_search_delete_char(EditorState *editor) {
+    if (editor->prompt_len == 0) {
+        editor_search_cancel(editor);
+        return;
+    }
+
+    editor_prompt_delete_char(editor);
+    editor_search_incremental(editor);
+}
+
+/**
+ * Accept search prompt
+ * An empty prompt repeats the last pattern
+ */
+void editor_search_accept(EditorState *editor) {
+    editor->mode = MODE_NORMAL;
+
+    if (editor->prompt_len > 0) {
+        if (editor->search_pattern)
+            free(editor->search_pattern);
+        editor->search_pattern = string_copy(editor->prompt);
+    }
+
+    if (!editor->search_pattern)
+        return;
+
+    // Re-run the search so an empty prompt (or a pattern typed then trimmed) lands correctly
+    int start = editor->search_backward ? editor->search_origin : editor->search_origin + 1;
+    int match = editor_search_from(editor, editor->search_pattern, start, editor->search_backward);
+
+    if (match < 0) {
+        editor_move_to_pos(editor, editor->search_origin);
+        if (match == -1)
+            editor_set_message(editor, "Pattern not found: %s", editor->search_pattern);
+    } else {
+        editor_move_to_pos(editor, match);
+    }
+}
+
+/**
+ * Cancel search prompt and restore cursor
+ */
+void editor_search_cancel(EditorState *editor) {
+    editor->mode = MODE_NORMAL;
+    editor_move_to_pos(editor, editor->search_origin);
+}
+
+/**
+ * Jump to next match of last pattern
+ * reverse = search against the direction of the last '/' or '?'
+ */
+void editor_search_next(EditorState *editor, bool reverse) {
+    if (!editor->search_pattern) {
+        editor_set_message(editor, "No previous search pattern");
+        return;
+    }
+
+    bool backward = editor->search_backward != reverse;
+    int pos = editor_get_cursor_position(editor);
+    int match = editor_search_from(editor, editor->search_pattern, backward ? pos : pos + 1, backward);
+
+    if (match == -1)
+        editor_set_message(editor, "Pattern not found: %s", editor->search_pattern);
+    else if (match >= 0)
+        editor_move_to_pos(editor, match);
+}
+
+/**
+ * Snapshot of the text as the screen shows it: pending INSERT text is included and a
+ * pending DELETE range left out. Taking it costs one pointer per leaf
+ */
+static void editor_snapshot(EditorState *editor, RopeSnapshot *snap) {
+    rope_snapshot_init(snap);
+    int len = editor->rope ? editor->rope->total_len : 0;
+
+    if (editor->mode == MODE_INSERT && editor->insert_buffer_len > 0) {
+        // The gap buffer holds the pending text in two parts around the gap
+        int pos = editor->insert_start_pos < len ? editor->insert_start_pos : len;
+        int gap_len = editor->insert_buffer_cap - editor->insert_buffer_len;
+        rope_snapshot_add(snap, editor->rope, 0, pos);
+        rope_snapshot_add_text(snap, editor->insert_buffer, editor->insert_gap);
+        rope_snapshot_add_text(snap, editor->insert_buffer + editor->insert_gap + gap_len,
+                               editor->insert_buffer_len - editor->insert_gap);
+        rope_snapshot_add(snap, editor->rope, pos, len);
+    } else if (editor->mode == MODE_DELETE && editor->delete_end > editor->delete_start) {
+        rope_snapshot_add(snap, editor->rope, 0, editor->delete_start);
+        rope_snapshot_add(snap, editor->rope, editor->delete_end, len);
+    } else {
+        rope_snapshot_add(snap, editor->rope, 0, len);
+    }
+}
+
+/**
+ * Report a finished background count (finish callback, run on the main thread)
+ */
+static void editor_count_done(WorkerGroup *group) {
+    EditorState *editor = group->data;
+    char *pat = editor->count.pat ? string_copy(editor->count.pat) : NULL;
+    int slices = editor->count.slice_count;
+
+    TextCounts counts;
+    if (!snapshot_count_finish(&editor->count, &counts))
+        editor_set_message(editor, "Count cancelled");
+    else if (pat)
+        editor_set_message(editor, "%ld matches of \"%s\" (%.1f ms, %d slices in the background)",
+                           counts.matches, pat, event_now_ms() - editor->count_start, slices);
+    else
+        editor_set_message(editor, "%ld lines, %ld words, %ld bytes (%.1f ms)", counts.lines,
+                           counts.words, counts.bytes, event_now_ms() - editor->count_start);
+    free(pat);
+}
+
+/**
+ * Start counting the buffer on the worker pool (matches of pat too, if not NULL)
+ * Keys keep being handled meanwhile; the result comes back through editor_count_done()
+ */
+static void editor_count_start(EditorState *editor, char *pat) {
+    if (editor->count.running) {
+        editor_set_message(editor, "A count is already running (ESC cancels it)");
+        return;
+    }
+
+    editor_load_wait(editor);
+    RopeSnapshot snap;
+    editor_snapshot(editor, &snap);
+    editor->count_start = event_now_ms();
+    snapshot_count_start(&editor->count, &snap, pat, editor_count_done, editor);
+}
+
+/**
+ * Stop a background count; it reports "Count cancelled" when its slices have stopped
+ */
+void editor_count_cancel(EditorState *editor) {
+    if (editor->count.running)
+        snapshot_count_cancel(&editor->count);
+}
+
+/**
+ * Count all matches of last pattern
+ * Literal patterns in large files are counted in the background by a snapshot count;
+ * small files are counted at once by search_count_matches()
+ * Regex matches are counted in a single streaming pass
+ */
+void editor_count_matches(EditorState *editor) {
+    if (!editor->search_pattern) {
+        editor_set_message(editor, "No previous search pattern");
+        return;
+    }
+
+    Regexp *re;
+    if (!editor_prepare_pattern(editor, editor->search_pattern, &re))
+        return;
+
+    editor_load_wait(editor);
+    if (!re && editor->rope && editor->rope->total_len >= SEARCH_PARALLEL_MIN) {
+        editor_count_start(editor, editor->search_pattern);
+        return;
+    }
+
+    double start = event_now_ms();
+    int count = re ? regexp_count(re, editor->rope)
+                   : search_count_matches(editor->rope, editor->search_pattern);
+    double elapsed = event_now_ms() - start;
+
+    if (re)
+        editor_set_message(editor, "%d matches of /%s/ (%.1f ms)", count,
+                           editor->search_pattern, elapsed);
+    else
+        editor_set_message(editor, "%d matches of \"%s\" (%.1f ms, %d threads)", count,
+                           editor->search_pattern, elapsed, search_thread_count(editor->rope));
+}
+
+/**
+ * Replace all matches of pattern with replacement
+ * Match ranges are gathered first, then the rope is rebuilt once by
+ * rope_replace_ranges() instead of one delete_at/insert_at per match
+ */
+void editor_replace_all(EditorState *editor, char *pattern, char *replacement) {
+    Regexp *re;
+    if (!editor_prepare_pattern(editor, pattern, &re))
+        return;
+    editor_load_wait(editor);
+
+    double start = event_now_ms();
+
+    // Gather match ranges (literal patterns use the parallel finder)
+    MatchList starts;
+    MatchList ends;
+    match_list_init(&starts);
+    match_list_init(&ends);
+
+    if (re) {
+        int len = editor->rope ? editor->rope->total_len : 0;
+        int pos = 0;
+        int end;
+        while (pos <= len) {
+            int match = regexp_find(re, editor->rope, pos, &end);
+            if (match == -1)
+                break;
+            match_list_push(&starts, match);
+            match_list_push(&ends, end);
+            pos = end > match ? end : end + 1;
+        }
+    } else {
+        int len = string_length(pattern);
+        search_find_all(editor->rope, pattern, &starts);
+        for (int i = 0; i < starts.count; i++)
+            match_list_push(&ends, starts.positions[i] + len);
+    }
+
+    int count = starts.count;
+    if (count > 0) {
+        if (editor_journal_ready(editor))
+            journal_replace(&editor->journal, starts.positions, ends.positions, count, replacement);
+        int *views = editor_views_save(editor);
+        editor->rope = rope_replace_ranges(editor->rope, starts.positions, ends.positions,
+                                           count, replacement);
+        line_index_build(&editor->line_index, editor->rope);
+        editor_invalidate_line_cache(editor);
+        editor->modified = true;
+        autosave_note_edit(&editor->autosave);
+
+        // Other views follow the text they showed
+        editor_views_replace(editor, views, starts.positions, ends.positions, count, string_length(replacement));
+        free(views);
+
+        // Stay on the same line where possible
+        if (editor->rope)
+            editor_clamp_cursor(editor);
+        else
+            editor->cursor_line = editor->cursor_col = 0;
+    }
+
+    double elapsed = event_now_ms() - start;
+    match_list_free(&starts);
+    match_list_free(&ends);
+
+    if (count == 0)
+        editor_set_message(editor, "Pattern not found: %s", pattern);
+    else
+        editor_set_message(editor, "Replaced %d matches (%.1f ms)", count, elapsed);
+}
+
+/**
+ * Enter COMMAND mode
+ */
+void editor_enter_command_mode(EditorState *editor) {
+    editor->mode = MODE_COMMAND;
+    editor->prompt_len = 0;
+    editor->prompt[0] = '\0';
+}
+
+/**
+ * Add character to command prompt
+ */
+void editor_command_insert_char(EditorState *editor, char c) {
+    if (editor->prompt_len >= PROMPT_MAX - 1)
+        return;
+
+    editor->prompt[editor->prompt_len++] = c;
+    editor->prompt[editor->prompt_len] = '\0';
+}
+
+/**
+ * Remove last character of command prompt
+ * Backspace on an empty prompt leaves COMMAND mode (like Vim)
+ */
+void editor_command_delete_char(EditorState *editor) {
+    if (editor->prompt_len == 0) {
+        editor_command_cancel(editor);
+        return;
+    }
+
+    editor_prompt_delete_char(editor);
+}
+
+/**
+ * Cancel command prompt
+ */
+void editor_command_cancel(EditorState *editor) {
+    editor->mode = MODE_NORMAL;
+}
+
+/**
+ * Copy one '/'-terminated field of a substitute command into out
+ * In patterns only "\/" is unescaped (other escapes belong to the regex);
+ * in replacements "\n", "\t", "\\" and "\/" are unescaped
+ * Returns pointer to the terminating '/' (or end of string)
+ */
+static char *editor_parse_field(char *src, char *out, bool replacement) {
+    int len = 0;
+
+    while (*src && *src != '/') {
+        if (src[0] == '\\' && src[1]) {
+            char e = src[1];
+            if (e == '/')
+                out[len++] = '/';
+            else if (!replacement)
+                out[len++] = '\\', out[len++] = e;
+            else
+                out[len++] = e == 'n' ? '\n' : e == 't' ? '\t' : e;
+            src += 2;
+        } else {
+            out[len++] = *src++;
+        }
+    }
+
+    out[len] = '\0';
+    return src;
+}
+
+/**
+ * Run a substitute command: s/pattern/replacement/[g] (an optional leading '%' is accepted)
+ * Every match in the file is replaced
+ */
+static void editor_command_substitute(EditorState *editor, char *cmd) {
+    char pattern[PROMPT_MAX];
+    char replacement[PROMPT_MAX];
+
+    char *p = editor_parse_field(cmd, pattern, false);
+    if (*p != '/' || pattern[0] == '\0') {
+        editor_set_message(editor, "Usage: s/pattern/replacement/");
+        return;
+    }
+
+    p = editor_parse_field(p + 1, replacement, true);
+    if (*p == '/')
+        p++;
+    if (*p == 'g')
+        p++;
+    if (*p != '\0') {
+        editor_set_message(editor, "Trailing characters: %s", p);
+        return;
+    }
+
+    // The pattern becomes the last search pattern for n / N
+    if (editor->search_pattern)
+        free(editor->search_pattern);
+    editor->search_pattern = string_copy(pattern);
+
+    editor_replace_all(editor, pattern, replacement);
+}
+
+/**
+ * Set the autosave triggers of this buffer: autosave <seconds idle> [<edits>], or autosave off
+ * Without arguments the current settings are shown
+ */
+static void editor_command_autosave(EditorState *editor, char *args) {
+    Autosave *autosave = &editor->autosave;
+    int idle = autosave->idle_seconds;
+    int edits = autosave->edit_limit;
+
+    while (*args == ' ')
+        args++;
+    if (strcmp(args, "off") == 0) {
+        idle = edits = 0;
+    } else if (*args) {
+        char *end;
+        idle = (int)strtol(args, &end, 10);
+        if (*end == ' ')
+            edits = (int)strtol(end, &end, 10);
+        if (*end != '\0' || idle < 0 || edits < 0) {
+            editor_set_message(editor, "Usage: autosave <seconds idle> [<edits>] | autosave off");
+            return;
+        }
+    }
+
+    autosave_configure(autosave, idle, edits);
+    if (!autosave->path)
+        editor_set_message(editor, "No file name: nothing to autosave");
+    else if (idle == 0 && edits == 0)
+        editor_set_message(editor, "Autosave off");
+    else
+        editor_set_message(editor, "Autosave to %s after %d s idle or %d edits (0 = never)",
+                           autosave->path, idle, edits);
+}
+
+/**
+ * Keep text away from every view compressed: compress on / compress off
+ * Without arguments the text held compressed is shown
+ */
+static void editor_command_compress(EditorState *editor, char *args) {
+    while (*args == ' ')
+        args++;
+
+    if (strcmp(args, "on") == 0) {
+        editor->compress = true;
+        editor->freeze_edits = 0;
+        editor->freeze_report = true;
+        editor_set_message(editor, "Compressing text away from the views in the background");
+    } else if (strcmp(args, "off") == 0) {
+        if (editor->freeze)
+            rope_freeze_cancel(editor->freeze);
+        editor->freeze = NULL;
+        editor->compress = false;
+        editor->rope = rope_thaw(editor->rope);
+        editor_set_message(editor, "Compression off");
+    } else if (*args) {
+        editor_set_message(editor, "Usage: compress on | compress off");
+    } else {
+        long bytes, stored;
+        rope_cold_stats(editor->rope, &bytes, &stored);
+        editor_set_message(editor, "Compression %s: %.1f MB of text held in %.1f MB",
+                           editor->compress ? "on" : "off", bytes / 1048576.0, stored / 1048576.0);
+    }
+}
+
+/**
+ * Keep the line index in a sidecar beside the file: index on / index off
+ * Without arguments the sidecar's state is shown
+ */
+static void editor_command_index(EditorState *editor, char *args) {
+    while (*args == ' ')
+        args++;
+
+    if (!editor->index_path) {
+        editor_set_message(editor, "No file name: no line index sidecar");
+    } else if (strcmp(args, "on") == 0) {
+        editor->index_keep = true;
+        editor_index_sync(editor);
+        if (!file_stamp_equal(&editor->index_stamp, &editor->disk))
+            editor_set_message(editor, "Line index is written to %s once the file is loaded and saved",
+                               editor->index_path);
+    } else if (strcmp(args, "off") == 0) {
+        editor->index_keep = false;
+        memset(&editor->index_stamp, 0, sizeof(FileStamp));
+        unlink(editor->index_path);
+        editor_set_message(editor, "Line index sidecar off");
+    } else if (*args) {
+        editor_set_message(editor, "Usage: index on | index off");
+    } else if (!editor->index_keep) {
+        editor_set_message(editor, "Line index sidecar off");
+    } else {
+        editor_set_message(editor, "Line index kept in %s (%s)", editor->index_path,
+                           file_stamp_equal(&editor->index_stamp, &editor->disk) ? "up to date" : "written once loaded and saved");
+    }
+}
+
+/**
+ * Jump to a line: <n> (line n), <n>% (n percent through the document), $ (last line)
+ */
+static void editor_command_goto(EditorState *editor, char *cmd) {
+    if (strcmp(cmd, "$") == 0) {
+        editor_goto_line(editor, INT_MAX);
+        return;
+    }
+
+    char *end;
+    long n = strtol(cmd, &end, 10);
+    if (n > INT_MAX)
+        n = INT_MAX;
+    if (strcmp(end, "%") == 0)
+        editor_goto_percent(editor, (int)n);
+    else if (*end == '\0')
+        editor_goto_line(editor, (int)n - 1);
+    else
+        editor_set_message(editor, "Not a command: %s", cmd);
+}
+
+/**
+ * Execute command prompt and return to NORMAL mode
+ */
+void editor_command_execute(EditorState *editor) {
+    editor->mode = MODE_NORMAL;
+
+    char *cmd = editor->prompt;
+    if (*cmd == '\0')
+        return;
+
+    if (cmd[0] == '%' && cmd[1] == 's' && cmd[2] == '/')
+        cmd++;
+
+    if (cmd[0] == 's' && cmd[1] == '/')
+        editor_command_substitute(editor, cmd + 2);
+    else if (strcmp(cmd, "wc") == 0)
+        editor_count_start(editor, NULL);
+    else if (strncmp(cmd, "autosave", 8) == 0 && (cmd[8] == '\0' || cmd[8] == ' '))
+        editor_command_autosave(editor, cmd + 8);
+    else if (strncmp(cmd, "compress", 8) == 0 && (cmd[8] == '\0' || cmd[8] == ' '))
+        editor_command_compress(editor, cmd + 8);
+    else if (strncmp(cmd, "index", 5) == 0 && (cmd[5] == '\0' || cmd[5] == ' '))
+        editor_command_index(editor, cmd + 5);
+    else if ((cmd[0] >= '0' && cmd[0] <= '9') || cmd[0] == '$')
+        editor_command_goto(editor, cmd);
+    else
+        editor_set_message(editor, "Not a command: %s", cmd);
+}
+
+/**
+ * Start or stop follow mode
+ * Following starts from the end of the loaded text, so anything appended since loading comes in first
+ */
+void editor_toggle_follow(EditorState *editor) {
+    if (editor->following) {
+        file_watch_close(&editor->follow);
+        editor->following = false;
+        editor_set_message(editor, "Follow stopped");
+        return;
+    }
+
+    if (!editor->filename) {
+        editor_set_message(editor, "No file to follow");
+        return;
+    }
+    // An edited rope no longer mirrors the file, so file offsets would not line up
+    if (editor->modified) {
+        editor_set_message(editor, "Save changes before following");
+        return;
+    }
+    editor_load_wait(editor);
+    int len = editor->rope ? editor->rope->total_len : 0;
+    if (!file_watch_open(&editor->follow, editor->filename, len)) {
+        editor_set_message(editor, "Cannot follow %s", editor->filename);
+        return;
+    }
+
+    editor->following = true;
+    editor_set_message(editor, "Following %s (%s)", editor->filename,
+                       file_watch_fd(&editor->follow) != -1 ? "inotify" : "polling");
+    editor_follow_update(editor);
+}
+
+/**
+ * Append the bytes the followed file has grown by
+ * The new text becomes a subtree joined along the rope's right spine (O(k + log n)) and the
+ * line index gains checkpoints for the new lines only. Views whose cursor sat on the last
+ * line jump to the new last line; the screen is redrawn only if a view shows the old end
+ */
+bool editor_follow_update(EditorState *editor) {
+    if (!editor->following)
+        return false;
+
+    char *text;
+    int len = file_watch_read(&editor->follow, &text);
+    if (len == -1) {
+        file_watch_close(&editor->follow);
+        editor->following = false;
+        if (!editor->modified) {
+            editor_reload(editor);
+            editor_set_message(editor, "File shrank; follow stopped and file reloaded");
+        } else {
+            editor_set_message(editor, "File shrank; follow stopped");
+        }
+        return true;
+    }
+    if (len == 0)
+        return false;
+
+    int old_len = editor->rope ? editor->rope->total_len : 0;
+    int last_line = editor->rope ? editor->rope->newlines : 0;
+    int newlines = 0;
+    for (char *p = text; (p = memchr(p, '\n', len - (p - text))) != NULL; p++)
+        newlines++;
+
+    // With unsaved edits, recovery replays the append by reading the range back from the file
+    if (journal_active(&editor->journal))
+        journal_append(&editor->journal, editor->follow.offset - editor->follow.partial_len - len, len);
+    editor->rope = rope_append(editor->rope, text, len);
+    line_index_append(&editor->line_index, old_len, text, len, last_line);
+    free(text);
+
+    // The rope mirrors the whole file again: don't mistake the growth for an outside change
+    FileStamp now;
+    if (editor->follow.partial_len == 0 && file_stamp_read(&now, editor->filename) &&
+        now.size == editor->follow.offset)
+        editor->disk = now;
+
+    // Line lengths change only on the old last line; keep the cache otherwise
+    if (editor->line_cache_valid && editor->line_cache_line == last_line)
+        editor_invalidate_line_cache(editor);
+
+    bool visible = false;
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view)) {
+        bool active = view == editor->active_view;
+        int *cursor_line = active ? &editor->cursor_line : &view->cursor_line;
+        int *cursor_col = active ? &editor->cursor_col : &view->cursor_col;
+        int top_line = active ? editor->top_line : view->top_line;
+
+        // Cursor at the end of the file: follow the new end (pending edits keep their place)
+        if (*cursor_line == last_line && newlines > 0 && !(active && editor->mode != MODE_NORMAL)) {
+            *cursor_line = last_line + newlines;
+            *cursor_col = 0;
+            if (active)
+                editor_invalidate_line_cache(editor);
+            visible = true;
+        }
+        if (last_line >= top_line && last_line < top_line + view->height)
+            visible = true;
+    }
+
+    return visible;
+}
+
+/**
+ * Notice changes made to the file by other programs
+ * Called before each redraw: one stat() call when nothing changed. A clean buffer is reloaded
+ * at once; with unsaved edits the user is warned (once) and saving is refused until decided
+ */
+void editor_check_disk(EditorState *editor) {
+    // Follow mode reads growth itself; pending INSERT/DELETE text is not in the rope yet;
+    // a file still loading is compared once it is all in
+    if (!editor->filename || editor->following || editor->mode != MODE_NORMAL ||
+        rope_load_active(&editor->loader))
+        return;
+
+    FileStamp now;
+    if (!file_stamp_read(&now, editor->filename) || file_stamp_equal(&now, &editor->disk))
+        return;
+
+    if (!editor->modified) {
+        editor_reload(editor);
+        return;
+    }
+    if (!editor->disk_changed) {
+        editor->disk_changed = true;
+        editor_set_message(editor, "%s changed on disk: R reloads (drops edits), S saves over it",
+                           editor->filename);
+    }
+}
+
+/**
+ * Re-read the file after an outside change
+ * Old leaves whose bytes are still in the file are reused wherever they moved, so only changed
+ * regions are rebuilt; cursors keep their line numbers (clamped to the new text)
+ */
+void editor_reload(EditorState *editor) {
+    if (!editor->filename)
+        return;
+
+    // The file is read whole here: drop what is still loading in the background
+    rope_load_cancel(&editor->loader);
+
+    double start = event_now_ms();
+    int len;
+    FileStamp stamp;
+    char *text = file_read_all(editor->filename, &len, &stamp);
+    if (!text) {
+        editor_set_message(editor, "Cannot reload %s", editor->filename);
+        return;
+    }
+
+    int old_leaves = 0;
+    RopeIter it;
+    if (editor->rope)
+        for (rope_iter_init(&it, editor->rope, 0); it.leaf; rope_iter_next(&it))
+            old_leaves++;
+
+    int kept;
+    editor->rope = rope_reload(editor->rope, text, len, &kept);
+    free(text);
+
+    editor->disk = stamp;
+    editor->disk_changed = false;
+    editor->modified = false;
+    journal_discard(&editor->journal);
+    autosave_discard(&editor->autosave);
+    if (editor->following) {
+        editor->follow.offset = len;
+        editor->follow.partial_len = 0;
+    }
+    line_index_invalidate(&editor->line_index);
+    editor_invalidate_line_cache(editor);
+    if (editor->rope)
+        editor_clamp_cursor(editor);
+    else
+        editor->cursor_line = editor->cursor_col = 0;
+
+    editor_set_message(editor, "Reloaded %s: %d of %d leaves reused (%.1f ms)",
+                       editor->filename, kept, old_leaves, event_now_ms() - start);
+}
+
+/**
+ * Append what the background loader has finished (wait: all of it)
+ * The line index gains checkpoints for the new lines only, as in follow mode; views and
+ * cursors keep their place since text only grows past the end
+ */
+static void editor_load_append(EditorState *editor, bool wait) {
+    int old_len = editor->rope ? editor->rope->total_len : 0;
+    int last_line = editor->rope ? editor->rope->newlines : 0;
+    editor->rope = rope_load_poll(editor->rope, &editor->loader, wait);
+
+    int line = last_line;
+    RopeIter it;
+    for (rope_iter_init(&it, editor->rope, old_len); it.leaf && it.leaf_start >= old_len; rope_iter_next(&it)) {
+        line_index_append(&editor->line_index, it.leaf_start, rope_leaf_text(it.leaf), it.leaf->total_len, line);
+        line += it.leaf->newlines;
+    }
+
+    // Line lengths change only on the old last line; keep the cache otherwise
+    if (line != last_line && editor->line_cache_valid && editor->line_cache_line == last_line)
+        editor_invalidate_line_cache(editor);
+
+    if (!rope_load_active(&editor->loader)) {
+        editor_set_message(editor, "Loaded %s (%d bytes) in %.0f ms", editor->filename,
+                           editor->rope->total_len, event_now_ms() - editor->load_start);
+        editor_warn_utf8(editor, editor->loader.invalid, (int)editor->loader.first_invalid);
+    }
+}
+
+/**
+ * Append the parts of the file loaded in the background since the last call
+ * Returns true while loading (its progress is shown) and when it ends
+ */
+bool editor_load_poll(EditorState *editor) {
+    if (!rope_load_active(&editor->loader))
+        return false;
+
+    editor_load_append(editor, false);
+    return true;
+}
+
+/**
+ * Wait for the rest of the file (searching, counting, saving and following need all of it)
+ */
+void editor_load_wait(EditorState *editor) {
+    if (rope_load_active(&editor->loader))
+        editor_load_append(editor, true);
+}
+
+/**
+ * Start a background autosave if one is due
+ * The snapshot (see editor_snapshot) is taken here; the writing is done by a worker pool job
+ */
+void editor_autosave(EditorState *editor) {
+    // A file still loading is only partly in the rope: autosave once it is all in
+    if (rope_load_active(&editor->loader) || !autosave_due(&editor->autosave))
+        return;
+
+    RopeSnapshot snap;
+    editor_snapshot(editor, &snap);
+    autosave_start(&editor->autosave, &snap);
+}
+
+/**
+ * Collect a finished autosave
+ * Returns true while a save runs (its progress is shown) and when one finishes
+ */
+bool editor_autosave_poll(EditorState *editor) {
+    Autosave *autosave = &editor->autosave;
+    if (!autosave->running)
+        return false;
+
+    if (autosave_poll(autosave) && autosave->failed)
+        editor_set_message(editor, "Autosave to %s failed", autosave->path);
+    return true;
+}
+
+/**
+ * Rewrite the line index sidecar once the rope holds all of a new version of the file
+ * (after loading, saving or reloading); unsaved edits, a part still loading or a followed
+ * file that keeps growing leave it for later. A failed write is not retried until the file changes
+ */
+void editor_index_sync(EditorState *editor) {
+    if (!editor->index_keep || editor->modified || editor->disk_changed || editor->following ||
+        rope_load_active(&editor->loader) || file_stamp_equal(&editor->index_stamp, &editor->disk))
+        return;
+
+    editor->index_stamp = editor->disk;
+    if (!line_index_save(&editor->line_index, editor->rope, editor->index_path, editor->filename, &editor->disk))
+        editor_set_message(editor, "Cannot write line index %s", editor->index_path);
+}
+
+/**
+ * Start compressing the text away from every view if compression is on
+ * Text within COMPRESS_HOT_MARGIN bytes of a view's first line stays as it is, so scrolling and
+ * editing near a view never wait for decompression. A new round starts once the rope has changed
+ */
+void editor_compress(EditorState *editor) {
+    if (!editor->compress || editor->freeze || editor->edits == editor->freeze_edits ||
+        rope_load_active(&editor->loader))
+        return;
+
+    int count = 0;
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view))
+        count++;
+    int (*hot)[2] = malloc(count * sizeof(*hot));
+    if (!hot) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int i = 0;
+    for (ViewNode *view = view_first(editor->views); view; view = view_next(view), i++) {
+        int top = view == editor->active_view ? editor->top_line : view->top_line;
+        int pos = editor_line_start(editor, top);
+        hot[i][0] = pos - COMPRESS_HOT_MARGIN;
+        hot[i][1] = pos < INT_MAX - COMPRESS_HOT_MARGIN ? pos + COMPRESS_HOT_MARGIN : INT_MAX;
+    }
+
+    editor->freeze = rope_freeze_start(editor->rope, hot, count);
+    editor->freeze_edits = editor->edits;
+    editor->freeze_start = event_now_ms();
+    free(hot);
+}
+
+/**
+ * Install a finished compression
+ * Offsets and line numbers are unchanged, so the line index, cache and views stay valid
+ * Returns true while one runs (its progress is shown) and when it ends
+ */
+bool editor_compress_poll(EditorState *editor) {
+    if (!editor->freeze)
+        return false;
+    if (!rope_freeze_done(editor->freeze))
+        return true;
+
+    long frozen, stored;
+    editor->rope = rope_freeze_finish(editor->rope, editor->freeze, &frozen, &stored);
+    editor->freeze = NULL;
+
+    if (editor->freeze_report)
+        editor_set_message(editor, "Compressed %.1f MB of text into %.1f MB (%.0f ms)",
+                           frozen / 1048576.0, stored / 1048576.0, event_now_ms() - editor->freeze_start);
+    editor->freeze_report = false;
+    return true;
+}
+
+/**
+ * Store the focused position in the active view node (before it loses focus or is copied)
+ */
+static void editor_park_view(EditorState *editor) {
+    editor->active_view->cursor_line = editor->cursor_line;
+    editor->active_view->cursor_col = editor->cursor_col;
+    editor->active_view->top_line = editor->top_line;
+    editor->active_view->left_col = editor->left_col;
+}
+
+/**
+ * Give focus to a view: its saved position becomes the editor's cursor
+ * Positions of unfocused views are only shifted, never validated, so clamp here
+ */
+static void editor_load_view(EditorState *editor, ViewNode *view) {
+    editor->active_view = view;
+    editor->cursor_line = view->cursor_line;
+    editor->cursor_col = view->cursor_col;
+    editor->top_line = view->top_line;
+    editor->left_col = view->left_col;
+    editor_invalidate_line_cache(editor);
+    editor_clamp_cursor(editor);
+}
+
+/**
+ * Split the focused view in two; focus stays in the first (top / left) half
+ * Both halves start at the same position and read the same rope
+ */
+void editor_split_view(EditorState *editor, SplitKind split) {
+    ViewNode *view = editor->active_view;
+
+    // Each half needs at least one row / column next to the separator
+    if ((split == SPLIT_HORIZONTAL && view->height < 3) || (split == SPLIT_VERTICAL && view->width < 3)) {
+        editor_set_message(editor, "Not enough room to split");
+        return;
+    }
+
+    editor_park_view(editor);
+    editor->active_view = view_split(view, split);
+}
+
+/**
+ * Close the focused view; its area goes to the neighbouring view or views
+ */
+void editor_close_view(EditorState *editor) {
+    ViewNode *next = view_close(editor->active_view);
+    if (!next) {
+        editor_set_message(editor, "Cannot close the last view");
+        return;
+    }
+    editor_load_view(editor, next);
+}
+
+/**
+ * Close every view except the focused one
+ */
+void editor_only_view(EditorState *editor) {
+    view_free(editor->views);
+    editor->views = view_create();
+    editor->active_view = editor->views;
+}
+
+/**
+ * Move focus to the next view, wrapping around to the first
+ */
+void editor_focus_next_view(EditorState *editor) {
+    ViewNode *next = view_next(editor->active_view);
+    if (!next)
+        next = view_first(editor->views);
+    if (next == editor->active_view)
+        return;
+
+    editor_park_view(editor);
+    editor_load_view(editor, next);
+}
+
+/**
+ * Save current rope contents to file
+ * Returns true on success, false on failure
+ */
+bool editor_save(EditorState *editor, bool force) {
+    // Need filename to save
+    if (!editor->filename)
+        return false;
+
+    // Don't overwrite changes made by another program without being told to
+    FileStamp now;
+    if (!force && file_stamp_read(&now, editor->filename) && !file_stamp_equal(&now, &editor->disk)) {
+        editor->disk_changed = true;
+        editor_set_message(editor, "%s changed on disk: R reloads (drops edits), S saves over it",
+                           editor->filename);
+        return false;
+    }
+
+    // Write rope to file (all of it: wait for the part still loading)
+    editor_load_wait(editor);
+    if (save_file(editor->rope, editor->filename)) {
+        editor->modified = false;  // Clear modified flag
+        editor->disk_changed = false;
+        file_stamp_read(&editor->disk, editor->filename);
+
+        // The file holds every journaled edit now; the next edit starts a new journal
+        journal_discard(&editor->journal);
+        autosave_discard(&editor->autosave);
+
+        // The file now holds exactly the rope: keep following from its new end
+        if (editor->following) {
+            editor->follow.offset = editor->rope ? editor->rope->total_len : 0;
+            editor->follow.partial_len = 0;
+        }
         return true;
     }
 
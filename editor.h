@@ -2,31 +2,93 @@
 #define EDITOR_H
 
 #include "rope.h"
+#include "lineindex.h"
+#include "search.h"
+#include "regexp.h"
+#include "view.h"
+#include "follow.h"
+#include "journal.h"
+#include "autosave.h"
 #include <stdbool.h>
 
-// Maximum size of insert buffer before flushing to rope
-#define MAX_BUFFER_SIZE 4096
+// Initial capacity of the insert gap buffer (grows by doubling)
+#define INSERT_BUFFER_INITIAL_SIZE 256
+
+// Maximum length of text typed on the bottom prompt line (search pattern, command)
+#define PROMPT_MAX 256
+
+// Maximum length of a one-shot status bar message
+#define MESSAGE_MAX 128
+
+// Text within this many bytes of a view's first line is never compressed (see editor_compress)
+#define COMPRESS_HOT_MARGIN (1 << 20)
 
 // Editor modes (inspired by Vim)
 typedef enum {
     MODE_NORMAL,   // Navigate without editing
     MODE_INSERT,   // Insert text (buffered until ESC)
-    MODE_DELETE    // Delete text with backspace
+    MODE_DELETE,   // Delete text with backspace (batched until ESC or cursor motion)
+    MODE_SEARCH,   // Type a search pattern on the prompt line (incremental)
+    MODE_COMMAND   // Type a ':' command on the prompt line
 } EditorMode;
 
 // Editor state - contains all editor data
 typedef struct {
     RopeNode *rope;              // The rope data structure containing file content
+    LineIndex line_index;        // Sparse line-start checkpoints, maintained across edits
     int cursor_line;             // Current line number (0-indexed)
-    int cursor_col;              // Current column number (0-indexed, character position not display)
+    int cursor_col;              // Byte offset of cursor in current line (0-indexed, on a UTF-8 character boundary)
     int top_line;                // Top line currently visible on screen (for scrolling)
+    int left_col;                // First visible display column (horizontal scrolling)
+    ViewNode *views;             // Window layout (split views all read this rope)
+    ViewNode *active_view;       // View with focus; its position is cursor_line/cursor_col/top_line/left_col
+    int line_cache_line;         // Line whose metrics are cached below
+    int line_cache_start;        // Cached start position of line_cache_line in rope
+    int line_cache_len;          // Cached length of line_cache_line (excluding newline)
+    bool line_cache_valid;       // False after rope edits; recomputed lazily
+    unsigned long edits;         // Edit generation: bumped with every line cache invalidation (from 1)
     char *filename;              // Name of file being edited
     bool modified;               // True if file has unsaved changes
     EditorMode mode;             // Current editor mode
-    char insert_buffer[MAX_BUFFER_SIZE];  // Buffer for insert mode text (not yet in rope)
-    int insert_buffer_len;       // Current length of insert buffer
+    char *insert_buffer;         // Gap buffer for insert mode text (not yet in rope)
+    int insert_buffer_cap;       // Allocated size of insert buffer (text + gap)
+    int insert_buffer_len;       // Number of pending characters in insert buffer
+    int insert_gap;              // Start of the gap = cursor offset inside pending text
     int insert_start_pos;        // Position in rope where insert mode started
-    int delete_count;            // Count of deletions in delete mode
+    int insert_start_line;       // Line of insert_start_pos
+    int insert_start_col;        // Column of insert_start_pos
+    int delete_start;            // Start of pending deletion range in rope (cursor sits here)
+    int delete_end;              // End of pending deletion range (empty when equal to start)
+    int delete_end_line;         // Line of delete_end
+    int delete_repeat;           // Count prefix typed in DELETE mode (0 = none)
+    int pending_key;             // NORMAL mode key waiting for the key that completes it ('g', Ctrl-W; 0 = none)
+    int pending_count;           // Count typed before a jump (<n>G, <n>gg, <n>%; 0 = none)
+    char prompt[PROMPT_MAX];     // Text typed on the prompt line
+    int prompt_len;              // Length of prompt text
+    char *search_pattern;        // Last accepted search pattern (NULL if none)
+    bool search_backward;        // Direction of last search ('/' forward, '?' backward)
+    int search_origin;           // Cursor position when the search prompt was opened
+    char *regex_source;          // Pattern that regex was compiled from (NULL if none)
+    Regexp *regex;               // Compiled regex cache (reused while the pattern is unchanged)
+    char message[MESSAGE_MAX];   // One-shot status bar message (cleared on next key)
+    bool following;              // Follow mode: bytes appended to the file are appended to the rope
+    FileWatch follow;            // Watch on filename while following
+    FileStamp disk;              // File on disk when last loaded, reloaded or saved
+    bool disk_changed;           // File changed on disk while there were unsaved edits (warned once)
+    Journal journal;             // Write-ahead journal of unsaved edits (replayed after a crash)
+    Autosave autosave;           // Periodic background copy of the buffer beside the file
+    SnapshotCount count;         // Count running on the worker pool (:wc, 'C' on large files)
+    double count_start;          // Time the count started (ms)
+    RopeLoader loader;           // Rest of a large file, still loading in the background
+    double load_start;           // Time loading started (ms)
+    bool compress;               // Keep text away from every view compressed in cold leaves (:compress)
+    RopeFreeze *freeze;          // Stretches being compressed in the background (NULL if none)
+    unsigned long freeze_edits;  // Edit generation last searched for stretches to compress (0 = none yet)
+    double freeze_start;         // Time the compression started (ms)
+    bool freeze_report;          // Say what the running compression saved (it was asked for)
+    char *index_path;            // Line index sidecar beside the file (NULL for a buffer without a file)
+    bool index_keep;             // Keep the sidecar up to date (:index on, or found at open)
+    FileStamp index_stamp;       // Version of the file the sidecar describes
 } EditorState;
 
 // ========== Editor initialization and cleanup ==========
@@ -51,6 +113,19 @@ void editor_move_left(EditorState *editor);
 // Move cursor right one character (wraps to next line if at end)
 void editor_move_right(EditorState *editor);
 
+// Move cursor to the start / end of its line (the view scrolls sideways to follow)
+void editor_move_line_start(EditorState *editor);
+void editor_move_line_end(EditorState *editor);
+
+// Move cursor to the start of a line (0-based, clamped), in O(log n) whatever the distance
+void editor_goto_line(EditorState *editor, int line);
+
+// Move cursor to the line 'percent' percent of the way through the document
+void editor_goto_percent(EditorState *editor, int percent);
+
+// Scroll one screen down (direction 1) or up (-1), moving the cursor along
+void editor_page(EditorState *editor, int direction);
+
 // Clamp cursor position to valid bounds
 void editor_clamp_cursor(EditorState *editor);
 
@@ -76,18 +151,140 @@ void editor_flush_insert_buffer(EditorState *editor);
 // Delete character from insert buffer (backspace in INSERT mode)
 void editor_delete_buffer_char(EditorState *editor);
 
+// Move cursor left inside the pending insert text
+void editor_insert_move_left(EditorState *editor);
+
+// Move cursor right inside the pending insert text
+void editor_insert_move_right(EditorState *editor);
+
+// Get character at logical index of the insert buffer (skipping the gap)
+char editor_insert_buffer_char(EditorState *editor, int idx);
+
 // ========== Delete mode operations ==========
 
-// Delete character from rope (backspace in DELETE mode)
+// Extend pending deletion by one character, or by the count prefix if one was typed
 void editor_delete_char(EditorState *editor);
 
-// Flush delete operations (currently just resets counter)
+// Extend pending deletion range by n characters before the cursor
+void editor_delete_chars(EditorState *editor, int n);
+
+// Append a digit to the DELETE mode count prefix
+void editor_delete_count_digit(EditorState *editor, int digit);
+
+// Apply pending deletion range to rope with a single delete_at
 void editor_flush_delete_buffer(EditorState *editor);
 
+// ========== Search operations ==========
+
+// Enter SEARCH mode ('/' forward or '?' backward)
+void editor_enter_search_mode(EditorState *editor, bool backward);
+
+// Add character to search prompt and jump to the first match (incremental)
+void editor_search_insert_char(EditorState *editor, char c);
+
+// Remove last character of search prompt (leaves SEARCH mode when empty)
+void editor_search_delete_char(EditorState *editor);
+
+// Accept search prompt (Enter) and return to NORMAL mode
+void editor_search_accept(EditorState *editor);
+
+// Cancel search prompt (ESC) and restore cursor
+void editor_search_cancel(EditorState *editor);
+
+// Jump to next match of last pattern ('n'), or previous one if reverse ('N')
+void editor_search_next(EditorState *editor, bool reverse);
+
+// Count all matches of last pattern and report in status bar
+// Literal patterns in large files are counted in the background
+void editor_count_matches(EditorState *editor);
+
+// Stop a background count (ESC in NORMAL mode)
+void editor_count_cancel(EditorState *editor);
+
+// Replace every match of pattern with replacement in one rope rebuild
+void editor_replace_all(EditorState *editor, char *pattern, char *replacement);
+
+// ========== Command line operations ==========
+
+// Enter COMMAND mode (':')
+void editor_enter_command_mode(EditorState *editor);
+
+// Add character to command prompt
+void editor_command_insert_char(EditorState *editor, char c);
+
+// Remove last character of command prompt (leaves COMMAND mode when empty)
+void editor_command_delete_char(EditorState *editor);
+
+// Run command prompt (Enter) and return to NORMAL mode
+void editor_command_execute(EditorState *editor);
+
+// Cancel command prompt (ESC)
+void editor_command_cancel(EditorState *editor);
+
+// ========== Follow mode ==========
+
+// Start or stop following the file (tail -f)
+void editor_toggle_follow(EditorState *editor);
+
+// Append bytes the file has grown by; returns true if the screen needs redrawing
+bool editor_follow_update(EditorState *editor);
+
+// ========== External changes ==========
+
+// Check whether the file changed on disk; reload it if there are no unsaved edits, warn otherwise
+void editor_check_disk(EditorState *editor);
+
+// Re-read the file from disk, reusing unchanged leaves (unsaved edits are dropped)
+void editor_reload(EditorState *editor);
+
+// ========== Background loading ==========
+
+// Append the parts of a large file loaded since the last call; returns true while loading
+bool editor_load_poll(EditorState *editor);
+
+// Wait until the whole file is loaded (before an operation that needs all of it)
+void editor_load_wait(EditorState *editor);
+
+// ========== Autosave ==========
+
+// Start writing the buffer to its autosave file in the background if a trigger fired
+void editor_autosave(EditorState *editor);
+
+// Collect a finished autosave; returns true if the status bar needs redrawing
+bool editor_autosave_poll(EditorState *editor);
+
+// ========== Line index sidecar ==========
+
+// Rewrite the line index sidecar if it is kept and the rope now holds a newer version of the file
+void editor_index_sync(EditorState *editor);
+
+// ========== Compression ==========
+
+// Start compressing the text away from every view in the background if compression is on
+void editor_compress(EditorState *editor);
+
+// Install a finished compression; returns true while one runs (its progress is shown) and when it ends
+bool editor_compress_poll(EditorState *editor);
+
+// ========== View operations ==========
+
+// Split the focused view (horizontal = stacked, vertical = side by side)
+void editor_split_view(EditorState *editor, SplitKind split);
+
+// Close the focused view (focus moves to the view taking over its area)
+void editor_close_view(EditorState *editor);
+
+// Close every view except the focused one
+void editor_only_view(EditorState *editor);
+
+// Move focus to the next view (wrapping around)
+void editor_focus_next_view(EditorState *editor);
+
 // ========== File operations ==========
 
 // Save current rope contents to file
-bool editor_save(EditorState *editor);
+// Refuses (returns false) if the file changed on disk since it was loaded, unless force is set
+bool editor_save(EditorState *editor, bool force);
 
 // ========== Helper functions ==========
 
@@ -97,4 +294,22 @@ int editor_get_cursor_position(EditorState *editor);
 // Get length of current line
 int editor_get_current_line_length(EditorState *editor);
 
+// Get cursor column in codepoints (for display; cursor_col itself counts bytes)
+int editor_get_char_col(EditorState *editor);
+
+// Drop cached cursor line metrics (call after every rope edit)
+void editor_invalidate_line_cache(EditorState *editor);
+
+// Get starting position of a line via the line index
+int editor_line_start(EditorState *editor, int line);
+
+// Get line number containing a rope position via the line index
+int editor_line_from_pos(EditorState *editor, int pos);
+
+// Move cursor to an absolute rope position
+void editor_move_to_pos(EditorState *editor, int pos);
+
+// Set one-shot status bar message (printf-style)
+void editor_set_message(EditorState *editor, const char *fmt, ...);
+
 #endif
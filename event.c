@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include "event.h"
+
+// Self-pipe: the SIGWINCH handler writes a byte, event_wait() polls the read end
+static int resize_pipe[2] = { -1, -1 };
+
+/**
+ * SIGWINCH handler: only wakes the main loop (write() is async-signal-safe)
+ */
+static void event_on_resize(int sig) {
+    (void)sig;
+    int saved = errno;
+    char c = 0;
+    if (write(resize_pipe[1], &c, 1) < 0) {
+        // Pipe full: a wake-up is already pending
+    }
+    errno = saved;
+}
+
+/**
+ * Create the resize pipe and install the SIGWINCH handler
+ * SA_RESTART keeps blocking reads (e.g. the rest of an escape sequence) from failing with EINTR
+ */
+void event_init(void) {
+    if (pipe(resize_pipe) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(resize_pipe[i], F_SETFL, fcntl(resize_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(resize_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    struct sigaction sa;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = event_on_resize;
+    sigaction(SIGWINCH, &sa, NULL);
+}
+
+/**
+ * Restore default SIGWINCH handling and close the pipe
+ */
+void event_cleanup(void) {
+    signal(SIGWINCH, SIG_DFL);
+    for (int i = 0; i < 2; i++) {
+        if (resize_pipe[i] != -1)
+            close(resize_pipe[i]);
+        resize_pipe[i] = -1;
+    }
+}
+
+/**
+ * Wait for the first of: a key, a resize, watch_fd or job_fd readable, timeout_ms elapsed
+ * Several sources can be ready at once; all of them are reported
+ */
+int event_wait(int watch_fd, int job_fd, int timeout_ms) {
+    struct pollfd pfds[4] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = resize_pipe[0], .events = POLLIN },
+        { .fd = watch_fd, .events = POLLIN },  // poll() skips negative descriptors
+        { .fd = job_fd, .events = POLLIN },    // Drained by worker_collect()
+    };
+
+    // A signal interrupts poll(); the resize pipe is readable when it is polled again
+    int ready;
+    while ((ready = poll(pfds, 4, timeout_ms)) == -1 && errno == EINTR)
+        ;
+    if (ready <= 0)
+        return EVENT_TIMEOUT;
+
+    int events = 0;
+    if (pfds[0].revents & (POLLIN | POLLHUP))
+        events |= EVENT_KEY;
+    if (pfds[1].revents & POLLIN) {
+        // Several resizes in a row need one redraw
+        char drain[64];
+        while (read(resize_pipe[0], drain, sizeof(drain)) > 0)
+            ;
+        events |= EVENT_RESIZE;
+    }
+    if (pfds[2].revents & (POLLIN | POLLHUP | POLLERR))
+        events |= EVENT_WATCH;
+    if (pfds[3].revents & POLLIN)
+        events |= EVENT_JOB;
+    return events;
+}
+
+/**
+ * The earlier of two timeouts (-1 means none)
+ */
+int event_earliest(int a, int b) {
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
+/**
+ * Monotonic clock in milliseconds
+ */
+double event_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Milliseconds left before the next frame is allowed
+ */
+int frame_wait(FramePacer *pacer) {
+    double wait = pacer->last_frame + EVENT_FRAME_MS - event_now_ms();
+    return wait > 0 ? (int)wait + 1 : 0;
+}
+
+/**
+ * Start the next frame interval now
+ */
+void frame_drawn(FramePacer *pacer) {
+    pacer->last_frame = event_now_ms();
+}
@@ -0,0 +1,49 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdbool.h>
+
+// Shortest time between two frames (about one display refresh at 60 Hz)
+#define EVENT_FRAME_MS 16
+
+// What the main loop was woken up by (bit mask)
+#define EVENT_KEY 1       // Input is ready on stdin
+#define EVENT_RESIZE 2    // The terminal was resized (SIGWINCH)
+#define EVENT_WATCH 4     // The watched descriptor is readable (e.g. a followed file grew)
+#define EVENT_TIMEOUT 8   // The timeout passed
+#define EVENT_JOB 16      // A worker pool group finished (see worker_fd)
+
+// Paces redraws to at most one per EVENT_FRAME_MS
+typedef struct {
+    double last_frame;    // Time the last frame was drawn (ms, monotonic clock)
+} FramePacer;
+
+// ========== Lifecycle ==========
+
+// Start catching SIGWINCH (the handler only writes to a pipe that event_wait() polls)
+void event_init(void);
+
+// Restore the default SIGWINCH handling and close the pipe
+void event_cleanup(void);
+
+// ========== Waiting ==========
+
+// Wait for a key, a resize, watch_fd or job_fd to become readable (-1 = none) or timeout_ms (-1 = none)
+// Returns the EVENT_* bits of everything that is ready
+int event_wait(int watch_fd, int job_fd, int timeout_ms);
+
+// The earlier of two timeouts in milliseconds (-1 = no timeout)
+int event_earliest(int a, int b);
+
+// Current time in milliseconds (monotonic clock)
+double event_now_ms(void);
+
+// ========== Frame pacing ==========
+
+// Milliseconds until the next frame may be drawn (0 = now)
+int frame_wait(FramePacer *pacer);
+
+// Record that a frame was just drawn
+void frame_drawn(FramePacer *pacer);
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "follow.h"
+#include "rope.h"
+
+/**
+ * Start watching a file for appended bytes
+ * Uses inotify on Linux; elsewhere (or if inotify fails) the size is polled
+ */
+bool file_watch_open(FileWatch *watch, char *filename, long offset) {
+    watch->fd = open(filename, O_RDONLY);
+    if (watch->fd == -1)
+        return false;
+
+    watch->notify_fd = -1;
+    watch->offset = offset;
+    watch->partial_len = 0;
+
+#ifdef __linux__
+    watch->notify_fd = inotify_init1(IN_NONBLOCK);
+    if (watch->notify_fd != -1 && inotify_add_watch(watch->notify_fd, filename, IN_MODIFY) == -1) {
+        close(watch->notify_fd);
+        watch->notify_fd = -1;
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * Stop watching: close the file and the inotify descriptor
+ */
+void file_watch_close(FileWatch *watch) {
+    if (watch->fd != -1)
+        close(watch->fd);
+    if (watch->notify_fd != -1)
+        close(watch->notify_fd);
+    watch->fd = -1;
+    watch->notify_fd = -1;
+}
+
+/**
+ * Descriptor that becomes readable when the file changes (-1 when polling)
+ */
+int file_watch_fd(FileWatch *watch) {
+    return watch->notify_fd;
+}
+
+/**
+ * Wait time before the next check: forever with inotify, FOLLOW_POLL_MS otherwise
+ */
+int file_watch_timeout(FileWatch *watch) {
+    return watch->notify_fd != -1 ? -1 : FOLLOW_POLL_MS;
+}
+
+/**
+ * Read everything appended since the last call
+ * A UTF-8 sequence still being written is held back until its last byte arrives,
+ * so the returned text can be cut into leaves directly
+ */
+int file_watch_read(FileWatch *watch, char **text) {
+    *text = NULL;
+
+    // Consume pending change events (their content doesn't matter, the size does)
+    if (watch->notify_fd != -1) {
+        char events[4096];
+        while (read(watch->notify_fd, events, sizeof(events)) > 0)
+            ;
+    }
+
+    struct stat st;
+    if (fstat(watch->fd, &st) == -1)
+        return 0;
+    if (st.st_size < watch->offset)
+        return -1;  // truncated or replaced: appended bytes can no longer be told apart
+    if (st.st_size == watch->offset)
+        return 0;
+
+    long grown = st.st_size - watch->offset;
+    char *buf = malloc(watch->partial_len + grown);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(buf, watch->partial, watch->partial_len);
+
+    long got = 0;
+    while (got < grown) {
+        ssize_t n = pread(watch->fd, buf + watch->partial_len + got, grown - got, watch->offset + got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    watch->offset += got;
+
+    // Hold back an incomplete trailing sequence for the next read
+    int len = watch->partial_len + got;
+    int complete = utf8_complete_len(buf, len);
+    watch->partial_len = len - complete;
+    memcpy(watch->partial, buf + complete, watch->partial_len);
+
+    if (complete == 0) {
+        free(buf);
+        return 0;
+    }
+    *text = buf;
+    return complete;
+}
+
+/**
+ * Fill a stamp from stat results
+ */
+static void file_stamp_set(FileStamp *stamp, struct stat *st) {
+    stamp->dev = st->st_dev;
+    stamp->ino = st->st_ino;
+    stamp->size = st->st_size;
+    stamp->mtime_sec = st->st_mtim.tv_sec;
+    stamp->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+/**
+ * Stamp a file as it is on disk now
+ */
+bool file_stamp_read(FileStamp *stamp, char *filename) {
+    struct stat st;
+    if (stat(filename, &st) == -1)
+        return false;
+    file_stamp_set(stamp, &st);
+    return true;
+}
+
+/**
+ * Same file, same size, same modification time
+ * (a rewrite within one mtime tick that keeps the size goes unnoticed)
+ */
+bool file_stamp_equal(FileStamp *a, FileStamp *b) {
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+/**
+ * Read a whole file for reloading
+ * The stamp is taken before reading, so a write racing with the read shows up as a later change
+ */
+char *file_read_all(char *filename, int *len, FileStamp *stamp) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    file_stamp_set(stamp, &st);
+
+    char *buf = malloc(st.st_size + 1);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // The file may still be shrinking or growing: take what is there up to the stamped size
+    long got = 0;
+    while (got < st.st_size) {
+        ssize_t n = pread(fd, buf + got, st.st_size - got, got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(fd);
+
+    buf[got] = '\0';
+    *len = got;
+    return buf;
+}
+
+/**
+ * Name of a file kept beside filename (journal, autosave, line index)
+ * "dir/name" gives "dir/.name.tim2.<ext>": hidden, in the same directory as the file
+ */
+char *file_sidecar_path(char *filename, char *ext) {
+    char *slash = strrchr(filename, '/');
+    int dir_len = slash ? (int)(slash - filename) + 1 : 0;
+    char *path = malloc(strlen(filename) + strlen(ext) + 8);
+    if (!path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(path, "%.*s.%s.tim2.%s", dir_len, filename, filename + dir_len, ext);
+    return path;
+}
@@ -0,0 +1,67 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// How often a followed file is checked for growth when inotify is not available
+#define FOLLOW_POLL_MS 250
+
+// Watches a file for appended bytes (follow mode, like tail -f)
+// Growth is signalled by inotify where available; otherwise the file size is polled
+typedef struct {
+    int fd;               // Followed file (read with pread, never seeks)
+    int notify_fd;        // inotify descriptor, readable when the file changes (-1 = poll)
+    long offset;          // Bytes of the file already handed out
+    char partial[4];      // UTF-8 sequence cut off at the end of the last read
+    int partial_len;      // Bytes in partial
+} FileWatch;
+
+// Identity and last modification of a file, to notice when it is changed by another program
+typedef struct {
+    dev_t dev;            // Device and inode: a file replaced by rename gets a new inode
+    ino_t ino;
+    off_t size;
+    long mtime_sec;       // Modification time (nanoseconds where the file system keeps them)
+    long mtime_nsec;
+} FileStamp;
+
+// ========== Lifecycle ==========
+
+// Start watching filename, treating its first 'offset' bytes as already read
+// Returns false if the file cannot be opened
+bool file_watch_open(FileWatch *watch, char *filename, long offset);
+
+// Stop watching and close descriptors
+void file_watch_close(FileWatch *watch);
+
+// ========== Reading growth ==========
+
+// Descriptor to wait on for changes (-1 if the file has to be polled)
+int file_watch_fd(FileWatch *watch);
+
+// Milliseconds to wait before checking again (-1 = wait for the descriptor)
+int file_watch_timeout(FileWatch *watch);
+
+// Read the bytes appended since the last call, ending on a UTF-8 boundary
+// Returns their length (0 if none) and a malloc'd copy in *text; -1 if the file shrank
+int file_watch_read(FileWatch *watch, char **text);
+
+// ========== Change detection ==========
+
+// Stamp filename as it is now (returns false if it cannot be stat'ed)
+bool file_stamp_read(FileStamp *stamp, char *filename);
+
+// Check whether two stamps describe the same unchanged file
+bool file_stamp_equal(FileStamp *a, FileStamp *b);
+
+// Read the whole file into a malloc'd buffer and stamp it from the same descriptor
+// Returns the buffer (*len bytes, NUL-terminated), or NULL if the file cannot be read
+char *file_read_all(char *filename, int *len, FileStamp *stamp);
+
+// ========== File names ==========
+
+// Name of a file kept beside filename: "dir/name" gives "dir/.name.tim2.<ext>" (malloc'd)
+char *file_sidecar_path(char *filename, char *ext);
+
+#endif
@@ -1,33 +1,68 @@
 #include <stdio.h>
+#include <limits.h>
 #include <unistd.h>
+#include <poll.h>
 #include "input.h"
 
+// Bytes read from stdin but not handled yet (a paste arrives in one read)
+static unsigned char input_buffer[INPUT_BUFFER_SIZE];  // Unsigned so UTF-8 bytes (>= 0x80) arrive as printable keys
+static int input_pos = 0;
+static int input_len = 0;
+
 /**
  * Read a single character from stdin
- * Blocking call - waits for input
+ * Blocking call - waits for input; whatever else is already typed is read along with it
  */
 int read_key(void) {
-    char c;
-    if (read(STDIN_FILENO, &c, 1) == 1)
-        return c;
-    return -1;
+    if (input_pos == input_len) {
+        ssize_t n = read(STDIN_FILENO, input_buffer, INPUT_BUFFER_SIZE);
+        if (n <= 0)
+            return -1;
+        input_pos = 0;
+        input_len = n;
+    }
+    return input_buffer[input_pos++];
+}
+
+/**
+ * Check whether keys read from stdin are still waiting in the input buffer
+ * (poll() on stdin can't see them: they have already been read)
+ */
+bool input_buffered(void) {
+    return input_pos < input_len;
+}
+
+/**
+ * Check whether a key can be read without blocking, waiting up to timeout_ms for one
+ */
+bool input_pending(int timeout_ms) {
+    if (input_pos < input_len)
+        return true;
+
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN);
 }
 
 /**
- * Parse escape sequence to detect arrow keys
- * Arrow keys send: ESC [ A/B/C/D for up/down/right/left
+ * Parse escape sequence to detect arrow and page keys
+ * Arrow keys send: ESC [ A/B/C/D for up/down/right/left; Page Up / Page Down send ESC [ 5 ~ / ESC [ 6 ~
+ * A lone ESC (nothing follows within ESCAPE_TIMEOUT_MS) is KEY_REGULAR
  */
 KeyType parse_arrow_key(int first_key) {
     // Not an escape sequence
     if (first_key != KEY_ESCAPE)
         return KEY_REGULAR;
 
-    char seq[2];
+    // Plain ESC key press: no sequence bytes pending
+    if (!input_pending(ESCAPE_TIMEOUT_MS))
+        return KEY_REGULAR;
+
+    int seq[2];
 
     // Read next two characters of escape sequence
-    if (read(STDIN_FILENO, &seq[0], 1) != 1)
+    if ((seq[0] = read_key()) == -1)
         return KEY_REGULAR;
-    if (read(STDIN_FILENO, &seq[1], 1) != 1)
+    if ((seq[1] = read_key()) == -1)
         return KEY_REGULAR;
 
     // Check for arrow key pattern: ESC [ <letter>
@@ -37,17 +72,79 @@ KeyType parse_arrow_key(int first_key) {
             case 'B': return KEY_ARROW_DOWN;
             case 'C': return KEY_ARROW_RIGHT;
             case 'D': return KEY_ARROW_LEFT;
+            case '5': return read_key() == '~' ? KEY_PAGE_UP : KEY_REGULAR;
+            case '6': return read_key() == '~' ? KEY_PAGE_DOWN : KEY_REGULAR;
         }
     }
 
     return KEY_REGULAR;
 }
 
+/**
+ * Continue a NORMAL mode key sequence an earlier key started: a count (<n>G, <n>gg, <n>%),
+ * the first 'g' of gg or the Ctrl-W of a window command. Each key is its own event, so the
+ * event loop keeps running in between
+ * Returns true if the key belonged to the sequence; any other key ends it and is handled as usual
+ */
+static bool handle_pending_key(EditorState *editor, int c, KeyType key_type) {
+    if (editor->pending_key == KEY_CTRL_W) {
+        editor->pending_key = 0;
+        if (c == 's')
+            editor_split_view(editor, SPLIT_HORIZONTAL);
+        else if (c == 'v')
+            editor_split_view(editor, SPLIT_VERTICAL);
+        else if (c == 'w' || c == KEY_CTRL_W)
+            editor_focus_next_view(editor);
+        else if (c == 'c')
+            editor_close_view(editor);
+        else if (c == 'o')
+            editor_only_view(editor);
+        else
+            return false;
+        return true;
+    }
+
+    if (editor->pending_key == 'g') {
+        int count = editor->pending_count;
+        editor->pending_key = 0;
+        editor->pending_count = 0;
+        if (c != 'g')
+            return false;
+        editor_goto_line(editor, count > 0 ? count - 1 : 0);
+        return true;
+    }
+
+    if (editor->pending_count == 0)
+        return false;
+
+    if (key_type == KEY_REGULAR && c >= '0' && c <= '9') {
+        if (editor->pending_count < 100000000)
+            editor->pending_count = editor->pending_count * 10 + (c - '0');
+        return true;
+    }
+    if (c == 'g') {
+        editor->pending_key = 'g';
+        return true;
+    }
+
+    int count = editor->pending_count;
+    editor->pending_count = 0;
+    if (c == 'G')
+        editor_goto_line(editor, count - 1);
+    else if (c == '%')
+        editor_goto_percent(editor, count);
+    else
+        return false;
+    return true;
+}
+
 /**
  * Main input handler - processes keyboard input based on current mode
  * Returns false if user wants to quit, true to continue editing
  */
-bool handle_input(EditorState *editor) {
+bool handle_input(BufferList *buffers) {
+    EditorState *editor = buffer_list_current(buffers);
+
     // Read one key
     int c = read_key();
 
@@ -55,12 +152,19 @@ bool handle_input(EditorState *editor) {
     if (c == -1)
         return true;
 
+    // Any key press dismisses the previous status message
+    editor->message[0] = '\0';
+
     // Handle input based on current mode
     switch (editor->mode) {
         case MODE_NORMAL: {
             // Try to parse as arrow key
             KeyType key_type = parse_arrow_key(c);
 
+            // Second key of gg or of a window command, or a key after a count
+            if (handle_pending_key(editor, c, key_type))
+                break;
+
             // Movement keys (vim-style hjkl or arrow keys)
             if (key_type == KEY_ARROW_UP || c == 'k') {
                 editor_move_up(editor);
@@ -74,6 +178,30 @@ bool handle_input(EditorState *editor) {
             else if (key_type == KEY_ARROW_RIGHT || c == 'l') {
                 editor_move_right(editor);
             }
+            else if (c == '0') {
+                editor_move_line_start(editor);
+            }
+            else if (c == '$') {
+                editor_move_line_end(editor);
+            }
+            // Jumps: gg (first line), G (last line), <n>G / <n>gg (line n), <n>% (n percent in)
+            // 'g' and counts wait for the next key (handle_pending_key)
+            else if (c == 'g') {
+                editor->pending_key = 'g';
+            }
+            else if (c == 'G') {
+                editor_goto_line(editor, INT_MAX);  // Clamped to the last line of the whole file
+            }
+            else if (c >= '1' && c <= '9') {
+                editor->pending_count = c - '0';
+            }
+            // Paging: Page Up / Page Down, Ctrl-B / Ctrl-F
+            else if (key_type == KEY_PAGE_UP || c == KEY_CTRL_B) {
+                editor_page(editor, -1);
+            }
+            else if (key_type == KEY_PAGE_DOWN || c == KEY_CTRL_F) {
+                editor_page(editor, 1);
+            }
             // Mode switching keys
             else if (c == 'i') {
                 editor_enter_insert_mode(editor);
@@ -81,9 +209,56 @@ bool handle_input(EditorState *editor) {
             else if (c == 'd') {
                 editor_enter_delete_mode(editor);
             }
+            // Search keys
+            else if (c == '/') {
+                editor_enter_search_mode(editor, false);
+            }
+            else if (c == '?') {
+                editor_enter_search_mode(editor, true);
+            }
+            else if (c == 'n') {
+                editor_search_next(editor, false);
+            }
+            else if (c == 'N') {
+                editor_search_next(editor, true);
+            }
+            else if (c == 'C') {
+                editor_count_matches(editor);
+            }
+            // ESC stops a count running in the background
+            else if (key_type == KEY_REGULAR && c == KEY_ESCAPE) {
+                editor_count_cancel(editor);
+            }
+            // Command line (e.g. :s/old/new/)
+            else if (c == ':') {
+                editor_enter_command_mode(editor);
+            }
+            // Split views: Ctrl-W then s (stacked), v (side by side), w (next), c (close), o (only)
+            // The subcommand waits for the next key (handle_pending_key)
+            else if (c == KEY_CTRL_W) {
+                editor->pending_key = KEY_CTRL_W;
+            }
+            // Follow mode: keep appending what is written to the file
+            else if (c == 'F') {
+                editor_toggle_follow(editor);
+            }
+            // Buffer switching (tim2 a b c)
+            else if (c == 'b') {
+                buffer_list_switch(buffers, 1);
+            }
+            else if (c == 'B') {
+                buffer_list_switch(buffers, -1);
+            }
             // File operations
             else if (c == 's') {
-                editor_save(editor);
+                editor_save(editor, false);
+            }
+            // File changed on disk: save over it, or reload it
+            else if (c == 'S') {
+                editor_save(editor, true);
+            }
+            else if (c == 'R') {
+                editor_reload(editor);
             }
             else if (c == 'q') {
                 return false;  // Quit editor
@@ -92,7 +267,16 @@ bool handle_input(EditorState *editor) {
         }
 
         case MODE_INSERT: {
-            if (c == KEY_ESCAPE) {
+            // Arrow keys move inside the pending insert text
+            KeyType key_type = parse_arrow_key(c);
+
+            if (key_type == KEY_ARROW_LEFT) {
+                editor_insert_move_left(editor);
+            }
+            else if (key_type == KEY_ARROW_RIGHT) {
+                editor_insert_move_right(editor);
+            }
+            else if (key_type == KEY_REGULAR && c == KEY_ESCAPE) {
                 // Exit insert mode, flush buffer to rope
                 editor_enter_normal_mode(editor);
             }
@@ -109,17 +293,80 @@ bool handle_input(EditorState *editor) {
         }
 
         case MODE_DELETE: {
-            if (c == KEY_ESCAPE) {
-                // Exit delete mode
+            KeyType key_type = parse_arrow_key(c);
+
+            // Cursor leaving the pending range applies it to the rope first
+            if (key_type == KEY_ARROW_UP || c == 'k') {
+                editor_flush_delete_buffer(editor);
+                editor_move_up(editor);
+            }
+            else if (key_type == KEY_ARROW_DOWN || c == 'j') {
+                editor_flush_delete_buffer(editor);
+                editor_move_down(editor);
+            }
+            else if (key_type == KEY_ARROW_LEFT || c == 'h') {
+                editor_flush_delete_buffer(editor);
+                editor_move_left(editor);
+            }
+            else if (key_type == KEY_ARROW_RIGHT || c == 'l') {
+                editor_flush_delete_buffer(editor);
+                editor_move_right(editor);
+            }
+            else if (key_type == KEY_REGULAR && c == KEY_ESCAPE) {
+                // Exit delete mode, apply pending range to rope
                 editor_enter_normal_mode(editor);
             }
+            else if (c >= '0' && c <= '9') {
+                // Count prefix: "500" then backspace deletes 500 characters
+                editor_delete_count_digit(editor, c - '0');
+            }
             else if (c == KEY_BACKSPACE) {
-                // Delete from rope immediately
+                // Extend pending deletion range (rope untouched until flush)
                 editor_delete_char(editor);
             }
             // Ignore other keys in delete mode
             break;
         }
+
+        case MODE_SEARCH: {
+            KeyType key_type = parse_arrow_key(c);
+
+            if (key_type == KEY_REGULAR && c == KEY_ESCAPE) {
+                // Cancel search, cursor returns to where it was
+                editor_search_cancel(editor);
+            }
+            else if (c == KEY_ENTER) {
+                // Accept pattern (empty prompt repeats the last one)
+                editor_search_accept(editor);
+            }
+            else if (c == KEY_BACKSPACE) {
+                editor_search_delete_char(editor);
+            }
+            else if (c >= 32 || c == '\t') {
+                // Each character re-runs the search from the origin
+                editor_search_insert_char(editor, c);
+            }
+            // Ignore arrows and other control characters while typing a pattern
+            break;
+        }
+
+        case MODE_COMMAND: {
+            KeyType key_type = parse_arrow_key(c);
+
+            if (key_type == KEY_REGULAR && c == KEY_ESCAPE) {
+                editor_command_cancel(editor);
+            }
+            else if (c == KEY_ENTER) {
+                editor_command_execute(editor);
+            }
+            else if (c == KEY_BACKSPACE) {
+                editor_command_delete_char(editor);
+            }
+            else if (c >= 32 || c == '\t') {
+                editor_command_insert_char(editor, c);
+            }
+            break;
+        }
     }
 
     return true;  // Continue editing
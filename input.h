@@ -2,19 +2,31 @@
 #define INPUT_H
 
 #include "editor.h"
+#include "buffer.h"
 #include <stdbool.h>
 
 // Key code constants
 #define KEY_ESCAPE 27       // ESC key
 #define KEY_BACKSPACE 127   // Backspace key
 #define KEY_ENTER 10        // Enter/newline key
+#define KEY_CTRL_W 23       // Ctrl-W (prefix of window commands)
+#define KEY_CTRL_B 2        // Ctrl-B (page up)
+#define KEY_CTRL_F 6        // Ctrl-F (page down)
 
-// Arrow key types (detected from escape sequences)
+// Time to wait for the rest of an escape sequence before treating ESC as a key
+#define ESCAPE_TIMEOUT_MS 25
+
+// Bytes taken from stdin by one read()
+#define INPUT_BUFFER_SIZE 4096
+
+// Arrow and paging key types (detected from escape sequences)
 typedef enum {
     KEY_ARROW_UP,
     KEY_ARROW_DOWN,
     KEY_ARROW_LEFT,
     KEY_ARROW_RIGHT,
+    KEY_PAGE_UP,
+    KEY_PAGE_DOWN,
     KEY_REGULAR  // Not an arrow key
 } KeyType;
 
@@ -23,11 +35,17 @@ typedef enum {
 // Read a single key from stdin (blocking)
 int read_key(void);
 
-// Parse escape sequence to detect arrow keys
+// Check whether keys already read from stdin are waiting to be handled
+bool input_buffered(void);
+
+// Check whether a key is ready, waiting up to timeout_ms for one (0 = don't wait)
+bool input_pending(int timeout_ms);
+
+// Parse escape sequence to detect arrow and page keys
 KeyType parse_arrow_key(int first_key);
 
-// Handle keyboard input and update editor state
+// Handle keyboard input and update the current buffer (or switch buffers)
 // Returns false if user wants to quit, true otherwise
-bool handle_input(EditorState *editor);
+bool handle_input(BufferList *buffers);
 
 #endif
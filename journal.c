@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "event.h"
+
+// First bytes of a journal file (the digit is the format version)
+#define JOURNAL_MAGIC "TIM2JRN1"
+#define JOURNAL_MAGIC_LEN 8
+
+// Record types
+#define RECORD_INSERT 'I'    // pos, len, text
+#define RECORD_DELETE 'D'    // pos, len
+#define RECORD_REPLACE 'R'   // count, replacement length, replacement, count (start, end) pairs
+#define RECORD_APPEND 'A'    // file offset, len (the bytes are read back from the file)
+
+// Read position in a journal loaded into memory
+typedef struct {
+    char *data;
+    int len;
+    int pos;
+} JournalReader;
+
+/**
+ * FNV-1a hash of a record, stored after it to detect a torn write
+ */
+static uint32_t journal_checksum(char *data, int len) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Append raw bytes to the pending records
+ */
+static void journal_put(Journal *journal, void *data, int len) {
+    if (journal->pending_len + len > journal->pending_cap) {
+        while (journal->pending_len + len > journal->pending_cap)
+            journal->pending_cap = journal->pending_cap ? journal->pending_cap * 2 : JOURNAL_BUFFER_SIZE;
+        journal->pending = realloc(journal->pending, journal->pending_cap);
+        if (!journal->pending) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(journal->pending + journal->pending_len, data, len);
+    journal->pending_len += len;
+}
+
+/**
+ * Append a 32-bit integer to the pending records
+ */
+static void journal_put_int(Journal *journal, int32_t value) {
+    journal_put(journal, &value, sizeof(value));
+}
+
+/**
+ * Start a record; returns where it begins in the pending buffer
+ */
+static int journal_record_begin(Journal *journal, char type) {
+    int start = journal->pending_len;
+    journal_put(journal, &type, 1);
+    return start;
+}
+
+/**
+ * Finish a record with its checksum
+ * A batch that has grown past JOURNAL_BUFFER_SIZE is written at once
+ */
+static void journal_record_end(Journal *journal, int start) {
+    uint32_t sum = journal_checksum(journal->pending + start, journal->pending_len - start);
+    journal_put(journal, &sum, sizeof(sum));
+    if (journal->pending_len >= JOURNAL_BUFFER_SIZE)
+        journal_write(journal);
+}
+
+/**
+ * Copy the next n bytes of the journal (false if it ends first)
+ */
+static bool journal_take(JournalReader *reader, void *out, int n) {
+    if (n < 0 || reader->len - reader->pos < n)
+        return false;
+    memcpy(out, reader->data + reader->pos, n);
+    reader->pos += n;
+    return true;
+}
+
+/**
+ * Initialize an inactive journal
+ * The journal of "dir/name" is "dir/.name.tim2.swp" (a buffer without a file has none)
+ */
+void journal_init(Journal *journal, char *filename) {
+    memset(journal, 0, sizeof(Journal));
+    journal->fd = -1;
+    if (!filename) {
+        journal->failed = true;
+        return;
+    }
+
+    journal->path = file_sidecar_path(filename, "swp");
+}
+
+/**
+ * Free journal memory; an open journal file is closed but kept
+ */
+void journal_free(Journal *journal) {
+    if (journal->fd != -1)
+        close(journal->fd);
+    free(journal->path);
+    free(journal->pending);
+}
+
+/**
+ * Create the journal file, starting with a header that stamps the file the edits apply to
+ */
+bool journal_begin(Journal *journal, FileStamp *base, int base_len) {
+    if (!journal->path)
+        return false;
+    journal->fd = open(journal->path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (journal->fd == -1) {
+        journal->failed = true;
+        return false;
+    }
+
+    journal->pending_len = 0;
+    journal->unsynced = false;
+    journal->last_sync = event_now_ms();
+
+    int64_t header[5] = { (int64_t)base->dev, (int64_t)base->ino, (int64_t)base->size,
+                          base->mtime_sec, base->mtime_nsec };
+    journal_put(journal, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN);
+    journal_put(journal, header, sizeof(header));
+    journal_put_int(journal, base_len);
+    journal_record_end(journal, 0);
+    return true;
+}
+
+/**
+ * Check whether edits are being journaled
+ */
+bool journal_active(Journal *journal) {
+    return journal->fd != -1;
+}
+
+/**
+ * Check whether a journal file is there (left by a session that did not exit)
+ */
+bool journal_exists(Journal *journal) {
+    return journal->path && !journal_active(journal) && access(journal->path, F_OK) == 0;
+}
+
+/**
+ * Delete the journal: the file now holds its edits (save), or they were given up (reload, quit)
+ */
+void journal_discard(Journal *journal) {
+    if (journal->fd != -1) {
+        close(journal->fd);
+        unlink(journal->path);
+    }
+    journal->fd = -1;
+    journal->failed = journal->path == NULL;
+    journal->pending_len = 0;
+    journal->unsynced = false;
+}
+
+/**
+ * Record an insertion (the inserted text is stored in the record)
+ */
+void journal_insert(Journal *journal, int pos, char *text, int len) {
+    int start = journal_record_begin(journal, RECORD_INSERT);
+    journal_put_int(journal, pos);
+    journal_put_int(journal, len);
+    journal_put(journal, text, len);
+    journal_record_end(journal, start);
+}
+
+/**
+ * Record a deletion
+ */
+void journal_delete(Journal *journal, int pos, int len) {
+    int start = journal_record_begin(journal, RECORD_DELETE);
+    journal_put_int(journal, pos);
+    journal_put_int(journal, len);
+    journal_record_end(journal, start);
+}
+
+/**
+ * Record a replace-all as one record holding every range
+ */
+void journal_replace(Journal *journal, int *starts, int *ends, int count, char *replacement) {
+    int rep_len = strlen(replacement);
+    int start = journal_record_begin(journal, RECORD_REPLACE);
+    journal_put_int(journal, count);
+    journal_put_int(journal, rep_len);
+    journal_put(journal, replacement, rep_len);
+    for (int i = 0; i < count; i++) {
+        journal_put_int(journal, starts[i]);
+        journal_put_int(journal, ends[i]);
+    }
+    journal_record_end(journal, start);
+}
+
+/**
+ * Record file growth appended in follow mode
+ * Only the file range is stored; recovery reads the bytes back from the file
+ */
+void journal_append(Journal *journal, long offset, int len) {
+    int64_t file_offset = offset;
+    int start = journal_record_begin(journal, RECORD_APPEND);
+    journal_put(journal, &file_offset, sizeof(file_offset));
+    journal_put_int(journal, len);
+    journal_record_end(journal, start);
+}
+
+/**
+ * Write all pending records at once (group commit)
+ * If the journal cannot be written it is given up: a partial record would only be dropped on replay
+ */
+void journal_write(Journal *journal) {
+    if (journal->fd == -1 || journal->pending_len == 0)
+        return;
+
+    int done = 0;
+    while (done < journal->pending_len) {
+        ssize_t n = write(journal->fd, journal->pending + done, journal->pending_len - done);
+        if (n <= 0) {
+            close(journal->fd);
+            journal->fd = -1;
+            journal->failed = true;
+            break;
+        }
+        done += n;
+    }
+
+    journal->pending_len = 0;
+    journal->unsynced = journal->fd != -1;
+}
+
+/**
+ * Time until written records should be synced: JOURNAL_SYNC_MS after the previous sync
+ */
+int journal_sync_timeout(Journal *journal) {
+    if (journal->fd == -1 || !journal->unsynced)
+        return -1;
+    double wait = journal->last_sync + JOURNAL_SYNC_MS - event_now_ms();
+    return wait > 0 ? (int)wait : 0;
+}
+
+/**
+ * Make written records durable
+ */
+void journal_sync(Journal *journal) {
+    if (journal->fd == -1 || !journal->unsynced)
+        return;
+    fdatasync(journal->fd);
+    journal->unsynced = false;
+    journal->last_sync = event_now_ms();
+}
+
+/**
+ * Check the next record's structure and checksum without applying it
+ * On success the reader is left after the record
+ */
+static bool journal_check_record(JournalReader *reader) {
+    int start = reader->pos;
+    char type;
+    int32_t a, b;
+    int64_t offset;
+    if (!journal_take(reader, &type, 1))
+        return false;
+
+    int skip = 0;
+    if (type == RECORD_INSERT) {
+        if (!journal_take(reader, &a, 4) || !journal_take(reader, &b, 4))
+            return false;
+        skip = b;
+    } else if (type == RECORD_DELETE) {
+        if (!journal_take(reader, &a, 4) || !journal_take(reader, &b, 4))
+            return false;
+    } else if (type == RECORD_REPLACE) {
+        if (!journal_take(reader, &a, 4) || !journal_take(reader, &b, 4) || a < 0 || b < 0 ||
+            b > reader->len - reader->pos || a > (reader->len - reader->pos - b) / 8)
+            return false;
+        skip = b + a * 8;
+    } else if (type == RECORD_APPEND) {
+        if (!journal_take(reader, &offset, 8) || !journal_take(reader, &b, 4))
+            return false;
+    } else {
+        return false;
+    }
+
+    if (skip < 0 || reader->len - reader->pos < skip)
+        return false;
+    reader->pos += skip;
+
+    uint32_t sum;
+    return journal_take(reader, &sum, 4) && sum == journal_checksum(reader->data + start, reader->pos - 4 - start);
+}
+
+/**
+ * Apply a checked record to the rope
+ * Returns false if it doesn't fit the text (the reader is then somewhere inside the record)
+ */
+static bool journal_replay_record(JournalReader *reader, RopeNode **root, int file_fd) {
+    char type;
+    int32_t a, b;
+    int64_t offset;
+    int len = *root ? (*root)->total_len : 0;
+    if (!journal_take(reader, &type, 1))
+        return false;
+
+    if (type == RECORD_INSERT) {
+        if (!journal_take(reader, &a, 4) || !journal_take(reader, &b, 4))
+            return false;
+        if (a < 0 || a > len)
+            return false;
+        char *text = substr(reader->data + reader->pos, b);
+        *root = insert_at(*root, a, text);
+        free(text);
+        reader->pos += b;
+    } else if (type == RECORD_DELETE) {
+        if (!journal_take(reader, &a, 4) || !journal_take(reader, &b, 4))
+            return false;
+        if (a < 0 || b < 0 || a > len || b > len - a)
+            return false;
+        *root = delete_at(*root, a, b);
+    } else if (type == RECORD_REPLACE) {
+        if (!journal_take(reader, &a, 4) || !journal_take(reader, &b, 4))
+            return false;
+        char *replacement = substr(reader->data + reader->pos, b);
+        reader->pos += b;
+
+        int *starts = malloc((a + 1) * sizeof(int));
+        int *ends = malloc((a + 1) * sizeof(int));
+        if (!starts || !ends) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        bool ok = true;
+        for (int i = 0; ok && i < a; i++) {
+            if (!journal_take(reader, &starts[i], 4) || !journal_take(reader, &ends[i], 4))
+                ok = false;
+            else if (starts[i] < (i ? ends[i - 1] : 0) || ends[i] < starts[i] || ends[i] > len)
+                ok = false;
+        }
+        if (ok)
+            *root = rope_replace_ranges(*root, starts, ends, a, replacement);
+        free(replacement);
+        free(starts);
+        free(ends);
+        if (!ok)
+            return false;
+    } else {
+        if (!journal_take(reader, &offset, 8) || !journal_take(reader, &b, 4))
+            return false;
+        char *text = malloc(b > 0 ? b : 1);
+        if (!text) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        bool ok = file_fd != -1 && b >= 0 && pread(file_fd, text, b, offset) == b;
+        if (ok)
+            *root = rope_append(*root, text, b);
+        free(text);
+        if (!ok)
+            return false;
+    }
+
+    reader->pos += 4;  // checksum
+    return true;
+}
+
+/**
+ * Apply a checked record, or leave the reader at its start if it doesn't fit the text
+ * (the journal is then cut off before it)
+ */
+static bool journal_apply_record(JournalReader *reader, RopeNode **root, int file_fd) {
+    int start = reader->pos;
+    if (!journal_replay_record(reader, root, file_fd)) {
+        reader->pos = start;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Load the whole journal file
+ */
+static char *journal_read(int fd, int *len) {
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return NULL;
+
+    char *data = malloc(st.st_size + 1);
+    if (!data) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    long got = 0;
+    while (got < st.st_size) {
+        ssize_t n = pread(fd, data + got, st.st_size - got, got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    *len = got;
+    return data;
+}
+
+/**
+ * Replay a journal left behind by a session that did not exit
+ * The header must stamp the file as it is now; a file that only grew (a followed log) is also
+ * accepted, and growth past what was journaled is cut off so positions line up. Records are
+ * checked first: the replay stops before a torn or inconsistent record, which is cut off the
+ * journal so that new records follow the last good one.
+ */
+int journal_recover(Journal *journal, char *filename, FileStamp *disk, RopeNode **root) {
+    if (!journal->path)
+        return 0;
+    int fd = open(journal->path, O_RDWR);
+    if (fd == -1)
+        return 0;
+
+    int len;
+    char *data = journal_read(fd, &len);
+    JournalReader reader = { data, len, 0 };
+
+    // Header: magic, stamp of the file the edits apply to, rope length at the first edit
+    char magic[JOURNAL_MAGIC_LEN];
+    int64_t header[5];
+    int32_t base_len;
+    uint32_t sum;
+    bool valid = data && journal_take(&reader, magic, JOURNAL_MAGIC_LEN) &&
+                 memcmp(magic, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) == 0 &&
+                 journal_take(&reader, header, sizeof(header)) &&
+                 journal_take(&reader, &base_len, 4) &&
+                 journal_take(&reader, &sum, 4) && sum == journal_checksum(data, reader.pos - 4);
+
+    int rope_len = *root ? (*root)->total_len : 0;
+    if (valid) {
+        bool same_file = header[0] == (int64_t)disk->dev && header[1] == (int64_t)disk->ino;
+        bool unchanged = header[2] == (int64_t)disk->size && header[3] == disk->mtime_sec &&
+                         header[4] == disk->mtime_nsec;
+        bool grown = (int64_t)disk->size > header[2];
+        valid = same_file && (unchanged || grown) && base_len >= 0 && base_len <= rope_len;
+    }
+
+    if (!valid) {
+        close(fd);
+        free(data);
+        char *old = malloc(strlen(journal->path) + 5);
+        if (!old) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        sprintf(old, "%s.old", journal->path);
+        rename(journal->path, old);
+        free(old);
+        return -1;
+    }
+
+    // Count the records that arrived whole
+    int records_start = reader.pos;
+    int checked = 0;
+    while (journal_check_record(&reader))
+        checked++;
+
+    if (checked == 0) {
+        close(fd);
+        unlink(journal->path);
+        free(data);
+        return 0;
+    }
+
+    // Replay onto the text the edits were made to
+    if (rope_len > base_len)
+        *root = delete_at(*root, base_len, rope_len - base_len);
+
+    int file_fd = open(filename, O_RDONLY);
+    reader.pos = records_start;
+    int replayed = 0;
+    while (replayed < checked && journal_apply_record(&reader, root, file_fd))
+        replayed++;
+    if (file_fd != -1)
+        close(file_fd);
+
+    // Keep journaling after the last record replayed
+    if (ftruncate(fd, reader.pos) == -1 || lseek(fd, reader.pos, SEEK_SET) == -1) {
+        close(fd);
+        fd = -1;
+        journal->failed = true;
+    }
+    journal->fd = fd;
+    journal->pending_len = 0;
+    journal->unsynced = false;
+    journal->last_sync = event_now_ms();
+
+    free(data);
+    return replayed;
+}
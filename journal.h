@@ -0,0 +1,83 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include "rope.h"
+#include "follow.h"
+
+// Records are collected in memory and written with one write() per batch
+#define JOURNAL_BUFFER_SIZE (64 * 1024)
+
+// Written records are synced to disk at most this often (group commit)
+#define JOURNAL_SYNC_MS 1000
+
+// Write-ahead journal of the edits made to a buffer since its file was loaded or saved
+// Kept in ".<name>.tim2.swp" beside the file: a header stamping the file the edits apply to,
+// then one record per rope edit, each with a checksum so a torn last write is dropped on replay.
+// Records are batched in memory, written once per key press and fdatasync'ed once per
+// JOURNAL_SYNC_MS, so no keystroke waits for the disk.
+typedef struct {
+    char *path;           // Journal file name
+    int fd;               // Open journal (-1 = no edits journaled since the last save)
+    bool failed;          // Journal could not be created (not retried until the next save)
+    char *pending;        // Records not yet written
+    int pending_len;
+    int pending_cap;
+    bool unsynced;        // Records written but not yet fdatasync'ed
+    double last_sync;     // Time of the last sync (ms, monotonic clock)
+} Journal;
+
+// ========== Lifecycle ==========
+
+// Initialize an inactive journal for filename (NULL: a buffer without a file, never journaled)
+void journal_init(Journal *journal, char *filename);
+
+// Free the journal's memory (the journal file is left as it is)
+void journal_free(Journal *journal);
+
+// Start journaling edits to a rope of base_len bytes read from the file stamped 'base'
+// Returns false if the journal file cannot be created
+bool journal_begin(Journal *journal, FileStamp *base, int base_len);
+
+// Check whether edits are being journaled
+bool journal_active(Journal *journal);
+
+// Check whether a journal left by an earlier session is waiting to be recovered
+bool journal_exists(Journal *journal);
+
+// Close and delete the journal (its edits are now in the file, or were dropped)
+void journal_discard(Journal *journal);
+
+// ========== Records ==========
+
+// Record insert_at(root, pos, text[0..len))
+void journal_insert(Journal *journal, int pos, char *text, int len);
+
+// Record delete_at(root, pos, len)
+void journal_delete(Journal *journal, int pos, int len);
+
+// Record rope_replace_ranges(root, starts, ends, count, replacement)
+void journal_replace(Journal *journal, int *starts, int *ends, int count, char *replacement);
+
+// Record that file bytes [offset, offset + len) were appended to the rope (follow mode)
+void journal_append(Journal *journal, long offset, int len);
+
+// ========== Group commit ==========
+
+// Write every pending record with a single write()
+void journal_write(Journal *journal);
+
+// Milliseconds until written records are due to be synced (-1 = nothing to sync)
+int journal_sync_timeout(Journal *journal);
+
+// fdatasync written records
+void journal_sync(Journal *journal);
+
+// ========== Recovery ==========
+
+// Replay the journal left by a session that did not exit onto *root (the file as loaded, stamped
+// 'disk') and keep journaling after it. Returns the number of records replayed, 0 if there is no
+// journal, -1 if it belongs to another version of the file (it is then renamed to "<path>.old")
+int journal_recover(Journal *journal, char *filename, FileStamp *disk, RopeNode **root);
+
+#endif
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lineindex.h"
+
+// First bytes of a sidecar (the digit is the format version)
+#define SIDECAR_MAGIC "TIM2LIX1"
+#define SIDECAR_MAGIC_LEN 8
+
+// Blocks of the file hashed to validate a sidecar
+#define SIDECAR_SAMPLES 64
+#define SIDECAR_SAMPLE_SIZE 4096
+
+// Larger files are not sidecars (a 2 GB file of short lines needs well under this)
+#define SIDECAR_MAX_SIZE (64 << 20)
+
+// Leaves walked from a checkpoint before the rope's newline counts take over
+// (64 short lines fit in a few leaves; only very long lines between checkpoints get this far)
+#define WALK_MAX_LEAVES 256
+
+
+// Initializes an empty index (built lazily on first query)
+void line_index_init(LineIndex *index) {
+	index->lines = NULL;
+	index->offsets = NULL;
+	index->count = 0;
+	index->capacity = 0;
+	index->valid = false;
+}
+
+
+// Frees the checkpoint arrays
+void line_index_free(LineIndex *index) {
+	free(index->lines);
+	free(index->offsets);
+	line_index_init(index);
+}
+
+
+// Marks the index as stale so that the next query rebuilds it
+void line_index_invalidate(LineIndex *index) {
+	index->valid = false;
+}
+
+
+// Appends a checkpoint, growing the arrays by doubling
+static void line_index_push(LineIndex *index, int line, int offset) {
+	if (index->count == index->capacity) {
+		int new_capacity = index->capacity ? index->capacity * 2 : 64;
+
+		int *lines = realloc(index->lines, new_capacity * sizeof(int));
+		int *offsets = realloc(index->offsets, new_capacity * sizeof(int));
+		// If realloc fails
+		if (lines == NULL || offsets == NULL) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+
+		index->lines = lines;
+		index->offsets = offsets;
+		index->capacity = new_capacity;
+	}
+
+	index->lines[index->count] = line;
+	index->offsets[index->count] = offset;
+	index->count++;
+}
+
+
+// Builds checkpoints for every LINE_INDEX_STRIDE-th line in one pass over the leaves
+// Cold leaves are passed by their newline count without being decompressed: lines inside
+// one are found from the checkpoint before it
+void line_index_build(LineIndex *index, RopeNode *root) {
+	index->count = 0;
+	line_index_push(index, 0, 0);  // line 0 always starts at 0
+
+	int line = 0;
+	RopeIter it;
+	for (rope_iter_init(&it, root, 0); it.leaf != NULL; rope_iter_next(&it)) {
+		if (it.leaf->cold) {
+			line += it.leaf->newlines;
+			continue;
+		}
+
+		char *str = it.leaf->str;
+		int len = it.leaf->total_len;
+
+		// Jump from newline to newline with memchr
+		char *p = str;
+		while ((p = memchr(p, '\n', len - (p - str))) != NULL) {
+			line++;
+			p++;
+			if (line >= index->lines[index->count - 1] + LINE_INDEX_STRIDE)
+				line_index_push(index, line, it.leaf_start + (int)(p - str));
+		}
+	}
+
+	index->valid = true;
+}
+
+
+// Returns the last checkpoint whose line is <= line (binary search)
+static int line_index_find_line(LineIndex *index, int line) {
+	int lo = 0, hi = index->count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (index->lines[mid] <= line)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+
+// Returns the last checkpoint whose offset is <= pos (binary search)
+static int line_index_find_offset(LineIndex *index, int pos) {
+	int lo = 0, hi = index->count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (index->offsets[mid] <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+
+// Makes sure the index describes the current rope
+static void line_index_ensure(LineIndex *index, RopeNode *root) {
+	if (!index->valid)
+		line_index_build(index, root);
+}
+
+
+// Updates checkpoints after inserting len characters (with 'newlines' '\n's) at pos
+// Checkpoints at or before pos are unaffected, later ones shift by (len, newlines)
+void line_index_insert(LineIndex *index, int pos, int len, int newlines) {
+	if (!index->valid || len <= 0)
+		return;
+
+	// Many new lines would leave a large unindexed gap: rebuild lazily instead
+	if (newlines > LINE_INDEX_STRIDE) {
+		line_index_invalidate(index);
+		return;
+	}
+
+	for (int i = line_index_find_offset(index, pos) + 1; i < index->count; i++) {
+		index->offsets[i] += len;
+		index->lines[i] += newlines;
+	}
+}
+
+
+// Adds checkpoints for text[0..len) appended at the end of the rope at pos
+// 'line' is the line pos falls on (newlines before pos); only the new text is scanned,
+// so a large append costs O(len) instead of the rebuild line_index_insert() would trigger.
+// Text before the last checkpoint is already indexed (an index read from a sidecar covers
+// the whole file while it is still loading)
+void line_index_append(LineIndex *index, int pos, char *text, int len, int line) {
+	if (!index->valid || len <= 0 || index->offsets[index->count - 1] >= pos + len)
+		return;
+
+	char *p = text;
+	while ((p = memchr(p, '\n', len - (p - text))) != NULL) {
+		line++;
+		p++;
+		if (line >= index->lines[index->count - 1] + LINE_INDEX_STRIDE)
+			line_index_push(index, line, pos + (int)(p - text));
+	}
+}
+
+
+// Updates checkpoints after deleting len characters (with 'newlines' '\n's) at start
+// Checkpoints inside the deleted range are dropped, later ones shift back
+void line_index_delete(LineIndex *index, int start, int len, int newlines) {
+	if (!index->valid || len <= 0)
+		return;
+
+	int end = start + len;
+	int out = 0;
+
+	for (int i = 0; i < index->count; i++) {
+		int offset = index->offsets[i];
+
+		// Line start removed (or merged into the line containing start)
+		if (offset > start && offset <= end)
+			continue;
+
+		if (offset > end) {
+			index->offsets[out] = offset - len;
+			index->lines[out] = index->lines[i] - newlines;
+		}
+		else {
+			index->offsets[out] = offset;
+			index->lines[out] = index->lines[i];
+		}
+		out++;
+	}
+
+	index->count = out;
+}
+
+
+// Returns the position just after the nth '\n' at or after pos (rope length if fewer exist)
+// Single leaf walk: one descent followed by memchr over consecutive leaves; a whole leaf
+// with fewer newlines than are left is passed by its count (a cold one stays compressed).
+// A walk still going after WALK_MAX_LEAVES leaves (a multi-megabyte line) descends by
+// newline counts instead
+static int skip_newlines(RopeNode *root, int pos, int n) {
+	if (n <= 0)
+		return pos;
+
+	RopeIter it;
+	int walked = 0;
+	for (rope_iter_init(&it, root, pos); it.leaf != NULL; rope_iter_next(&it)) {
+		if (++walked > WALK_MAX_LEAVES && it.leaf_start >= pos) {
+			int newline = get_line_from_pos(root, it.leaf_start) + n - 1;
+			return newline < root->newlines ? find_newline_pos(root, newline, 0) + 1 : root->total_len;
+		}
+
+		if (it.leaf_start >= pos && it.leaf->newlines < n) {
+			n -= it.leaf->newlines;
+			continue;
+		}
+
+		char *str = rope_leaf_text(it.leaf);
+		int len = it.leaf->total_len;
+		char *p = str + (pos > it.leaf_start ? pos - it.leaf_start : 0);
+
+		while (p < str + len && (p = memchr(p, '\n', len - (p - str))) != NULL) {
+			p++;
+			if (--n == 0)
+				return it.leaf_start + (int)(p - str);
+		}
+	}
+
+	return root->total_len;
+}
+
+
+// Returns the number of '\n's in [from, to) with a single leaf walk
+// Leaves wholly inside the range count by their newline count; past WALK_MAX_LEAVES
+// the rest of the range is counted by descending the tree
+static int count_newlines_between(RopeNode *root, int from, int to) {
+	int count = 0;
+
+	RopeIter it;
+	int walked = 0;
+	for (rope_iter_init(&it, root, from); it.leaf != NULL && it.leaf_start < to; rope_iter_next(&it)) {
+		if (++walked > WALK_MAX_LEAVES && it.leaf_start >= from)
+			return count + get_line_from_pos(root, to) - get_line_from_pos(root, it.leaf_start);
+
+		if (it.leaf_start >= from && it.leaf_start + it.leaf->total_len <= to) {
+			count += it.leaf->newlines;
+			continue;
+		}
+
+		char *str = rope_leaf_text(it.leaf);
+		char *p = str + (from > it.leaf_start ? from - it.leaf_start : 0);
+		char *end = str + (to - it.leaf_start < it.leaf->total_len ? to - it.leaf_start : it.leaf->total_len);
+
+		while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+			count++;
+			p++;
+		}
+	}
+
+	return count;
+}
+
+
+// Returns the starting position of a line
+// Binary search for the nearest checkpoint, then a memchr scan of the lines after it
+int line_index_line_start(LineIndex *index, RopeNode *root, int line) {
+	if (root == NULL || line <= 0)
+		return 0;
+
+	// Line doesn't exist: return end
+	if (line > root->newlines)
+		return root->total_len;
+
+	line_index_ensure(index, root);
+
+	int cp = line_index_find_line(index, line);
+	return skip_newlines(root, index->offsets[cp], line - index->lines[cp]);
+}
+
+
+// Returns the line containing pos
+// Binary search for the nearest checkpoint, then count newlines up to pos
+int line_index_line_from_pos(LineIndex *index, RopeNode *root, int pos) {
+	if (root == NULL || pos <= 0)
+		return 0;
+	if (pos > root->total_len)
+		pos = root->total_len;
+
+	line_index_ensure(index, root);
+
+	int cp = line_index_find_offset(index, pos);
+	return index->lines[cp] + count_newlines_between(root, index->offsets[cp], pos);
+}
+
+
+// ========== Sidecar ==========
+
+// Builds the sidecar name of "dir/name": "dir/.name.tim2.lines" (malloc'd)
+char *line_index_sidecar_path(char *filename) {
+	return file_sidecar_path(filename, "lines");
+}
+
+
+// Folds bytes into an FNV-1a hash
+static uint32_t sidecar_hash(uint32_t h, const void *data, size_t len) {
+	const unsigned char *p = data;
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+
+// Hashes SIDECAR_SAMPLES blocks spread evenly over the file (first and last included)
+// Catches a rewrite that kept the size and modification time without reading the whole file
+static bool sidecar_sample_hash(char *filename, long size, uint32_t *hash) {
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	char block[SIDECAR_SAMPLE_SIZE];
+	long span = size > SIDECAR_SAMPLE_SIZE ? size - SIDECAR_SAMPLE_SIZE : 0;
+	uint32_t h = 2166136261u;
+	for (int i = 0; i < SIDECAR_SAMPLES; i++) {
+		ssize_t n = pread(fd, block, sizeof(block), span * i / (SIDECAR_SAMPLES - 1));
+		if (n < 0) {
+			close(fd);
+			return false;
+		}
+		h = sidecar_hash(h, block, n);
+	}
+
+	close(fd);
+	*hash = h;
+	return true;
+}
+
+
+// Appends value as an LEB128 varint (7 bits per byte, high bit = more follow)
+static int sidecar_put_varint(unsigned char *out, uint32_t value) {
+	int n = 0;
+	while (value >= 0x80) {
+		out[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (unsigned char)value;
+	return n;
+}
+
+
+// Reads a varint at *pos (false if the data ends first or it is too long)
+static bool sidecar_get_varint(unsigned char *data, int len, int *pos, uint32_t *value) {
+	*value = 0;
+	for (int shift = 0; shift < 35 && *pos < len; shift += 7) {
+		unsigned char b = data[(*pos)++];
+		*value |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+
+// Writes the index of root (the whole file, stamped 'stamp') to path
+// Layout: magic, file stamp, sample hash, text length, checkpoint count, then each checkpoint
+// as the varint distances (lines, bytes) from the one before, and a checksum of all of it.
+// Written to a temporary name and renamed, so a reader never sees half a sidecar
+bool line_index_save(LineIndex *index, RopeNode *root, char *path, char *filename, FileStamp *stamp) {
+	FileStamp now;
+	uint32_t hash;
+	if (!file_stamp_read(&now, filename) || !file_stamp_equal(&now, stamp) ||
+	    !sidecar_sample_hash(filename, (long)stamp->size, &hash))
+		return false;
+	line_index_ensure(index, root);
+
+	int header_len = SIDECAR_MAGIC_LEN + 5 * 8 + 3 * 4;
+	unsigned char *data = malloc(header_len + (size_t)index->count * 10 + 4);
+	if (data == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	int64_t file[5] = { (int64_t)stamp->dev, (int64_t)stamp->ino, (int64_t)stamp->size,
+	                    stamp->mtime_sec, stamp->mtime_nsec };
+	int32_t counts[2] = { root ? root->total_len : 0, index->count };
+	int len = 0;
+	memcpy(data, SIDECAR_MAGIC, SIDECAR_MAGIC_LEN);
+	len += SIDECAR_MAGIC_LEN;
+	memcpy(data + len, file, sizeof(file));
+	len += sizeof(file);
+	memcpy(data + len, &hash, 4);
+	len += 4;
+	memcpy(data + len, counts, sizeof(counts));
+	len += sizeof(counts);
+	for (int i = 1; i < index->count; i++) {
+		len += sidecar_put_varint(data + len, index->lines[i] - index->lines[i - 1]);
+		len += sidecar_put_varint(data + len, index->offsets[i] - index->offsets[i - 1]);
+	}
+	uint32_t sum = sidecar_hash(2166136261u, data, len);
+	memcpy(data + len, &sum, 4);
+	len += 4;
+
+	char *temp = malloc(strlen(path) + 5);
+	if (temp == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(temp, "%s.tmp", path);
+	int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	bool ok = fd != -1 && write(fd, data, len) == len;
+	if (fd != -1)
+		ok = close(fd) == 0 && ok;
+	ok = ok && rename(temp, path) == 0;
+	if (!ok)
+		unlink(temp);
+
+	free(temp);
+	free(data);
+	return ok;
+}
+
+
+// Replaces the index by the one saved in path if that describes filename as stamped now
+// Anything that does not match (stamp, sample hash, checksum, checkpoint order) leaves the
+// index as it was and returns false
+bool line_index_load(LineIndex *index, char *path, char *filename, FileStamp *stamp) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size > SIDECAR_MAX_SIZE) {
+		close(fd);
+		return false;
+	}
+
+	int len = (int)st.st_size;
+	unsigned char *data = malloc(len > 0 ? len : 1);
+	if (data == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	bool valid = read(fd, data, len) == len;
+	close(fd);
+
+	// Header and checksum
+	int header_len = SIDECAR_MAGIC_LEN + 5 * 8 + 3 * 4;
+	int64_t file[5];
+	uint32_t hash, sum, sample;
+	int32_t counts[2];
+	valid = valid && len >= header_len + 4 && memcmp(data, SIDECAR_MAGIC, SIDECAR_MAGIC_LEN) == 0;
+	if (valid) {
+		memcpy(file, data + SIDECAR_MAGIC_LEN, sizeof(file));
+		memcpy(&hash, data + SIDECAR_MAGIC_LEN + sizeof(file), 4);
+		memcpy(counts, data + SIDECAR_MAGIC_LEN + sizeof(file) + 4, sizeof(counts));
+		memcpy(&sum, data + len - 4, 4);
+		valid = sum == sidecar_hash(2166136261u, data, len - 4) &&
+		        file[0] == (int64_t)stamp->dev && file[1] == (int64_t)stamp->ino &&
+		        file[2] == (int64_t)stamp->size && file[3] == stamp->mtime_sec &&
+		        file[4] == stamp->mtime_nsec && counts[0] == (int64_t)stamp->size && counts[1] >= 1 &&
+		        counts[1] <= (len - header_len - 4) / 2 + 1 &&  // At least 2 varint bytes per checkpoint
+		        sidecar_sample_hash(filename, (long)stamp->size, &sample) && sample == hash;
+	}
+
+	// Checkpoints: strictly increasing, inside the file
+	int *lines = NULL;
+	int *offsets = NULL;
+	if (valid) {
+		lines = malloc(counts[1] * sizeof(int));
+		offsets = malloc(counts[1] * sizeof(int));
+		if (lines == NULL || offsets == NULL) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		lines[0] = offsets[0] = 0;
+		int pos = header_len;
+		for (int i = 1; valid && i < counts[1]; i++) {
+			uint32_t line, offset;
+			valid = sidecar_get_varint(data, len - 4, &pos, &line) &&
+			        sidecar_get_varint(data, len - 4, &pos, &offset) &&
+			        line > 0 && offset > 0 && offset <= (uint32_t)(counts[0] - offsets[i - 1]) &&
+			        line <= (uint32_t)offset;
+			if (valid) {
+				lines[i] = lines[i - 1] + (int)line;
+				offsets[i] = offsets[i - 1] + (int)offset;
+			}
+		}
+		valid = valid && pos == len - 4;
+	}
+	free(data);
+
+	if (!valid) {
+		free(lines);
+		free(offsets);
+		return false;
+	}
+
+	free(index->lines);
+	free(index->offsets);
+	index->lines = lines;
+	index->offsets = offsets;
+	index->count = index->capacity = counts[1];
+	index->valid = true;
+	return true;
+}
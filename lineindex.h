@@ -0,0 +1,70 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include "rope.h"
+#include "follow.h"
+#include <stdbool.h>
+
+// A checkpoint is kept for every LINE_INDEX_STRIDE-th line when the index is built
+#define LINE_INDEX_STRIDE 64
+
+// Sparse index of line starts, kept beside the rope
+// Checkpoints are sorted (line, offset) pairs where offset is the start of that line.
+// Edits shift the checkpoints after the edit point instead of rebuilding the index.
+typedef struct {
+    int *lines;      // Line number of each checkpoint (ascending, lines[0] = 0)
+    int *offsets;    // Rope index where that line starts
+    int count;       // Number of checkpoints
+    int capacity;    // Allocated checkpoint slots
+    bool valid;      // False until built (or after an edit too large to patch)
+} LineIndex;
+
+// ========== Lifecycle ==========
+
+// Initialize an empty (not yet built) index
+void line_index_init(LineIndex *index);
+
+// Free checkpoint arrays
+void line_index_free(LineIndex *index);
+
+// Rebuild all checkpoints with a single pass over the rope leaves
+void line_index_build(LineIndex *index, RopeNode *root);
+
+// Mark index as stale (rebuilt on next query)
+void line_index_invalidate(LineIndex *index);
+
+// ========== Incremental maintenance ==========
+
+// Update checkpoints after insert_at(root, pos, text) of len chars containing newlines '\n's
+void line_index_insert(LineIndex *index, int pos, int len, int newlines);
+
+// Add checkpoints for text appended at the end of the rope at pos (pos lies on line 'line')
+void line_index_append(LineIndex *index, int pos, char *text, int len, int line);
+
+// Update checkpoints after delete_at(root, start, len) that removed newlines '\n's
+void line_index_delete(LineIndex *index, int start, int len, int newlines);
+
+// ========== Queries ==========
+
+// Get starting position of a line (rope length if line doesn't exist)
+int line_index_line_start(LineIndex *index, RopeNode *root, int line);
+
+// Get line number containing a character index
+int line_index_line_from_pos(LineIndex *index, RopeNode *root, int pos);
+
+// ========== Sidecar ==========
+// The index of a file can be kept in ".<name>.tim2.lines" beside it, stamped with the file's
+// identity, size, modification time and a hash of sampled blocks, so a reopen starts with
+// the whole index instead of rebuilding it from the text
+
+// Sidecar file name for filename (malloc'd)
+char *line_index_sidecar_path(char *filename);
+
+// Write the index of root, which holds exactly the file stamped 'stamp', to path
+// Returns false if the file has changed since or the sidecar cannot be written
+bool line_index_save(LineIndex *index, RopeNode *root, char *path, char *filename, FileStamp *stamp);
+
+// Replace the index by the one in path if it matches filename as stamped; false otherwise
+bool line_index_load(LineIndex *index, char *path, char *filename, FileStamp *stamp);
+
+#endif
@@ -1,42 +1,131 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "editor.h"
+#include "buffer.h"
 #include "display.h"
 #include "input.h"
+#include "event.h"
+#include "worker.h"
 
 /**
  * Main entry point for the text editor
- * Usage: ./tim2 <filename>
+ * Usage: ./tim2 <filename> [filename...]
  */
 int main(int argc, char **argv) {
     // Check command line arguments
-    if (argc != 2) {
-        printf("Usage: %s <filename>\n", argv[0]);
+    if (argc < 2) {
+        printf("Usage: %s <filename> [filename...]\n", argv[0]);
         return 1;
     }
 
-    // Initialize editor state and load file
-    EditorState *editor = editor_create(argv[1]);
+    // One buffer per file; only the first is loaded now, the rest when first shown
+    BufferList *buffers = buffer_list_create(argv + 1, argc - 1);
+    buffer_list_current(buffers);
 
-    // Setup terminal for raw input mode
+    // Setup terminal for raw input mode, and catch resizes
     term_init();
+    event_init();
 
-    // Main editor loop
+    // Main event loop: wait for keys, resizes, file growth and timers, then draw at most one frame
     bool running = true;
+    bool redraw = true;
+    FramePacer pacer = { 0 };
     while (running) {
-        // Render editor (content + status bar)
-        display_editor(editor);
+        EditorState *editor = buffer_list_current(buffers);
 
-        // Process keyboard input
+        // Pick up changes other programs made to the file
+        editor_check_disk(editor);
+
+        // Start a due autosave (its snapshot is taken here, between keys; the writing is not)
+        editor_autosave(editor);
+
+        // Refresh the line index sidecar after a load or save
+        editor_index_sync(editor);
+
+        // Compress text that has moved away from every view (on the worker pool)
+        editor_compress(editor);
+
+        // Render current buffer (content + status bar), at most once per EVENT_FRAME_MS
+        int frame_ms = -1;
+        if (redraw) {
+            frame_ms = frame_wait(&pacer);
+            if (frame_ms == 0) {
+                display_editor(editor);
+                frame_drawn(&pacer);
+                redraw = false;
+                frame_ms = -1;
+            }
+        }
+
+        // Edits journaled while handling the last keys go out in one write
+        journal_write(&editor->journal);
+
+        // Wake up for the earliest of: the next frame, a followed file's growth (polled where
+        // inotify is missing), a journal sync once keys pause (at most once per JOURNAL_SYNC_MS),
+        // an autosave's idle time, the progress of a running autosave, count, load or
+        // compression, and a background job finishing
+        int fd = editor->following ? file_watch_fd(&editor->follow) : -1;
+        int timeout = editor->following ? file_watch_timeout(&editor->follow) : -1;
+        timeout = event_earliest(timeout, frame_ms);
+        timeout = event_earliest(timeout, journal_sync_timeout(&editor->journal));
+        timeout = event_earliest(timeout, autosave_timeout(&editor->autosave));
+        if (editor->count.running || rope_load_active(&editor->loader) || editor->freeze)
+            timeout = event_earliest(timeout, WORKER_PROGRESS_MS);
+        // Keys left in the input buffer (the rest of a paste) are handled without waiting:
+        // they were read from stdin already, so poll() would not report them
+        bool buffered = input_buffered();
+        int events = event_wait(fd, worker_fd(), buffered ? 0 : timeout);
+        if (buffered)
+            events |= EVENT_KEY;
+
+        // The size is queried once per resize, not on every frame
+        if (events & EVENT_RESIZE) {
+            term_update_size();
+            redraw = true;
+        }
+
+        // Process every key already typed before drawing (a paste becomes one frame)
         // Returns false when user presses 'q' to quit
-        running = handle_input(editor);
+        if (events & EVENT_KEY) {
+            double start = event_now_ms();
+            do {
+                running = handle_input(buffers);
+            } while (running && input_pending(0) && event_now_ms() - start < EVENT_FRAME_MS);
+            redraw = true;
+            if (!running)
+                break;
+            editor = buffer_list_current(buffers);
+        }
+
+        // Timers and file growth (growth past every view's last line leaves the screen as it is)
+        // The journal is only synced while no keys come in, so typing never waits for the disk
+        if (!(events & EVENT_KEY) && journal_sync_timeout(&editor->journal) == 0)
+            journal_sync(&editor->journal);
+        if ((events & (EVENT_WATCH | EVENT_TIMEOUT)) && editor_follow_update(editor))
+            redraw = true;
+        if (buffer_list_poll(buffers))
+            redraw = true;
+
+        // Parts of a large file that finished loading are appended (the next frame shows them)
+        if (editor_load_poll(editor))
+            redraw = true;
+
+        // Finished background jobs report their results (their finish callbacks run here)
+        if (events & EVENT_JOB) {
+            worker_collect();
+            redraw = true;
+        }
+        if (editor->count.running && (events & EVENT_TIMEOUT))
+            redraw = true;
     }
 
     // Restore terminal to normal mode
+    event_cleanup();
     term_cleanup();
 
-    // Free all editor resources
-    editor_free(editor);
+    // Free all buffers and their editor resources, then stop the worker pool
+    buffer_list_free(buffers);
+    worker_shutdown();
 
     return 0;
 }
@@ -0,0 +1,839 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regexp.h"
+
+
+// ========== Parsing ==========
+
+// Syntax tree node types
+typedef enum {
+    AST_SET,      // One byte from set
+    AST_BOL,      // ^
+    AST_EOL,      // $
+    AST_EMPTY,    // Matches the empty string
+    AST_CONCAT,   // left then right
+    AST_ALT,      // left or right
+    AST_REPEAT    // left repeated min..max times (max = -1 for unbounded)
+} AstType;
+
+typedef struct Ast {
+    AstType type;
+    unsigned char set[32];
+    struct Ast *left;
+    struct Ast *right;
+    int min;
+    int max;
+} Ast;
+
+// Parser position and first error encountered
+typedef struct {
+    char *p;
+    const char *error;
+} Parser;
+
+
+// Allocates a syntax tree node
+static Ast *ast_new(AstType type, Ast *left, Ast *right) {
+    Ast *node = calloc(1, sizeof(Ast));
+    if (!node) {
+        perror("Failed to allocate regex node");
+        exit(EXIT_FAILURE);
+    }
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+
+// Frees a syntax tree
+static void ast_free(Ast *node) {
+    if (!node) return;
+    ast_free(node->left);
+    ast_free(node->right);
+    free(node);
+}
+
+
+static void set_add(unsigned char *set, unsigned char c) {
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+
+static bool set_has(unsigned char *set, unsigned char c) {
+    return set[c >> 3] & (1 << (c & 7));
+}
+
+
+// Adds the bytes of a \d \w \s class (or their negations) to set
+static void set_add_class(unsigned char *set, char cls) {
+    unsigned char tmp[32] = {0};
+    for (int c = 0; c < 256; c++) {
+        bool in;
+        switch (cls | 0x20) {
+            case 'd': in = c >= '0' && c <= '9'; break;
+            case 'w': in = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                           (c >= 'A' && c <= 'Z') || c == '_'; break;
+            default:  in = c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+                           c == '\f' || c == '\v'; break;
+        }
+        if (in) set_add(tmp, c);
+    }
+    bool negate = cls >= 'A' && cls <= 'Z';
+    for (int i = 0; i < 32; i++)
+        set[i] |= negate ? ~tmp[i] : tmp[i];
+    // Negated classes stay within a line
+    if (negate) set[1] &= ~(1 << 2);
+}
+
+
+// Returns the byte an escape stands for (\n \t, otherwise the character itself)
+static unsigned char escape_char(char c) {
+    if (c == 'n') return '\n';
+    if (c == 't') return '\t';
+    return c;
+}
+
+
+static bool is_class_escape(char c) {
+    return strchr("dDwWsS", c) != NULL;
+}
+
+
+static Ast *parse_alt(Parser *ps);
+
+
+// Builds a node matching one byte in [lo, hi]
+static Ast *ast_byte_range(unsigned char lo, unsigned char hi) {
+    Ast *node = ast_new(AST_SET, NULL, NULL);
+    for (int c = lo; c <= hi; c++)
+        set_add(node->set, c);
+    return node;
+}
+
+
+// Builds a node matching any multibyte UTF-8 character (lead byte + continuation bytes)
+static Ast *ast_utf8_multibyte(void) {
+    Ast *two = ast_new(AST_CONCAT, ast_byte_range(0xC2, 0xDF), ast_byte_range(0x80, 0xBF));
+    Ast *three = ast_new(AST_CONCAT, ast_byte_range(0xE0, 0xEF), ast_byte_range(0x80, 0xBF));
+    three = ast_new(AST_CONCAT, three, ast_byte_range(0x80, 0xBF));
+    Ast *four = ast_new(AST_CONCAT, ast_byte_range(0xF0, 0xF4), ast_byte_range(0x80, 0xBF));
+    four = ast_new(AST_CONCAT, four, ast_byte_range(0x80, 0xBF));
+    four = ast_new(AST_CONCAT, four, ast_byte_range(0x80, 0xBF));
+    return ast_new(AST_ALT, two, ast_new(AST_ALT, three, four));
+}
+
+
+// Builds a node matching the UTF-8 sequence at s (n bytes) as one unit
+static Ast *ast_sequence(char *s, int n) {
+    Ast *node = ast_byte_range(s[0], s[0]);
+    for (int i = 1; i < n; i++)
+        node = ast_new(AST_CONCAT, node, ast_byte_range(s[i], s[i]));
+    return node;
+}
+
+
+// Finishes a set node: bytes >= 0x80 in the set stand for "any non-ASCII character"
+// and are replaced by whole UTF-8 sequences, so '.', [^...] \W etc. never match half a character
+static Ast *finish_set(Ast *node) {
+    bool high = false;
+    for (int i = 16; i < 32; i++) {
+        if (node->set[i])
+            high = true;
+        node->set[i] = 0;
+    }
+    return high ? ast_new(AST_ALT, node, ast_utf8_multibyte()) : node;
+}
+
+
+// Length of the UTF-8 sequence at s if it is well formed, else 0
+static int sequence_len(char *s) {
+    int cp;
+    int n = utf8_seq_len(s[0]);
+    return (n > 1 && utf8_decode(s, n, &cp) == n) ? n : 0;
+}
+
+
+// Parses a bracket expression; p points after '['
+static Ast *parse_class(Parser *ps) {
+    Ast *node = ast_new(AST_SET, NULL, NULL);
+    bool negate = false;
+    if (*ps->p == '^') {
+        negate = true;
+        ps->p++;
+    }
+
+    Ast *multibyte = NULL;  // Alternatives for non-ASCII members
+
+    bool first = true;
+    while (*ps->p && (*ps->p != ']' || first)) {
+        first = false;
+
+        // Non-ASCII member: matched as a whole sequence
+        int n = sequence_len(ps->p);
+        if (n > 0) {
+            if (negate || (ps->p[n] == '-' && ps->p[n + 1] && ps->p[n + 1] != ']')) {
+                ps->error = negate ? "non-ASCII character in [^]" : "non-ASCII range in []";
+                ast_free(multibyte);
+                return node;
+            }
+            Ast *seq = ast_sequence(ps->p, n);
+            multibyte = multibyte ? ast_new(AST_ALT, multibyte, seq) : seq;
+            ps->p += n;
+            continue;
+        }
+
+        unsigned char lo = *ps->p++;
+        if (lo == '\\') {
+            if (!*ps->p) break;
+            char e = *ps->p++;
+            if (is_class_escape(e)) {
+                set_add_class(node->set, e);
+                continue;
+            }
+            lo = escape_char(e);
+        }
+
+        unsigned char hi = lo;
+        if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']') {
+            ps->p++;
+            hi = *ps->p++;
+            if (hi == '\\' && *ps->p) hi = escape_char(*ps->p++);
+            if (hi < lo || hi >= 0x80) {
+                ps->error = hi >= 0x80 ? "non-ASCII range in []" : "invalid range in []";
+                ast_free(multibyte);
+                return node;
+            }
+        }
+        for (int c = lo; c <= hi; c++)
+            set_add(node->set, c);
+    }
+
+    if (*ps->p != ']') {
+        ps->error = "missing ]";
+        ast_free(multibyte);
+        return node;
+    }
+    ps->p++;
+
+    if (negate) {
+        for (int i = 0; i < 32; i++)
+            node->set[i] = ~node->set[i];
+        set_add(node->set, '\n');
+        node->set[1] &= ~(1 << 2);
+    }
+
+    node = finish_set(node);
+    return multibyte ? ast_new(AST_ALT, node, multibyte) : node;
+}
+
+
+// Parses a single atom: literal, class, group or anchor
+static Ast *parse_atom(Parser *ps) {
+    char c = *ps->p++;
+    Ast *node;
+
+    switch (c) {
+        case '(':
+            node = parse_alt(ps);
+            if (ps->error) return node;
+            if (*ps->p != ')') ps->error = "missing )";
+            else ps->p++;
+            return node;
+        case '[':
+            return parse_class(ps);
+        case '^':
+            return ast_new(AST_BOL, NULL, NULL);
+        case '$':
+            return ast_new(AST_EOL, NULL, NULL);
+        case '*': case '+': case '?':
+            ps->error = "nothing to repeat";
+            return NULL;
+    }
+
+    // Non-ASCII character: one atom, so quantifiers apply to the whole sequence
+    int n = sequence_len(ps->p - 1);
+    if (n > 0) {
+        ps->p += n - 1;
+        return ast_sequence(ps->p - n, n);
+    }
+
+    node = ast_new(AST_SET, NULL, NULL);
+    if (c == '.') {
+        memset(node->set, 0xff, sizeof(node->set));
+        node->set['\n' >> 3] &= ~(1 << ('\n' & 7));
+        return finish_set(node);
+    } else if (c == '\\') {
+        if (!*ps->p) {
+            ps->error = "trailing backslash";
+            return node;
+        }
+        char e = *ps->p++;
+        if (is_class_escape(e)) {
+            set_add_class(node->set, e);
+            return finish_set(node);
+        }
+        set_add(node->set, escape_char(e));
+    } else {
+        set_add(node->set, c);
+    }
+    return node;
+}
+
+
+// Parses a decimal count for {n,m}; returns -1 if there are no digits
+static int parse_count(Parser *ps) {
+    if (*ps->p < '0' || *ps->p > '9') return -1;
+    int n = 0;
+    while (*ps->p >= '0' && *ps->p <= '9') {
+        if (n <= REGEXP_MAX_REPEAT) n = n * 10 + (*ps->p - '0');
+        ps->p++;
+    }
+    return n;
+}
+
+
+// Parses {n} {n,} {n,m}; p points at '{'. Leaves p unchanged and returns false
+// if the braces do not form a valid count (they are then taken literally)
+static bool parse_braces(Parser *ps, int *min, int *max) {
+    char *save = ps->p;
+    ps->p++;
+    *min = parse_count(ps);
+    *max = *min;
+    if (*ps->p == ',') {
+        ps->p++;
+        *max = parse_count(ps);
+    }
+    if (*min < 0 || *ps->p != '}') {
+        ps->p = save;
+        return false;
+    }
+    ps->p++;
+    return true;
+}
+
+
+// Parses an atom followed by any number of quantifiers
+static Ast *parse_repeat(Parser *ps) {
+    Ast *node = parse_atom(ps);
+
+    while (!ps->error) {
+        int min, max;
+        char c = *ps->p;
+        if (c == '*') { min = 0; max = -1; ps->p++; }
+        else if (c == '+') { min = 1; max = -1; ps->p++; }
+        else if (c == '?') { min = 0; max = 1; ps->p++; }
+        else if (c == '{' && parse_braces(ps, &min, &max)) {
+            if (min > REGEXP_MAX_REPEAT || max > REGEXP_MAX_REPEAT) {
+                ps->error = "repeat count too large";
+                break;
+            }
+            if (max >= 0 && max < min) {
+                ps->error = "invalid repeat count";
+                break;
+            }
+        }
+        else break;
+
+        node = ast_new(AST_REPEAT, node, NULL);
+        node->min = min;
+        node->max = max;
+    }
+    return node;
+}
+
+
+// Parses a sequence of repeated atoms
+static Ast *parse_concat(Parser *ps) {
+    Ast *node = NULL;
+    while (*ps->p && *ps->p != '|' && *ps->p != ')' && !ps->error) {
+        Ast *item = parse_repeat(ps);
+        node = node ? ast_new(AST_CONCAT, node, item) : item;
+    }
+    return node ? node : ast_new(AST_EMPTY, NULL, NULL);
+}
+
+
+// Parses alternatives separated by '|'
+static Ast *parse_alt(Parser *ps) {
+    Ast *node = parse_concat(ps);
+    while (*ps->p == '|' && !ps->error) {
+        ps->p++;
+        node = ast_new(AST_ALT, node, parse_concat(ps));
+    }
+    return node;
+}
+
+
+// ========== NFA construction ==========
+
+// Appends a state and returns its index (-1 once the size limit is exceeded)
+static int nfa_add(Nfa *nfa, NfaOp op, int out) {
+    if (nfa->count >= REGEXP_MAX_STATES) return -1;
+    if (nfa->count == nfa->capacity) {
+        nfa->capacity = nfa->capacity ? nfa->capacity * 2 : 64;
+        nfa->states = realloc(nfa->states, nfa->capacity * sizeof(NfaState));
+        if (!nfa->states) {
+            perror("Failed to allocate NFA");
+            exit(EXIT_FAILURE);
+        }
+    }
+    NfaState *s = &nfa->states[nfa->count];
+    s->op = op;
+    s->out = out;
+    s->out1 = -1;
+    memset(s->set, 0, sizeof(s->set));
+    return nfa->count++;
+}
+
+
+// Compiles node so that it continues at state next; returns its entry state
+// When reverse is set the program reads the text right to left: concatenations
+// are emitted in reverse order and ^/$ swap roles. Returns -1 if too large
+static int nfa_compile(Nfa *nfa, Ast *node, int next, bool reverse) {
+    if (next < 0) return -1;
+    int s, body, tail;
+
+    switch (node->type) {
+        case AST_SET:
+            s = nfa_add(nfa, NFA_CHAR, next);
+            if (s >= 0) memcpy(nfa->states[s].set, node->set, sizeof(node->set));
+            return s;
+
+        case AST_BOL:
+            return nfa_add(nfa, reverse ? NFA_EOL : NFA_BOL, next);
+
+        case AST_EOL:
+            return nfa_add(nfa, reverse ? NFA_BOL : NFA_EOL, next);
+
+        case AST_EMPTY:
+            return next;
+
+        case AST_CONCAT:
+            if (reverse)
+                return nfa_compile(nfa, node->right, nfa_compile(nfa, node->left, next, reverse), reverse);
+            return nfa_compile(nfa, node->left, nfa_compile(nfa, node->right, next, reverse), reverse);
+
+        case AST_ALT:
+            body = nfa_compile(nfa, node->left, next, reverse);
+            tail = nfa_compile(nfa, node->right, next, reverse);
+            if (body < 0 || tail < 0) return -1;
+            s = nfa_add(nfa, NFA_SPLIT, body);
+            if (s >= 0) nfa->states[s].out1 = tail;
+            return s;
+
+        case AST_REPEAT:
+            tail = next;
+            if (node->max < 0) {
+                // x*: split loops through the body or leaves
+                s = nfa_add(nfa, NFA_SPLIT, -1);
+                if (s < 0) return -1;
+                body = nfa_compile(nfa, node->left, s, reverse);
+                if (body < 0) return -1;
+                nfa->states[s].out = body;
+                nfa->states[s].out1 = next;
+                tail = s;
+            } else {
+                // Optional copies nest: (x(x(x)?)?)? so each may stop early
+                for (int i = node->min; i < node->max; i++) {
+                    body = nfa_compile(nfa, node->left, tail, reverse);
+                    if (body < 0) return -1;
+                    s = nfa_add(nfa, NFA_SPLIT, body);
+                    if (s < 0) return -1;
+                    nfa->states[s].out1 = next;
+                    tail = s;
+                }
+            }
+            // Mandatory copies
+            for (int i = 0; i < node->min && tail >= 0; i++)
+                tail = nfa_compile(nfa, node->left, tail, reverse);
+            return tail;
+    }
+    return -1;
+}
+
+
+// ========== Lazy DFA ==========
+
+// Prepares an empty DFA cache for nfa
+static void dfa_init(Dfa *dfa, Nfa *nfa, bool unanchored) {
+    dfa->nfa = nfa;
+    dfa->unanchored = unanchored;
+    dfa->states = NULL;
+    dfa->count = 0;
+    dfa->capacity = 0;
+    dfa->table = calloc(2 * DFA_MAX_STATES, sizeof(int));
+    dfa->stack = malloc((3 * nfa->count + 2) * sizeof(int));
+    dfa->mark = calloc(nfa->count, sizeof(int));
+    dfa->set = malloc(nfa->count * sizeof(int));
+    dfa->kernel = malloc(nfa->count * sizeof(int));
+    if (!dfa->table || !dfa->stack || !dfa->mark || !dfa->set || !dfa->kernel) {
+        perror("Failed to allocate DFA");
+        exit(EXIT_FAILURE);
+    }
+    dfa->generation = 0;
+    dfa->start[0] = dfa->start[1] = -1;
+}
+
+
+// Drops all cached states (the cache is rebuilt on demand)
+static void dfa_reset(Dfa *dfa) {
+    for (int i = 0; i < dfa->count; i++)
+        free(dfa->states[i].kernel);
+    dfa->count = 0;
+    memset(dfa->table, 0, 2 * DFA_MAX_STATES * sizeof(int));
+    dfa->start[0] = dfa->start[1] = -1;
+}
+
+
+// Frees the DFA cache and scratch space
+static void dfa_free(Dfa *dfa) {
+    dfa_reset(dfa);
+    free(dfa->states);
+    free(dfa->table);
+    free(dfa->stack);
+    free(dfa->mark);
+    free(dfa->set);
+    free(dfa->kernel);
+}
+
+
+// Starts a new visit generation for dfa->mark
+static int dfa_next_generation(Dfa *dfa) {
+    if (++dfa->generation == 0) {
+        memset(dfa->mark, 0, dfa->nfa->count * sizeof(int));
+        dfa->generation = 1;
+    }
+    return dfa->generation;
+}
+
+
+// Follows empty transitions from kernel into dfa->set, keeping only CHAR and MATCH states
+// bol/eol tell whether ^ and $ hold at the current position; returns size of the set
+static int dfa_closure(Dfa *dfa, int *kernel, int n, bool bol, bool eol) {
+    NfaState *states = dfa->nfa->states;
+    int gen = dfa_next_generation(dfa);
+    int sp = 0;
+    int count = 0;
+
+    for (int i = n - 1; i >= 0; i--)
+        dfa->stack[sp++] = kernel[i];
+
+    while (sp > 0) {
+        int s = dfa->stack[--sp];
+        if (dfa->mark[s] == gen) continue;
+        dfa->mark[s] = gen;
+
+        switch (states[s].op) {
+            case NFA_CHAR:
+            case NFA_MATCH:
+                dfa->set[count++] = s;
+                break;
+            case NFA_SPLIT:
+                dfa->stack[sp++] = states[s].out1;
+                dfa->stack[sp++] = states[s].out;
+                break;
+            case NFA_BOL:
+                if (bol) dfa->stack[sp++] = states[s].out;
+                break;
+            case NFA_EOL:
+                if (eol) dfa->stack[sp++] = states[s].out;
+                break;
+        }
+    }
+    return count;
+}
+
+
+// True if the closure of kernel contains the match state
+static bool dfa_accepts(Dfa *dfa, int *kernel, int n, bool bol, bool eol) {
+    int count = dfa_closure(dfa, kernel, n, bol, eol);
+    for (int i = 0; i < count; i++)
+        if (dfa->nfa->states[dfa->set[i]].op == NFA_MATCH) return true;
+    return false;
+}
+
+
+// Hash of a kernel and its newline flag
+static unsigned int dfa_hash(int *kernel, int n, bool after_newline) {
+    unsigned int h = 2166136261u ^ after_newline;
+    for (int i = 0; i < n; i++)
+        h = (h ^ (unsigned int)kernel[i]) * 16777619u;
+    return h;
+}
+
+
+// Returns the cached state for kernel, creating it if needed
+// The caller guarantees there is room (count < DFA_MAX_STATES)
+static int dfa_intern(Dfa *dfa, int *kernel, int n, bool after_newline) {
+    unsigned int mask = 2 * DFA_MAX_STATES - 1;
+    unsigned int slot = dfa_hash(kernel, n, after_newline) & mask;
+
+    while (dfa->table[slot]) {
+        DfaState *st = &dfa->states[dfa->table[slot] - 1];
+        if (st->nkernel == n && st->after_newline == after_newline &&
+            memcmp(st->kernel, kernel, n * sizeof(int)) == 0)
+            return dfa->table[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+
+    if (dfa->count == dfa->capacity) {
+        dfa->capacity = dfa->capacity ? dfa->capacity * 2 : 16;
+        dfa->states = realloc(dfa->states, dfa->capacity * sizeof(DfaState));
+        if (!dfa->states) {
+            perror("Failed to allocate DFA state");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    DfaState *st = &dfa->states[dfa->count];
+    st->kernel = malloc((n ? n : 1) * sizeof(int));
+    if (!st->kernel) {
+        perror("Failed to allocate DFA state");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(st->kernel, kernel, n * sizeof(int));
+    st->nkernel = n;
+    st->after_newline = after_newline;
+    st->accept_nl = dfa_accepts(dfa, kernel, n, after_newline, true);
+    st->accept_other = dfa_accepts(dfa, kernel, n, after_newline, false);
+    for (int c = 0; c < 256; c++)
+        st->next[c] = -1;
+
+    dfa->table[slot] = dfa->count + 1;
+    return dfa->count++;
+}
+
+
+// Returns the start state for a scan beginning at (or after) a line start or not
+static int dfa_start(Dfa *dfa, bool after_newline) {
+    if (dfa->start[after_newline] < 0) {
+        if (dfa->count >= DFA_MAX_STATES) dfa_reset(dfa);
+        dfa->start[after_newline] = dfa_intern(dfa, &dfa->nfa->start, 1, after_newline);
+    }
+    return dfa->start[after_newline];
+}
+
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+
+// Returns the state reached from *cur on byte c, computing and caching it if needed
+// When the cache is full it is flushed; *cur is then re-created in the fresh cache
+static int dfa_step(Dfa *dfa, int *cur, unsigned char c) {
+    int next = dfa->states[*cur].next[c];
+    if (next >= 0) return next;
+
+    DfaState *st = &dfa->states[*cur];
+    int count = dfa_closure(dfa, st->kernel, st->nkernel, st->after_newline, c == '\n');
+
+    // Kernel of the next state: targets of all CHAR states accepting c
+    int gen = dfa_next_generation(dfa);
+    int n = 0;
+    NfaState *states = dfa->nfa->states;
+    for (int i = 0; i < count; i++) {
+        NfaState *s = &states[dfa->set[i]];
+        if (s->op == NFA_CHAR && set_has(s->set, c) && dfa->mark[s->out] != gen) {
+            dfa->mark[s->out] = gen;
+            dfa->kernel[n++] = s->out;
+        }
+    }
+    if (dfa->unanchored && dfa->mark[dfa->nfa->start] != gen)
+        dfa->kernel[n++] = dfa->nfa->start;
+    qsort(dfa->kernel, n, sizeof(int), compare_int);
+
+    if (dfa->count >= DFA_MAX_STATES) {
+        int *kernel = malloc((st->nkernel ? st->nkernel : 1) * sizeof(int));
+        if (!kernel) {
+            perror("Failed to allocate DFA state");
+            exit(EXIT_FAILURE);
+        }
+        int nkernel = st->nkernel;
+        bool after_newline = st->after_newline;
+        memcpy(kernel, st->kernel, nkernel * sizeof(int));
+        dfa_reset(dfa);
+        *cur = dfa_intern(dfa, kernel, nkernel, after_newline);
+        free(kernel);
+    }
+
+    next = dfa_intern(dfa, dfa->kernel, n, c == '\n');
+    dfa->states[*cur].next[c] = next;
+    return next;
+}
+
+
+// True if a match ends in state st given the byte that follows (-1 = end of text)
+static bool dfa_accepting(DfaState *st, int lookahead) {
+    return (lookahead == '\n' || lookahead < 0) ? st->accept_nl : st->accept_other;
+}
+
+
+// Runs dfa left to right from 'from'. Returns the first position where a match
+// ends if earliest is set, otherwise the last one before the automaton dies (-1 if none)
+static int dfa_scan_forward(Dfa *dfa, RopeNode *root, int from, bool earliest) {
+    bool after_newline = from == 0 || char_at(root, from - 1) == '\n';
+    int cur = dfa_start(dfa, after_newline);
+    int result = -1;
+    int pos = from;
+
+    RopeIter it;
+    for (rope_iter_init(&it, root, from); it.leaf; rope_iter_next(&it)) {
+        unsigned char *str = (unsigned char *)rope_leaf_text(it.leaf);
+        int n = it.leaf->total_len;
+        for (int i = pos - it.leaf_start; i < n; i++) {
+            if (dfa_accepting(&dfa->states[cur], str[i])) {
+                result = it.leaf_start + i;
+                if (earliest) return result;
+            }
+            cur = dfa_step(dfa, &cur, str[i]);
+            if (dfa->states[cur].nkernel == 0) return result;
+        }
+        pos = it.leaf_start + n;
+    }
+
+    if (dfa_accepting(&dfa->states[cur], -1)) result = pos;
+    return result;
+}
+
+
+// Runs dfa right to left from 'from' down to 'limit'. If first_below >= 0, returns
+// the first position below it where a match starts; otherwise the last one before
+// the automaton dies (-1 if none)
+static int dfa_scan_backward(Dfa *dfa, RopeNode *root, int from, int limit, int first_below) {
+    int len = root ? root->total_len : 0;
+    bool after_newline = from == len || char_at(root, from) == '\n';
+    int cur = dfa_start(dfa, after_newline);
+    int result = -1;
+    int pos = from;
+
+    RopeIter it;
+    for (rope_iter_init_back(&it, root, from); it.leaf && pos > limit; rope_iter_prev(&it)) {
+        unsigned char *str = (unsigned char *)rope_leaf_text(it.leaf);
+        for (int i = pos - it.leaf_start - 1; i >= 0 && pos > limit; i--, pos--) {
+            if (dfa_accepting(&dfa->states[cur], str[i])) {
+                result = pos;
+                if (first_below >= 0 && pos < first_below) return result;
+            }
+            cur = dfa_step(dfa, &cur, str[i]);
+            if (dfa->states[cur].nkernel == 0) return first_below >= 0 ? -1 : result;
+        }
+    }
+
+    int lookahead = pos > 0 ? (unsigned char)char_at(root, pos - 1) : -1;
+    if (dfa_accepting(&dfa->states[cur], lookahead)) result = pos;
+    if (first_below >= 0 && result >= first_below) return -1;
+    return result;
+}
+
+
+// ========== Public API ==========
+
+bool regexp_is_literal(char *pattern) {
+    return strpbrk(pattern, ".[]()|*+?{}^$\\") == NULL;
+}
+
+
+Regexp *regexp_compile(char *pattern, const char **error) {
+    Parser ps = { pattern, NULL };
+    Ast *ast = parse_alt(&ps);
+    if (!ps.error && *ps.p == ')') ps.error = "unmatched )";
+    if (ps.error) {
+        ast_free(ast);
+        *error = ps.error;
+        return NULL;
+    }
+
+    Regexp *re = calloc(1, sizeof(Regexp));
+    if (!re) {
+        perror("Failed to allocate regex");
+        exit(EXIT_FAILURE);
+    }
+
+    re->forward.start = nfa_compile(&re->forward, ast, nfa_add(&re->forward, NFA_MATCH, -1), false);
+    re->reverse.start = nfa_compile(&re->reverse, ast, nfa_add(&re->reverse, NFA_MATCH, -1), true);
+    ast_free(ast);
+    if (re->forward.start < 0 || re->reverse.start < 0) {
+        free(re->forward.states);
+        free(re->reverse.states);
+        free(re);
+        *error = "pattern too large";
+        return NULL;
+    }
+
+    for (int i = 0; i < re->forward.count && !re->multiline; i++)
+        if (re->forward.states[i].op == NFA_CHAR && set_has(re->forward.states[i].set, '\n'))
+            re->multiline = true;
+
+    dfa_init(&re->scan, &re->forward, true);
+    dfa_init(&re->start, &re->reverse, false);
+    dfa_init(&re->extend, &re->forward, false);
+    dfa_init(&re->rscan, &re->reverse, true);
+    return re;
+}
+
+
+void regexp_free(Regexp *re) {
+    if (!re) return;
+    dfa_free(&re->scan);
+    dfa_free(&re->start);
+    dfa_free(&re->extend);
+    dfa_free(&re->rscan);
+    free(re->forward.states);
+    free(re->reverse.states);
+    free(re);
+}
+
+
+int regexp_find(Regexp *re, RopeNode *root, int from, int *match_end) {
+    int len = root ? root->total_len : 0;
+    if (from < 0) from = 0;
+    if (from > len) return -1;
+
+    // Earliest end of any match starting at or after from
+    int end = dfa_scan_forward(&re->scan, root, from, true);
+    if (end < 0) return -1;
+
+    // Leftmost start of a match ending there, then the longest match from that start
+    int start = dfa_scan_backward(&re->start, root, end, from, -1);
+    if (start < 0) start = end;
+    *match_end = dfa_scan_forward(&re->extend, root, start, false);
+    if (*match_end < end) *match_end = end;
+    return start;
+}
+
+
+int regexp_rfind(Regexp *re, RopeNode *root, int before, int *match_end) {
+    int len = root ? root->total_len : 0;
+    if (before > len + 1) before = len + 1;
+    if (before <= 0) return -1;
+
+    // Matches starting before 'before' end no later than the next newline unless the
+    // pattern can consume one; scan back from there for the first start below 'before'
+    int from = re->multiline ? len : rope_find_newline(root, before - 1);
+    int start = dfa_scan_backward(&re->rscan, root, from, 0, before);
+    if (start < 0) return -1;
+    *match_end = dfa_scan_forward(&re->extend, root, start, false);
+    return start;
+}
+
+
+int regexp_count(Regexp *re, RopeNode *root) {
+    int len = root ? root->total_len : 0;
+    int count = 0;
+    int pos = 0;
+    int end;
+
+    while (pos <= len) {
+        int start = regexp_find(re, root, pos, &end);
+        if (start < 0) break;
+        count++;
+        // Empty matches advance by one so the scan always makes progress
+        pos = end > start ? end : end + 1;
+    }
+    return count;
+}
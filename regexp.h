@@ -0,0 +1,98 @@
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include "rope.h"
+#include <stdbool.h>
+
+// Limits that keep memory bounded regardless of pattern or file size
+#define REGEXP_MAX_STATES 4096   // Largest NFA a pattern may compile to
+#define REGEXP_MAX_REPEAT 1000   // Largest count allowed in {n,m}
+#define DFA_MAX_STATES 1024      // Cached DFA states per automaton before the cache is flushed
+
+// NFA instruction types (Thompson construction)
+typedef enum {
+    NFA_CHAR,    // Consume one byte contained in set
+    NFA_SPLIT,   // Continue at both out and out1
+    NFA_BOL,     // Continue only at start of line (previous byte was '\n' or start of text)
+    NFA_EOL,     // Continue only at end of line (next byte is '\n' or end of text)
+    NFA_MATCH    // Pattern matched
+} NfaOp;
+
+// Single NFA state
+typedef struct {
+    NfaOp op;
+    int out;                  // Next state
+    int out1;                 // Second branch (NFA_SPLIT only)
+    unsigned char set[32];    // Bitmap of accepted bytes (NFA_CHAR only)
+} NfaState;
+
+// Compiled NFA program
+typedef struct {
+    NfaState *states;  // State array
+    int count;         // Number of states
+    int capacity;      // Allocated states
+    int start;         // Entry state
+} Nfa;
+
+// One lazily built DFA state = set of NFA states reached after a byte
+typedef struct {
+    int *kernel;        // Sorted NFA states (before following empty transitions)
+    int nkernel;        // Size of kernel (0 = dead state)
+    bool after_newline; // Previous byte was '\n' (or scan started at a line start)
+    bool accept_nl;     // Match ends here if the next byte is '\n' or text ends
+    bool accept_other;  // Match ends here if the next byte is anything else
+    int next[256];      // Transition per byte (-1 = not computed yet)
+} DfaState;
+
+// Lazily built DFA over an NFA with a bounded state cache
+typedef struct {
+    Nfa *nfa;           // Program being simulated
+    bool unanchored;    // Restart the NFA at every byte (search instead of match)
+    DfaState *states;   // Cached states
+    int count;          // Number of cached states
+    int capacity;       // Allocated states
+    int *table;         // Hash table of state index + 1 (0 = empty slot)
+    int start[2];       // Start state for after_newline = false/true (-1 = not built)
+    int *stack;         // Scratch: closure stack
+    int *mark;          // Scratch: closure visit marks
+    int *set;           // Scratch: closure result
+    int *kernel;        // Scratch: kernel being built
+    int generation;     // Current visit mark value
+} Dfa;
+
+// Compiled regular expression with the four automata used for searching
+typedef struct {
+    Nfa forward;        // Pattern read left to right
+    Nfa reverse;        // Pattern read right to left
+    Dfa scan;           // Forward unanchored: earliest position where a match ends
+    Dfa start;          // Reverse anchored: leftmost start of a match with known end
+    Dfa extend;         // Forward anchored: longest match from a known start
+    Dfa rscan;          // Reverse unanchored: backward search
+    bool multiline;     // Pattern can match '\n' (matches may span lines)
+} Regexp;
+
+// ========== Compilation ==========
+
+// Compile pattern (returns NULL and sets *error on syntax error)
+// Supports literals . [] [^] \d \w \s (and negations) ^ $ ( ) | * + ? {n,m}
+Regexp *regexp_compile(char *pattern, const char **error);
+
+// Free compiled expression and its DFA caches
+void regexp_free(Regexp *re);
+
+// True if pattern contains no regex syntax (plain substring search suffices)
+bool regexp_is_literal(char *pattern);
+
+// ========== Searching ==========
+
+// Find leftmost match starting at or after from (-1 if none); *match_end gets its end
+// Linear time: one forward DFA pass, one reverse pass to the start, one pass to the longest end
+int regexp_find(Regexp *re, RopeNode *root, int from, int *match_end);
+
+// Find last match starting before 'before' (-1 if none); *match_end gets its end
+int regexp_rfind(Regexp *re, RopeNode *root, int before, int *match_end);
+
+// Count all non-overlapping matches
+int regexp_count(Regexp *re, RopeNode *root);
+
+#endif
@@ -1,7 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include "rope.h"
+#include "worker.h"
+#include "compress.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 // Returns true if a given node is a leaf node, else false
@@ -52,23 +66,330 @@ int count_newlines(char *str) {
 }
 
 
-// Recomputes total_len, weight, height and newlines of a node
+// Returns true if c is a UTF-8 continuation byte (10xxxxxx)
+bool utf8_is_continuation(char c) {
+	return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+
+// Returns the length of the UTF-8 sequence introduced by lead byte c
+// ASCII, continuation and invalid lead bytes count as a single byte
+int utf8_seq_len(char c) {
+	unsigned char b = c;
+	if (b < 0xC2)
+		return 1;
+	if (b < 0xE0)
+		return 2;
+	if (b < 0xF0)
+		return 3;
+	if (b < 0xF5)
+		return 4;
+	return 1;
+}
+
+
+// Decodes the character at s (at most len bytes available) into *cp
+// Returns the number of bytes consumed; malformed input consumes one byte and yields U+FFFD
+int utf8_decode(char *s, int len, int *cp) {
+	unsigned char b = s[0];
+	int n = utf8_seq_len(s[0]);
+
+	if (n == 1) {
+		*cp = b < 0x80 ? b : 0xFFFD;
+		return 1;
+	}
+
+	// Truncated sequence or missing continuation bytes
+	if (n > len) {
+		*cp = 0xFFFD;
+		return 1;
+	}
+	int value = b & (0x7F >> n);
+	for (int i = 1; i < n; i++) {
+		if (!utf8_is_continuation(s[i])) {
+			*cp = 0xFFFD;
+			return 1;
+		}
+		value = (value << 6) | (s[i] & 0x3F);
+	}
+
+	// Overlong forms, surrogates and values past U+10FFFF are invalid
+	if ((n == 3 && value < 0x800) || (n == 4 && value < 0x10000) ||
+	    (value >= 0xD800 && value <= 0xDFFF) || value > 0x10FFFF) {
+		*cp = 0xFFFD;
+		return 1;
+	}
+
+	*cp = value;
+	return n;
+}
+
+
+// Codepoint ranges drawn with no width (combining marks, zero-width characters)
+static const int zero_width_ranges[][2] = {
+	{0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x0610, 0x061A},
+	{0x064B, 0x065F}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x1AB0, 0x1AFF},
+	{0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F},
+	{0xFE20, 0xFE2F},
+};
+
+// Codepoint ranges drawn two columns wide (CJK, Hangul, fullwidth forms, emoji)
+static const int wide_ranges[][2] = {
+	{0x1100, 0x115F}, {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF},
+	{0x4E00, 0x9FFF}, {0xA000, 0xA4CF}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF},
+	{0xFE30, 0xFE4F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F},
+	{0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+
+// Returns true if cp lies in one of the count ranges
+static bool in_ranges(const int ranges[][2], int count, int cp) {
+	for (int i = 0; i < count; i++)
+		if (cp >= ranges[i][0] && cp <= ranges[i][1])
+			return true;
+	return false;
+}
+
+
+// Returns the number of display columns codepoint cp occupies
+int codepoint_width(int cp) {
+	if (cp == '\t')
+		return TAB_WIDTH;
+	if (cp < 0x300)
+		return 1;
+	if (in_ranges(zero_width_ranges, sizeof(zero_width_ranges) / sizeof(zero_width_ranges[0]), cp))
+		return 0;
+	if (in_ranges(wide_ranges, sizeof(wide_ranges) / sizeof(wide_ranges[0]), cp))
+		return 2;
+	return 1;
+}
+
+
+// Returns the number of display columns of the character starting at s (len bytes available)
+// The whole width is charged to the lead byte; continuation bytes count as zero columns,
+// so summing over every byte of a string gives its display width
+int char_width(char *s, int len) {
+	unsigned char b = s[0];
+	if (b == '\t')
+		return TAB_WIDTH;
+	if (b < 0x80)
+		return 1;
+	if (utf8_is_continuation(s[0]))
+		return 0;
+
+	int cp;
+	utf8_decode(s, len, &cp);
+	return codepoint_width(cp);
+}
+
+
+// Returns the total display width of a string
+int count_display_width(char *str) {
+	// Edge case when str is NULL
+	if (str == NULL)
+		return 0;
+
+	int len = string_length(str);
+	int width = 0;
+	for (int i = 0; i < len; i++)
+		width += char_width(str + i, len - i);
+
+	return width;
+}
+
+
+// Returns the number of codepoints in a string (bytes that are not continuation bytes)
+int count_codepoints(char *str) {
+	// Edge case when str is NULL
+	if (str == NULL)
+		return 0;
+
+	int count = 0;
+	for (int i = 0; str[i] != '\0'; i++)
+		if (!utf8_is_continuation(str[i]))
+			count++;
+
+	return count;
+}
+
+
+// Bytes examined per step by the ASCII fast path (one SSE2 register, or one 64-bit word)
+#ifdef __SSE2__
+#define ASCII_BLOCK 16
+#else
+#define ASCII_BLOCK 8
+#define BYTES_01 0x0101010101010101ULL
+#define BYTES_80 0x8080808080808080ULL
+#endif
+
+
+// Returns true if the ASCII_BLOCK bytes at text are all ASCII, adding their newlines and tabs
+static bool measure_ascii_block(char *text, int *newlines, int *tabs) {
+#ifdef __SSE2__
+	__m128i v = _mm_loadu_si128((const __m128i *)text);
+	if (_mm_movemask_epi8(v) != 0)
+		return false;
+	*newlines += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+	*tabs += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+	return true;
+#else
+	uint64_t w;
+	memcpy(&w, text, sizeof(w));
+	if (w & BYTES_80)
+		return false;
+
+	// With every byte below 0x80, adding 0x7F sets a byte's top bit exactly when it is non-zero
+	uint64_t nl = w ^ (BYTES_01 * '\n');
+	uint64_t tab = w ^ (BYTES_01 * '\t');
+	nl = ~(nl + BYTES_01 * 0x7F) & BYTES_80;
+	tab = ~(tab + BYTES_01 * 0x7F) & BYTES_80;
+	*newlines += (int)(((nl >> 7) * BYTES_01) >> 56);
+	*tabs += (int)(((tab >> 7) * BYTES_01) >> 56);
+	return true;
+#endif
+}
+
+
+// Returns true if the ASCII_BLOCK bytes at text are all ASCII
+static bool ascii_block(char *text) {
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)text)) == 0;
+#else
+	uint64_t w;
+	memcpy(&w, text, sizeof(w));
+	return (w & BYTES_80) == 0;
+#endif
+}
+
+
+// Counts newlines, display width, codepoints and invalid bytes of text[0..len)
+// ASCII blocks take the vector path; multibyte characters are decoded one at a time,
+// since their width depends on the codepoint. Totals match the per-byte helpers above
+void measure_text(char *text, int len, TextStats *stats) {
+	int newlines = 0, tabs = 0, ascii = 0;
+	int width = 0, chars = 0, invalid = 0;
+
+	int i = 0;
+	while (i < len) {
+		int start = i;
+		while (i + ASCII_BLOCK <= len && measure_ascii_block(text + i, &newlines, &tabs))
+			i += ASCII_BLOCK;
+		ascii += i - start;
+		if (i >= len)
+			break;
+
+		// A single character (tail of the text, or the block holding a non-ASCII byte)
+		unsigned char b = text[i];
+		if (b < 0x80) {
+			newlines += b == '\n';
+			tabs += b == '\t';
+			ascii++;
+			i++;
+		} else if (utf8_is_continuation(text[i])) {
+			// Continuation bytes of valid sequences are skipped below, so this one is stray
+			invalid++;
+			i++;
+		} else {
+			int cp;
+			int n = utf8_decode(text + i, len - i, &cp);
+			if (n == 1)
+				invalid++;
+			width += codepoint_width(cp);
+			chars++;
+			i += n;
+		}
+	}
+
+	stats->newlines = newlines;
+	stats->width = width + ascii + tabs * (TAB_WIDTH - 1);
+	stats->chars = chars + ascii;
+	stats->invalid = invalid;
+}
+
+
+// Validates text[0..len) as UTF-8 without computing widths
+// Returns the number of invalid bytes; *first is the offset of the first (-1 if none)
+int utf8_validate(char *text, int len, int *first) {
+	int invalid = 0;
+	*first = -1;
+
+	int i = 0;
+	while (i < len) {
+		while (i + ASCII_BLOCK <= len && ascii_block(text + i))
+			i += ASCII_BLOCK;
+		if (i >= len)
+			break;
+
+		int cp;
+		int n = (unsigned char)text[i] < 0x80 ? 1 : utf8_decode(text + i, len - i, &cp);
+		if (n == 1 && (unsigned char)text[i] >= 0x80) {
+			if (invalid++ == 0)
+				*first = i;
+		}
+		i += n;
+	}
+
+	return invalid;
+}
+
+
+// Returns the length of text[0..len) without a UTF-8 sequence cut off at its end
+// (the missing bytes are still to be read; a complete or invalid tail is kept)
+int utf8_complete_len(char *text, int len) {
+	int lead = len - 1;
+	while (lead > 0 && len - lead < 4 && utf8_is_continuation(text[lead]))
+		lead--;
+	if (lead >= 0 && lead + utf8_seq_len(text[lead]) > len)
+		return lead;
+	return len;
+}
+
+
+// Returns the length of the next leaf chunk of text (len bytes available)
+// At most CHUNK_SIZE bytes, shortened so that no UTF-8 sequence is cut in two
+int utf8_chunk_len(char *text, int len) {
+	if (len <= CHUNK_SIZE)
+		return len;
+
+	int n = CHUNK_SIZE;
+	while (n > CHUNK_SIZE - 3 && utf8_is_continuation(text[n]))
+		n--;
+
+	// Not valid UTF-8 here: cut at the byte limit
+	if (utf8_is_continuation(text[n]))
+		return CHUNK_SIZE;
+	return n;
+}
+
+
+// Recomputes total_len, weight, height, newlines and width of a node
 void update_metadata(RopeNode *node) {
 	// Edge case when node is NULL
 	if (node == NULL)
 		return;
 
-	// CASE 1: node = leaf node
-	if (is_leaf(node)) {
+	// CASE 1: node = cold leaf (its counts were summed from the leaves it replaced)
+	if (is_leaf(node) && node->cold) {
+		node->weight = node->total_len;
+		node->height = 1;
+	}
+
+	// CASE 2: node = leaf node
+	else if (is_leaf(node)) {
 		node->total_len = string_length(node->str);
 		node->weight = node->total_len;              // weight of a leaf node = strlen(node->str)
 
 		node->height = 1;                            // height of a leaf node is 1
 
-		node->newlines = count_newlines(node->str);  // calculates the count of newlines in node->str
+		// newlines, display columns and UTF-8 codepoints of node->str in a single pass
+		TextStats stats;
+		measure_text(node->str, node->total_len, &stats);
+		node->newlines = stats.newlines;
+		node->width = stats.width;
+		node->chars = stats.chars;
 	}
 
-	// CASE 2: node = internal node
+	// CASE 3: node = internal node
 	else {
 		// total_len of internal node = sum of total_len of left & right nodes
 		int left_len = node->left ? node->left->total_len : 0;
@@ -87,7 +408,416 @@ void update_metadata(RopeNode *node) {
 			node->newlines += node->left->newlines;
 		if (node->right)
 			node->newlines += node->right->newlines;
+
+		// width = sum of display widths of left & right nodes
+		node->width = 0;
+		if (node->left)
+			node->width += node->left->width;
+		if (node->right)
+			node->width += node->right->width;
+
+		// chars = sum of codepoint counts of left & right nodes
+		node->chars = 0;
+		if (node->left)
+			node->chars += node->left->chars;
+		if (node->right)
+			node->chars += node->right->chars;
+	}
+}
+
+
+// ========== Node allocator ==========
+
+// Nodes and leaf texts of every rope (all open buffers) come from two shared pools of
+// fixed-size slots. Slots are carved from large slabs and freed slots are kept on a free
+// list, so building and freeing leaves costs no malloc() and memory released by one rope
+// is reused by the next. Slabs are mapped directly, so the ones whose slots are all free can
+// be unmapped by pool_trim() (after compression has released a large part of a rope).
+// Not thread-safe: ropes are only built and freed on the main thread
+// (parallel loading builds each range from private pools, merged in with pool_merge())
+
+// Slots allocated at once when a pool runs dry
+#define POOL_SLAB_SLOTS 4096
+
+// A free slot (the first bytes of an unused slot link it into the free list)
+typedef struct PoolSlot {
+	struct PoolSlot *next;
+} PoolSlot;
+
+// Free list of one slot size
+typedef struct {
+	size_t slot_size;  // bytes per slot (rounded up so every slot can hold a PoolSlot)
+	PoolSlot *free;    // unused slots
+	char **slabs;      // every slab carved so far (for pool_trim())
+	int slab_count;
+	int slab_capacity;
+} Pool;
+
+#define POOL_SLOT_SIZE(n) (((n) + sizeof(PoolSlot) - 1) / sizeof(PoolSlot) * sizeof(PoolSlot))
+
+static Pool node_pool = { POOL_SLOT_SIZE(sizeof(RopeNode)), NULL, NULL, 0, 0 };
+static Pool text_pool = { POOL_SLOT_SIZE(CHUNK_SIZE + 1), NULL, NULL, 0, 0 };
+
+// A leaf text (or a cold leaf's block) freed while a snapshot may still be reading it
+typedef struct {
+	char *text;
+	int len;
+	ColdBlock *cold;  // Set instead of text for a cold block
+} DeferredText;
+
+// Snapshots alive (see rope_snapshot_init); while any is, freed leaf texts and blocks wait here
+static int snapshot_pins = 0;
+static DeferredText *deferred_texts = NULL;
+static int deferred_count = 0;
+static int deferred_capacity = 0;
+
+
+// Takes a slot from the pool, carving a new slab if the free list is empty
+static void *pool_alloc(Pool *pool) {
+	if (pool->free == NULL) {
+		char *slab = mmap(NULL, pool->slot_size * POOL_SLAB_SLOTS, PROT_READ | PROT_WRITE,
+		                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (slab == MAP_FAILED) {
+			perror("mmap");
+			exit(EXIT_FAILURE);
+		}
+		if (pool->slab_count == pool->slab_capacity) {
+			pool->slab_capacity = pool->slab_capacity ? pool->slab_capacity * 2 : 64;
+			pool->slabs = realloc(pool->slabs, pool->slab_capacity * sizeof(char *));
+			if (pool->slabs == NULL) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		pool->slabs[pool->slab_count++] = slab;
+		for (int i = POOL_SLAB_SLOTS - 1; i >= 0; i--) {
+			PoolSlot *slot = (PoolSlot *)(slab + i * pool->slot_size);
+			slot->next = pool->free;
+			pool->free = slot;
+		}
+	}
+
+	PoolSlot *slot = pool->free;
+	pool->free = slot->next;
+	return slot;
+}
+
+
+// Returns a slot to the pool
+static void pool_free(Pool *pool, void *ptr) {
+	PoolSlot *slot = ptr;
+	slot->next = pool->free;
+	pool->free = slot;
+}
+
+
+// Moves the free slots and the slabs of a private pool (same slot size) into a shared one
+// Slots in use stay valid: their slab now belongs to 'into', so they are freed into it later
+static void pool_merge(Pool *into, Pool *from) {
+	for (int i = 0; i < from->slab_count; i++) {
+		if (into->slab_count == into->slab_capacity) {
+			into->slab_capacity = into->slab_capacity ? into->slab_capacity * 2 : 64;
+			into->slabs = realloc(into->slabs, into->slab_capacity * sizeof(char *));
+			if (into->slabs == NULL) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		into->slabs[into->slab_count++] = from->slabs[i];
+	}
+	free(from->slabs);
+	from->slabs = NULL;
+	from->slab_count = from->slab_capacity = 0;
+
+	if (from->free == NULL)
+		return;
+
+	PoolSlot *last = from->free;
+	while (last->next)
+		last = last->next;
+	last->next = into->free;
+	into->free = from->free;
+	from->free = NULL;
+}
+
+
+// Orders slabs by address (for the binary search in pool_slab_of())
+static int pool_slab_compare(const void *a, const void *b) {
+	char *x = *(char * const *)a;
+	char *y = *(char * const *)b;
+	return x < y ? -1 : x > y;
+}
+
+
+// Index of the slab holding a slot (slabs sorted by address)
+static int pool_slab_of(Pool *pool, void *slot) {
+	int lo = 0;
+	int hi = pool->slab_count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if ((char *)slot >= pool->slabs[mid])
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+
+// Unmaps the slabs whose slots are all on the free list
+// One pass counts free slots per slab, a second drops the slots of empty slabs from the list
+static void pool_trim(Pool *pool) {
+	if (pool->slab_count == 0 || pool->free == NULL)
+		return;
+
+	qsort(pool->slabs, pool->slab_count, sizeof(char *), pool_slab_compare);
+	int *free_slots = calloc(pool->slab_count, sizeof(int));
+	if (free_slots == NULL) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (PoolSlot *slot = pool->free; slot; slot = slot->next)
+		free_slots[pool_slab_of(pool, slot)]++;
+
+	int empty = 0;
+	for (int i = 0; i < pool->slab_count; i++)
+		if (free_slots[i] == POOL_SLAB_SLOTS)
+			empty++;
+	if (empty > 0) {
+		PoolSlot **link = &pool->free;
+		while (*link) {
+			if (free_slots[pool_slab_of(pool, *link)] == POOL_SLAB_SLOTS)
+				*link = (*link)->next;
+			else
+				link = &(*link)->next;
+		}
+
+		int kept = 0;
+		for (int i = 0; i < pool->slab_count; i++) {
+			if (free_slots[i] == POOL_SLAB_SLOTS)
+				munmap(pool->slabs[i], pool->slot_size * POOL_SLAB_SLOTS);
+			else
+				pool->slabs[kept++] = pool->slabs[i];
+		}
+		pool->slab_count = kept;
+	}
+	free(free_slots);
+}
+
+
+// Allocates a zeroed rope node from pool
+static RopeNode *node_alloc_from(Pool *pool) {
+	RopeNode *node = pool_alloc(pool);
+	memset(node, 0, sizeof(RopeNode));
+	return node;
+}
+
+
+// Allocates a zeroed rope node
+static RopeNode *node_alloc(void) {
+	return node_alloc_from(&node_pool);
+}
+
+
+// Allocates room for a leaf text of len bytes plus the terminator, from pool
+// Leaves hold at most CHUNK_SIZE bytes; longer texts (only from direct create_leaf() calls) use malloc
+static char *leaf_text_alloc_from(Pool *pool, int len) {
+	if (len <= CHUNK_SIZE)
+		return pool_alloc(pool);
+
+	char *text = malloc(len + 1);
+	if (text == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	return text;
+}
+
+
+// Sets a leaf text or a cold block aside until no snapshot is alive
+static void defer_free(char *text, int len, ColdBlock *cold) {
+	if (deferred_count == deferred_capacity) {
+		deferred_capacity = deferred_capacity ? deferred_capacity * 2 : 1024;
+		deferred_texts = realloc(deferred_texts, deferred_capacity * sizeof(DeferredText));
+		if (deferred_texts == NULL) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	deferred_texts[deferred_count].text = text;
+	deferred_texts[deferred_count].len = len;
+	deferred_texts[deferred_count].cold = cold;
+	deferred_count++;
+}
+
+
+// Frees a leaf text of len bytes allocated by leaf_text_alloc_from()
+// While a snapshot is alive the text is only set aside (another thread may be reading it)
+static void leaf_text_free(char *text, int len) {
+	if (text == NULL)
+		return;
+	if (snapshot_pins > 0) {
+		defer_free(text, len, NULL);
+		return;
+	}
+	if (len <= CHUNK_SIZE)
+		pool_free(&text_pool, text);
+	else
+		free(text);
+}
+
+
+// Frees the block of a cold leaf (set aside like a leaf text while a snapshot is alive)
+static void cold_block_free(ColdBlock *cold) {
+	if (cold == NULL)
+		return;
+	if (snapshot_pins > 0)
+		defer_free(NULL, 0, cold);
+	else
+		free(cold);
+}
+
+
+// Frees a node and, for a leaf, its text or cold block
+static void node_free(RopeNode *node) {
+	if (is_leaf(node)) {
+		leaf_text_free(node->str, node->total_len);
+		cold_block_free(node->cold);
+	}
+	pool_free(&node_pool, node);
+}
+
+
+// Creates a leaf holding a copy of text[0..len) from the given pools (text need not be NUL-terminated)
+static RopeNode *create_leaf_in(Pool *nodes, Pool *texts, char *text, int len) {
+	RopeNode *node = node_alloc_from(nodes);
+	node->str = leaf_text_alloc_from(texts, len);
+	memcpy(node->str, text, len);
+	node->str[len] = '\0';
+	update_metadata(node);
+	return node;
+}
+
+
+// Creates a leaf holding a copy of text[0..len) (text need not be NUL-terminated)
+static RopeNode *create_leaf_n(char *text, int len) {
+	return create_leaf_in(&node_pool, &text_pool, text, len);
+}
+
+
+// ========== Cold leaves ==========
+
+// A cold leaf stands for a stretch of about COLD_BLOCK_SIZE bytes of ordinary leaves: one node
+// with the stretch's summed counts (so navigation passes it without reading it) and one block
+// with its text, compressed unless that saves little. The text is decompressed on access into
+// a small per-thread cache (pool threads read cold leaves too, e.g. in parallel searches), and
+// an edit inside a cold leaf thaws it back into ordinary leaves
+
+// Blocks that compress to more than this fraction of their size (in eighths) are stored as they are
+#define COLD_STORE_EIGHTHS 7
+
+struct ColdBlock {
+	unsigned long id;  // Names the block in the caches (a freed block's address can come back)
+	int len;           // Bytes of text
+	int size;          // Bytes in data
+	bool compressed;   // False: data is the text itself, NUL-terminated
+	char data[];
+};
+
+// Decompressed block kept by one thread
+typedef struct {
+	unsigned long id;  // 0 = empty
+	char *text;        // len + 1 bytes (NUL-terminated)
+	int capacity;
+} ColdCacheEntry;
+
+// One thread's decompressed blocks, most recently used first
+typedef struct {
+	ColdCacheEntry entries[COLD_CACHE_BLOCKS];
+} ColdCache;
+
+static pthread_key_t cold_cache_key;
+static pthread_once_t cold_cache_once = PTHREAD_ONCE_INIT;
+
+// Id of the next block made into a cold leaf (blocks are installed on the main thread only)
+static unsigned long cold_next_id = 1;
+
+
+// Frees a thread's cache when the thread exits
+static void cold_cache_destroy(void *ptr) {
+	ColdCache *cache = ptr;
+	for (int i = 0; i < COLD_CACHE_BLOCKS; i++)
+		free(cache->entries[i].text);
+	free(cache);
+}
+
+
+// Creates the key of the per-thread caches (once)
+static void cold_cache_key_create(void) {
+	if (pthread_key_create(&cold_cache_key, cold_cache_destroy) != 0) {
+		perror("pthread_key_create");
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+// Returns the calling thread's cache, creating it on first use
+static ColdCache *cold_cache(void) {
+	pthread_once(&cold_cache_once, cold_cache_key_create);
+	ColdCache *cache = pthread_getspecific(cold_cache_key);
+	if (cache == NULL) {
+		cache = calloc(1, sizeof(ColdCache));
+		if (cache == NULL) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		pthread_setspecific(cold_cache_key, cache);
+	}
+	return cache;
+}
+
+
+// Returns the text of a cold block, decompressing it into the least recently used cache entry
+// unless this thread has it already
+static char *cold_text(ColdBlock *cold) {
+	if (!cold->compressed)
+		return cold->data;
+
+	ColdCache *cache = cold_cache();
+	int slot = 0;
+	while (slot < COLD_CACHE_BLOCKS - 1 && cache->entries[slot].id != cold->id)
+		slot++;
+
+	ColdCacheEntry entry = cache->entries[slot];
+	if (entry.id != cold->id) {
+		if (entry.capacity < cold->len + 1) {
+			entry.capacity = cold->len + 1;
+			entry.text = realloc(entry.text, entry.capacity);
+			if (entry.text == NULL) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (!decompress_block(cold->data, cold->size, entry.text, cold->len)) {
+			fprintf(stderr, "cold block %lu is corrupt\n", cold->id);
+			exit(EXIT_FAILURE);
+		}
+		entry.text[cold->len] = '\0';
+		entry.id = cold->id;
 	}
+
+	// Move to the front
+	memmove(&cache->entries[1], &cache->entries[0], slot * sizeof(ColdCacheEntry));
+	cache->entries[0] = entry;
+	return entry.text;
+}
+
+
+// Returns the text of a leaf (a cold leaf's is decompressed)
+char *rope_leaf_text(RopeNode *leaf) {
+	if (leaf->cold)
+		return cold_text(leaf->cold);
+	return leaf->str;
 }
 
 
@@ -129,18 +859,8 @@ char *substr(char *start, int n) {
 
 // Allocates a new rope node, sets metadata and returns it
 RopeNode *create_leaf(char *text) {
-	RopeNode *node = calloc(1, sizeof(RopeNode));	
-	// If calloc fails
-	if (node == NULL) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
-	}
-
-	// Set metadata
-	node->str = string_copy(text);  // allocates & copies text into node->str
-	update_metadata(node);          // update the metadata of the node
-
-	return node;
+	// Copies text into a pooled leaf and sets its metadata
+	return create_leaf_n(text, string_length(text));
 }
 
 
@@ -161,13 +881,7 @@ RopeNode *concat(RopeNode *left_subtree, RopeNode *right_subtree) {
 	// Create a new parent node and attach left & right subtree as its children
 	if (skew >= -1 && skew <= 1) {
 		// Create an internal node whose children would be left & right
-		RopeNode *node = calloc(1, sizeof(RopeNode));
-
-		// If calloc fails
-		if (node == NULL) {
-			perror("calloc");
-			exit(EXIT_FAILURE);
-		}
+		RopeNode *node = node_alloc();
 
 		// Update the new internal/parent node
 		node->left = left_subtree;
@@ -215,6 +929,10 @@ RopeNode *concat(RopeNode *left_subtree, RopeNode *right_subtree) {
 }
 
 
+// Turns a cold leaf back into ordinary leaves (see the cold leaves section below)
+static RopeNode *cold_thaw(RopeNode *leaf);
+
+
 // Splits a tree into two parts at a given index recursively and concatenates to rebuild the trees
 // 'left' and 'right' are the resulting subtrees
 void split(RopeNode *node, int idx, RopeNode **left, RopeNode **right) {
@@ -227,7 +945,13 @@ void split(RopeNode *node, int idx, RopeNode **left, RopeNode **right) {
 
 	// BASE CASE: node is a leaf node
 	if (is_leaf(node)) {
-		int len = string_length(node->str);
+		int len = node->total_len;
+
+		// A cut inside a cold leaf thaws it into ordinary leaves first (only the cut one is copied again)
+		if (node->cold && idx > 0 && idx < len) {
+			split(cold_thaw(node), idx, left, right);
+			return;
+		}
 
 		// Everything to the right
 		if (idx <= 0) {
@@ -243,24 +967,24 @@ void split(RopeNode *node, int idx, RopeNode **left, RopeNode **right) {
 
 		// Split the leaf into two leaves
 		else {
-			// Slicing the leaf
-			char *left_part = substr(node->str, idx);
-			char *right_part = substr(node->str + idx, len - idx);
-
 			// Creating new leaves with the slices
-			*left = create_leaf(left_part);
-			*right = create_leaf(right_part);
+			*left = create_leaf_n(node->str, idx);
+			*right = create_leaf_n(node->str + idx, len - idx);
 
 			// Free memory
-			free(left_part);
-			free(right_part);
-			free(node->str);
-			free(node);
+			node_free(node);
 		}
 
 		return;
 	}
 
+	// Detach children from the node that is about to be freed
+	// (stale parent pointers would be followed by later rotations)
+	if (node->left)
+		node->left->parent = NULL;
+	if (node->right)
+		node->right->parent = NULL;
+
 	// CASE-1: required index is in the left subtree
 	if (idx < node->weight) {
 		RopeNode *L;  // left split of the left subtree
@@ -292,7 +1016,7 @@ void split(RopeNode *node, int idx, RopeNode **left, RopeNode **right) {
 	}
 
 	// Free the old internal node
-	free(node);
+	node_free(node);
 }
 
 
@@ -306,11 +1030,11 @@ RopeNode *build_rope(char *text) {
 	RopeNode *root = NULL;
 
 	// Iteratively create leaves and concatenate to the root
-	for (int i = 0; i < len; i += CHUNK_SIZE) {
-		char *buffer = substr(text + i, CHUNK_SIZE);  // copies a substring
-		RopeNode *leaf = create_leaf(buffer);         // creates a leaf
+	// (chunks never cut a UTF-8 sequence, so leaves always hold whole characters)
+	for (int i = 0, n; i < len; i += n) {
+		n = utf8_chunk_len(text + i, len - i);        // chunk length
+		RopeNode *leaf = create_leaf_n(text + i, n);  // creates a leaf with a copy of the chunk
 		root = concat(root, leaf);                    // concatenate with root
-		free(buffer);                                 // free the substring
 	}
 
 	// Return the root of the rope
@@ -333,6 +1057,9 @@ RopeNode *insert_at(RopeNode *root, int idx, char *text) {
 	else if (idx > root->total_len)
 		idx = root->total_len;
 
+	// Never split inside a UTF-8 sequence
+	idx = rope_char_start(root, idx);
+
 	// Split the rope
 	RopeNode *left, *right;
 	split(root, idx, &left, &right);
@@ -369,6 +1096,13 @@ RopeNode *delete_at(RopeNode *root, int start, int len) {
 	if (start + len > root->total_len)
 		len = root->total_len - start;
 
+	// Round both ends down to character boundaries (never split inside a UTF-8 sequence)
+	int end = rope_char_start(root, start + len);
+	start = rope_char_start(root, start);
+	len = end - start;
+	if (len <= 0)
+		return root;
+
 	// Split at 'start' -> left + mid
 	RopeNode *left = NULL;
 	RopeNode *mid = NULL;
@@ -401,43 +1135,8 @@ void free_rope(RopeNode *root) {
 	free_rope(root->left);
 	free_rope(root->right);
 
-	// Free string if root is leaf
-	if (root->str != NULL)
-		free(root->str);
-
-	// Set everything to NULL
-	root->left = NULL;
-	root->right = NULL;
-	root->parent = NULL;
-	root->str = NULL;
-
-	// Free the node
-	free(root);
-}
-
-
-// Loads the file into a rope
-RopeNode *load_file(char *filename) {
-	FILE *fp = fopen(filename, "r");  // open the file in read mode
-	// Error handling
-	if (!fp) {
-        perror("Error opening file");
-        return NULL;
-    }
-
-    RopeNode *root = NULL;              // root of the whole rope
-    char buffer[CHUNK_SIZE + 1] = {0};  // buffer to read chunks (of fixed size) from the file
-
-	// Read the file in chunks [fread() loads the chunk of text into buffer]
-	int n;
-	while ((n = fread(buffer, 1, CHUNK_SIZE, fp)) > 0) {  // fread() returns the number of characters that were read
-		buffer[n] = '\0';                                 // terminate buffer with null character
-		RopeNode *leaf = create_leaf(buffer);             // create a leaf with the buffer
-		root = concat(root, leaf);                        // append the leaf to the tree
-    }
-
-    fclose(fp);
-    return root;
+	// Free the node (and its string if root is a leaf)
+	node_free(root);
 }
 
 
@@ -447,10 +1146,11 @@ void write_rope_to_file(RopeNode *node, FILE *fp) {
 	if (node == NULL)
 		return;
 
-	// Base condition-2: leaf is reached
+	// Base condition-2: leaf is reached (a cold one is decompressed)
 	if (is_leaf(node)) {
-		if (node->str != NULL)
-			fprintf(fp, "%s", node->str);     // appends the string to the file
+		char *str = rope_leaf_text(node);
+		if (str != NULL)
+			fprintf(fp, "%s", str);           // appends the string to the file
 		return;
 	}
 
@@ -663,7 +1363,7 @@ void print_text(RopeNode *node) {
 
 	// CASE 1: node = leaf node
 	if (is_leaf(node))
-		printf("%s", node->str);
+		printf("%s", rope_leaf_text(node));
 
 	// CASE 2: node = internal node
 	else {
@@ -702,8 +1402,8 @@ void print_tree_rec(RopeNode *node, int depth, char branch) {
 		printf("R── ");
 
 	// Print node metadata
-	printf("[%p] h=%d w=%d len=%d nl=%d ",
-		   (void *)node, node->height, node->weight, node->total_len, node->newlines);
+	printf("[%p] h=%d w=%d len=%d nl=%d dw=%d ",
+		   (void *)node, node->height, node->weight, node->total_len, node->newlines, node->width);
 
 	// Leaf preview
 	if (node->str != NULL) {
@@ -718,6 +1418,9 @@ void print_tree_rec(RopeNode *node, int depth, char branch) {
 			printf("...");
 		printf("\" ");
 	}
+	else if (node->cold != NULL) {
+		printf("cold ");
+	}
 
 	// Parent pointer
 	printf(" parent=%p\n", (void *)node->parent);
@@ -736,8 +1439,8 @@ char char_at(RopeNode *root, int idx) {
 
 	// BASE CASE
     if (is_leaf(root)) {
-        if (idx < string_length(root->str))
-            return root->str[idx];
+        if (idx < root->total_len)
+            return rope_leaf_text(root)[idx];
         return '\0';
     }
 
@@ -760,9 +1463,10 @@ int find_newline_pos(RopeNode *root, int newline_idx, int offset) {
 
     if (is_leaf(root)) {
         // Search through leaf for the newline
+        char *str = rope_leaf_text(root);
         int count = 0;
-        for (int i = 0; root->str[i] != '\0'; i++) {
-            if (root->str[i] == '\n') {
+        for (int i = 0; str[i] != '\0'; i++) {
+            if (str[i] == '\n') {
                 if (count == newline_idx)
                     return offset + i;
                 count++;
@@ -848,3 +1552,1878 @@ int count_total_lines(RopeNode *root) {
         return 1;
     return root->newlines + 1;
 }
+
+
+// Get line number containing a character index - O(log n)
+// Counts the newlines before idx using the newlines metadata
+int get_line_from_pos(RopeNode *root, int idx) {
+    if (root == NULL || idx <= 0)
+        return 0;
+
+    // Every newline lies before the end of the rope
+    if (idx >= root->total_len)
+        return root->newlines;
+
+    // BASE CASE: count newlines in the leaf before idx
+    if (is_leaf(root)) {
+        char *str = rope_leaf_text(root);
+        int count = 0;
+        for (int i = 0; i < idx && str[i] != '\0'; i++)
+            if (str[i] == '\n')
+                count++;
+        return count;
+    }
+
+    // Index in left subtree: right subtree doesn't contribute
+    if (idx < root->weight)
+        return get_line_from_pos(root->left, idx);
+
+    // Index in right subtree: all newlines of the left subtree come before it
+    int left_newlines = root->left ? root->left->newlines : 0;
+    return left_newlines + get_line_from_pos(root->right, idx - root->weight);
+}
+
+
+// Get display width of all text before idx - O(log n)
+// Display column of idx within its line = offset(idx) - offset(line start)
+int get_display_offset(RopeNode *root, int idx) {
+    if (root == NULL || idx <= 0)
+        return 0;
+
+    if (idx >= root->total_len)
+        return root->width;
+
+    // BASE CASE: sum widths in the leaf before idx
+    if (is_leaf(root)) {
+        char *str = rope_leaf_text(root);
+        int width = 0;
+        for (int i = 0; i < idx && str[i] != '\0'; i++)
+            width += char_width(str + i, root->total_len - i);
+        return width;
+    }
+
+    // Index in left subtree
+    if (idx < root->weight)
+        return get_display_offset(root->left, idx);
+
+    // Index in right subtree: the whole left subtree comes before it
+    int left_width = root->left ? root->left->width : 0;
+    return left_width + get_display_offset(root->right, idx - root->weight);
+}
+
+
+// Get index of the character covering display offset target - O(log n)
+// A target inside a tab maps to the tab itself; past the end maps to total_len
+int find_display_offset(RopeNode *root, int target) {
+    if (root == NULL || target <= 0)
+        return 0;
+
+    if (target >= root->width)
+        return root->total_len;
+
+    // BASE CASE: walk the leaf until the character covering target
+    if (is_leaf(root)) {
+        char *str = rope_leaf_text(root);
+        int width = 0;
+        for (int i = 0; str[i] != '\0'; i++) {
+            width += char_width(str + i, root->total_len - i);
+            if (width > target)
+                return i;
+        }
+        return root->total_len;
+    }
+
+    // Target in left subtree
+    int left_width = root->left ? root->left->width : 0;
+    if (target < left_width)
+        return find_display_offset(root->left, target);
+
+    // Target in right subtree: skip the whole left subtree
+    return root->weight + find_display_offset(root->right, target - left_width);
+}
+
+
+// Get number of codepoints before idx - O(log n)
+// Codepoint column of idx within its line = offset(idx) - offset(line start)
+int get_char_offset(RopeNode *root, int idx) {
+    if (root == NULL || idx <= 0)
+        return 0;
+
+    if (idx >= root->total_len)
+        return root->chars;
+
+    // BASE CASE: count lead bytes in the leaf before idx
+    if (is_leaf(root)) {
+        char *str = rope_leaf_text(root);
+        int count = 0;
+        for (int i = 0; i < idx && str[i] != '\0'; i++)
+            if (!utf8_is_continuation(str[i]))
+                count++;
+        return count;
+    }
+
+    // Index in left subtree
+    if (idx < root->weight)
+        return get_char_offset(root->left, idx);
+
+    // Index in right subtree: the whole left subtree comes before it
+    int left_chars = root->left ? root->left->chars : 0;
+    return left_chars + get_char_offset(root->right, idx - root->weight);
+}
+
+
+// Get byte index of codepoint number target (inverse of get_char_offset) - O(log n)
+// Past the end maps to total_len
+int find_char_offset(RopeNode *root, int target) {
+    if (root == NULL || target <= 0)
+        return 0;
+
+    if (target >= root->chars)
+        return root->total_len;
+
+    // BASE CASE: walk the leaf to the lead byte of codepoint target
+    if (is_leaf(root)) {
+        char *str = rope_leaf_text(root);
+        int count = 0;
+        for (int i = 0; str[i] != '\0'; i++) {
+            if (utf8_is_continuation(str[i]))
+                continue;
+            if (count == target)
+                return i;
+            count++;
+        }
+        return root->total_len;
+    }
+
+    // Target in left subtree
+    int left_chars = root->left ? root->left->chars : 0;
+    if (target < left_chars)
+        return find_char_offset(root->left, target);
+
+    // Target in right subtree: skip the whole left subtree
+    return root->weight + find_char_offset(root->right, target - left_chars);
+}
+
+
+// Decodes the character starting at idx (it may span leaves)
+// Returns its length in bytes and stores the codepoint in *cp
+static int rope_decode_at(RopeNode *root, int idx, int *cp) {
+    char buf[4];
+    int n = 0;
+    while (n < 4 && idx + n < root->total_len) {
+        buf[n] = char_at(root, idx + n);
+        n++;
+    }
+    return utf8_decode(buf, n, cp);
+}
+
+
+// Get start of the UTF-8 sequence containing idx (idx itself if it is a boundary)
+int rope_char_start(RopeNode *root, int idx) {
+    if (root == NULL || idx <= 0)
+        return 0;
+    if (idx >= root->total_len)
+        return root->total_len;
+
+    // A sequence is at most 4 bytes, so look back at most 3 continuation bytes
+    int start = idx;
+    while (start > 0 && idx - start < 3 && utf8_is_continuation(char_at(root, start)))
+        start--;
+
+    // Only a lead byte whose sequence reaches idx makes it a boundary
+    int cp;
+    if (start < idx && start + rope_decode_at(root, start, &cp) > idx)
+        return start;
+    return idx;
+}
+
+
+// Get index just past the character at idx
+// The character includes any zero-width combining marks that follow its base
+int rope_next_char(RopeNode *root, int idx) {
+    if (root == NULL || idx >= root->total_len)
+        return root ? root->total_len : 0;
+
+    int cp;
+    int next = idx + rope_decode_at(root, idx, &cp);
+    if (cp == '\n')
+        return next;
+
+    while (next < root->total_len) {
+        int len = rope_decode_at(root, next, &cp);
+        if (cp == '\n' || codepoint_width(cp) != 0)
+            break;
+        next += len;
+    }
+    return next;
+}
+
+
+// Get start of the character before idx (a base character together with its combining marks)
+int rope_prev_char(RopeNode *root, int idx) {
+    if (root == NULL || idx <= 0)
+        return 0;
+
+    int cp;
+    int prev = rope_char_start(root, idx - 1);
+    while (prev > 0) {
+        rope_decode_at(root, prev, &cp);
+        if (codepoint_width(cp) != 0)
+            break;
+
+        // Combining marks at the start of a line have no base to attach to
+        int before = rope_char_start(root, prev - 1);
+        rope_decode_at(root, before, &cp);
+        if (cp == '\n')
+            break;
+        prev = before;
+    }
+    return prev;
+}
+
+
+// Positions the iterator on the leaf containing idx (idx is clamped to the rope)
+// Right subtrees skipped on the way down are stacked for rope_iter_next()
+void rope_iter_init(RopeIter *it, RopeNode *root, int idx) {
+    it->depth = 0;
+    it->leaf = NULL;
+    it->leaf_start = 0;
+
+    if (root == NULL)
+        return;
+
+    if (idx < 0)
+        idx = 0;
+
+    RopeNode *node = root;
+    while (!is_leaf(node)) {
+        if (idx < node->weight && node->left) {
+            // Going left: the right subtree is visited later
+            if (node->right)
+                it->stack[it->depth++] = node->right;
+            node = node->left;
+        }
+        else {
+            // Going right: skip over the left subtree
+            idx -= node->weight;
+            it->leaf_start += node->weight;
+            node = node->right;
+        }
+    }
+
+    it->leaf = node;
+}
+
+
+// Moves the iterator to the next leaf in order
+// Returns false (and sets leaf to NULL) once the last leaf has been visited
+bool rope_iter_next(RopeIter *it) {
+    if (it->leaf == NULL)
+        return false;
+
+    it->leaf_start += it->leaf->total_len;
+
+    // No right subtree pending: iteration is over
+    if (it->depth == 0) {
+        it->leaf = NULL;
+        return false;
+    }
+
+    // Descend to the leftmost leaf of the next pending subtree
+    RopeNode *node = it->stack[--it->depth];
+    while (!is_leaf(node)) {
+        if (node->left) {
+            if (node->right)
+                it->stack[it->depth++] = node->right;
+            node = node->left;
+        }
+        else {
+            node = node->right;
+        }
+    }
+
+    it->leaf = node;
+    return true;
+}
+
+
+// Positions a backward iterator on the leaf containing idx - 1 (the character before idx)
+// Left subtrees skipped on the way down are stacked for rope_iter_prev()
+void rope_iter_init_back(RopeIter *it, RopeNode *root, int idx) {
+	it->depth = 0;
+	it->leaf = NULL;
+	it->leaf_start = 0;
+
+	if (root == NULL || idx <= 0)
+		return;
+
+	if (idx > root->total_len)
+		idx = root->total_len;
+
+	// Descend towards the character at idx - 1
+	int target = idx - 1;
+	RopeNode *node = root;
+	while (!is_leaf(node)) {
+		if (target >= node->weight && node->right) {
+			// Going right: the left subtree is visited later
+			if (node->left)
+				it->stack[it->depth++] = node->left;
+			target -= node->weight;
+			it->leaf_start += node->weight;
+			node = node->right;
+		}
+		else {
+			node = node->left;
+		}
+	}
+
+	it->leaf = node;
+}
+
+
+// Moves a backward iterator to the previous leaf
+// Returns false (and sets leaf to NULL) once the first leaf has been visited
+bool rope_iter_prev(RopeIter *it) {
+	if (it->leaf == NULL)
+		return false;
+
+	// No left subtree pending: iteration is over
+	if (it->depth == 0) {
+		it->leaf = NULL;
+		return false;
+	}
+
+	// Descend to the rightmost leaf of the next pending subtree
+	RopeNode *node = it->stack[--it->depth];
+	while (!is_leaf(node)) {
+		if (node->right) {
+			if (node->left)
+				it->stack[it->depth++] = node->left;
+			node = node->right;
+		}
+		else {
+			node = node->left;
+		}
+	}
+
+	it->leaf = node;
+	it->leaf_start -= node->total_len;
+	return true;
+}
+
+
+// Returns the position of the first '\n' at or after idx by scanning leaves with memchr
+// Cost is proportional to the distance scanned, not to the size of the rope
+int rope_find_newline(RopeNode *root, int idx) {
+    if (root == NULL)
+        return 0;
+    if (idx < 0)
+        idx = 0;
+
+    RopeIter it;
+    for (rope_iter_init(&it, root, idx); it.leaf != NULL; rope_iter_next(&it)) {
+        // Skip the part of the first leaf before idx
+        int from = idx > it.leaf_start ? idx - it.leaf_start : 0;
+        int len = it.leaf->total_len;
+        if (from >= len)
+            continue;
+
+        char *str = rope_leaf_text(it.leaf);
+        char *hit = memchr(str + from, '\n', len - from);
+        if (hit != NULL)
+            return it.leaf_start + (int)(hit - str);
+    }
+
+    return root->total_len;
+}
+
+
+// Returns the position of the '\n' ending the line that contains idx (rope length if none)
+// Descends by newline counts instead of scanning, so a multi-megabyte line costs O(log n)
+int rope_line_end(RopeNode *root, int idx) {
+    if (root == NULL)
+        return 0;
+
+    int line = get_line_from_pos(root, idx);
+    if (line >= root->newlines)
+        return root->total_len;
+    return find_newline_pos(root, line, 0);
+}
+
+
+// Returns true if pat occurs at idx, comparing leaf by leaf without copying
+bool rope_match_at(RopeNode *root, int idx, char *pat) {
+    int len = string_length(pat);
+    if (root == NULL || idx < 0 || idx + len > root->total_len)
+        return false;
+
+    RopeIter it;
+    int matched = 0;
+    for (rope_iter_init(&it, root, idx); it.leaf != NULL && matched < len; rope_iter_next(&it)) {
+        int from = idx + matched - it.leaf_start;
+        int n = it.leaf->total_len - from;
+        if (n > len - matched)
+            n = len - matched;
+
+        if (memcmp(rope_leaf_text(it.leaf) + from, pat + matched, n) != 0)
+            return false;
+        matched += n;
+    }
+
+    return matched == len;
+}
+
+
+// Returns the position of the first occurrence of pat at or after from
+int rope_find(RopeNode *root, char *pat, int from) {
+    if (root == NULL)
+        return -1;
+    return rope_find_range(root, pat, from, root->total_len);
+}
+
+
+// Returns the position of the first occurrence of pat starting in [from, limit)
+// memchr skips to candidates for the first byte, which are then verified in place;
+// only candidates straddling a leaf boundary fall back to rope_match_at()
+int rope_find_range(RopeNode *root, char *pat, int from, int limit) {
+    int len = string_length(pat);
+    if (root == NULL || len == 0)
+        return -1;
+    if (from < 0)
+        from = 0;
+
+    RopeIter it;
+    for (rope_iter_init(&it, root, from); it.leaf != NULL && it.leaf_start < limit; rope_iter_next(&it)) {
+        char *str = rope_leaf_text(it.leaf);
+        char *end = str + it.leaf->total_len;
+        char *p = str + (from > it.leaf_start ? from - it.leaf_start : 0);
+
+        // Only candidates starting before limit count
+        if (limit - it.leaf_start < it.leaf->total_len)
+            end = str + (limit - it.leaf_start);
+
+        while (p < end && (p = memchr(p, pat[0], end - p)) != NULL) {
+            int pos = it.leaf_start + (int)(p - str);
+
+            // Candidate fully inside this leaf: plain memcmp
+            if (p + len <= str + it.leaf->total_len) {
+                if (memcmp(p, pat, len) == 0)
+                    return pos;
+            }
+            else if (rope_match_at(root, pos, pat)) {
+                return pos;
+            }
+            p++;
+        }
+    }
+
+    return -1;
+}
+
+
+// Recursive helper for rope_rfind(): visits leaves right to left
+// offset = rope index of the first character of node
+static int rfind_rec(RopeNode *root, RopeNode *node, int offset, char *pat, int len, int before) {
+    // Subtree starts at or after the limit: nothing to find here
+    if (node == NULL || offset >= before)
+        return -1;
+
+    if (is_leaf(node)) {
+        int last = before - offset - 1;
+        if (last >= node->total_len)
+            last = node->total_len - 1;
+
+        // Scan backwards for the first byte, then verify
+        char *str = rope_leaf_text(node);
+        for (int i = last; i >= 0; i--) {
+            if (str[i] != pat[0])
+                continue;
+            if (i + len <= node->total_len ? memcmp(str + i, pat, len) == 0
+                                           : rope_match_at(root, offset + i, pat))
+                return offset + i;
+        }
+        return -1;
+    }
+
+    // Right subtree holds the later matches
+    int pos = rfind_rec(root, node->right, offset + node->weight, pat, len, before);
+    if (pos != -1)
+        return pos;
+
+    return rfind_rec(root, node->left, offset, pat, len, before);
+}
+
+
+// Returns the position of the last occurrence of pat starting before 'before'
+int rope_rfind(RopeNode *root, char *pat, int before) {
+    int len = string_length(pat);
+    if (root == NULL || len == 0)
+        return -1;
+
+    return rfind_rec(root, root, 0, pat, len, before);
+}
+
+
+// ========== Batch editing ==========
+
+// Growable array of leaves (output of rope_replace_ranges)
+typedef struct {
+    RopeNode **nodes;
+    int count;
+    int capacity;
+} LeafList;
+
+
+// Appends a leaf to the list
+static void leaf_list_push(LeafList *list, RopeNode *leaf) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->nodes = realloc(list->nodes, list->capacity * sizeof(RopeNode *));
+        if (list->nodes == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    list->nodes[list->count++] = leaf;
+}
+
+
+// Turns text[0..len) into CHUNK_SIZE leaves from the given pools appended to the list
+// (text is not NUL-terminated, so chunks are copied with create_leaf_in())
+static void leaf_list_push_text_in(LeafList *list, Pool *nodes, Pool *texts, char *text, int len) {
+    for (int i = 0, n; i < len; i += n) {
+        n = utf8_chunk_len(text + i, len - i);
+        leaf_list_push(list, create_leaf_in(nodes, texts, text + i, n));
+    }
+}
+
+
+// Turns text[0..len) into CHUNK_SIZE leaves appended to the list
+static void leaf_list_push_text(LeafList *list, char *text, int len) {
+    leaf_list_push_text_in(list, &node_pool, &text_pool, text, len);
+}
+
+
+// Appends n bytes to a growable text buffer
+static void text_append(char **buf, int *len, int *cap, char *src, int n) {
+    if (*len + n > *cap) {
+        while (*len + n > *cap)
+            *cap = *cap ? *cap * 2 : 256;
+        *buf = realloc(*buf, *cap);
+        if (*buf == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(*buf + *len, src, n);
+    *len += n;
+}
+
+
+// Frees the internal nodes of a tree, leaving its leaves alive
+static void free_internal_nodes(RopeNode *node) {
+    if (node == NULL || is_leaf(node))
+        return;
+    free_internal_nodes(node->left);
+    free_internal_nodes(node->right);
+    node_free(node);
+}
+
+
+// Builds a perfectly balanced tree over leaves[0..count) in O(count), with internal nodes from pool
+static RopeNode *build_tree_in(Pool *pool, RopeNode **leaves, int count) {
+    if (count == 0)
+        return NULL;
+    if (count == 1) {
+        leaves[0]->parent = NULL;
+        return leaves[0];
+    }
+
+    RopeNode *node = node_alloc_from(pool);
+
+    // Halves differ by at most one leaf, so subtree heights differ by at most one (AVL holds)
+    int mid = count / 2;
+    node->left = build_tree_in(pool, leaves, mid);
+    node->right = build_tree_in(pool, leaves + mid, count - mid);
+    node->left->parent = node;
+    node->right->parent = node;
+    update_metadata(node);
+    return node;
+}
+
+
+// Builds a perfectly balanced tree over leaves[0..count) in O(count)
+RopeNode *build_rope_from_leaves(RopeNode **leaves, int count) {
+    return build_tree_in(&node_pool, leaves, count);
+}
+
+
+// Replaces every range [starts[i], ends[i]) with replacement in one pass
+// Ranges must be sorted and non-overlapping (empty ranges insert replacement)
+// Leaves no range touches are reused by pointer; the tree is rebuilt balanced
+RopeNode *rope_replace_ranges(RopeNode *root, int *starts, int *ends, int count, char *replacement) {
+    if (count == 0)
+        return root;
+
+    int rep_len = string_length(replacement);
+    LeafList out = { NULL, 0, 0 };      // Leaves of the new rope
+    LeafList spare = { NULL, 0, 0 };    // Touched leaves whose text has been consumed
+
+    // Text of touched leaves (and replacements) waiting to be cut into new leaves
+    char *pending = NULL;
+    int pending_len = 0;
+    int pending_cap = 0;
+
+    int m = 0;          // Next range to apply
+    int skip_until = 0; // End of the last applied range (bytes before it are dropped)
+
+    RopeIter it;
+    for (rope_iter_init(&it, root, 0); it.leaf; ) {
+        RopeNode *leaf = it.leaf;
+        int ls = it.leaf_start;
+        int le = ls + leaf->total_len;
+        rope_iter_next(&it);
+
+        // Untouched leaf: keep it as is
+        if (skip_until <= ls && (m == count || starts[m] >= le)) {
+            if (pending_len > 0) {
+                leaf_list_push_text(&out, pending, pending_len);
+                pending_len = 0;
+            }
+            leaf->parent = NULL;
+            leaf_list_push(&out, leaf);
+            continue;
+        }
+
+        // Copy surviving bytes and replacements into the pending text
+        char *str = rope_leaf_text(leaf);
+        for (int i = ls; i < le; ) {
+            if (i < skip_until) {
+                i = skip_until < le ? skip_until : le;
+            } else if (m < count && starts[m] == i) {
+                text_append(&pending, &pending_len, &pending_cap, replacement, rep_len);
+                skip_until = ends[m++];
+            } else {
+                int next = (m < count && starts[m] < le) ? starts[m] : le;
+                text_append(&pending, &pending_len, &pending_cap, str + (i - ls), next - i);
+                i = next;
+            }
+        }
+
+        leaf_list_push(&spare, leaf);
+    }
+
+    // Ranges at the very end of the text (empty matches)
+    while (m < count) {
+        text_append(&pending, &pending_len, &pending_cap, replacement, rep_len);
+        m++;
+    }
+    leaf_list_push_text(&out, pending, pending_len);
+
+    // Consumed leaves are freed only after the old tree's internal nodes (which still point at them)
+    free_internal_nodes(root);
+    for (int i = 0; i < spare.count; i++)
+        node_free(spare.nodes[i]);
+    RopeNode *result = build_rope_from_leaves(out.nodes, out.count);
+
+    free(pending);
+    free(out.nodes);
+    free(spare.nodes);
+    return result;
+}
+
+
+// ========== Snapshots ==========
+
+// Appends a span to the snapshot (text, or bytes from offset on in a cold block)
+static void snapshot_push(RopeSnapshot *snap, char *text, int len, bool owned, ColdBlock *cold, int offset) {
+    if (snap->count == snap->capacity) {
+        snap->capacity = snap->capacity ? snap->capacity * 2 : 1024;
+        snap->spans = realloc(snap->spans, snap->capacity * sizeof(SnapshotSpan));
+        if (snap->spans == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    snap->spans[snap->count].text = text;
+    snap->spans[snap->count].len = len;
+    snap->spans[snap->count].owned = owned;
+    snap->spans[snap->count].cold = cold;
+    snap->spans[snap->count].offset = offset;
+    snap->count++;
+    snap->total += len;
+}
+
+
+// Starts an empty snapshot
+// Leaf texts never change once built, so a snapshot only records pointers into them; what it
+// must prevent is their reuse, so from now until the release every freed leaf text is set aside
+void rope_snapshot_init(RopeSnapshot *snap) {
+    snap->spans = NULL;
+    snap->count = 0;
+    snap->capacity = 0;
+    snap->total = 0;
+    snapshot_pins++;
+}
+
+
+// Adds bytes [start, end) of the rope: one span per leaf, no text copied (O(leaves in range))
+// A cold leaf's span refers to its block, which the reader decompresses
+void rope_snapshot_add(RopeSnapshot *snap, RopeNode *root, int start, int end) {
+    if (root == NULL)
+        return;
+    if (start < 0)
+        start = 0;
+    if (end > root->total_len)
+        end = root->total_len;
+
+    RopeIter it;
+    for (rope_iter_init(&it, root, start); it.leaf && it.leaf_start < end; rope_iter_next(&it)) {
+        int from = start > it.leaf_start ? start - it.leaf_start : 0;
+        int to = end - it.leaf_start < it.leaf->total_len ? end - it.leaf_start : it.leaf->total_len;
+        if (to > from && it.leaf->cold)
+            snapshot_push(snap, NULL, to - from, false, it.leaf->cold, from);
+        else if (to > from)
+            snapshot_push(snap, it.leaf->str + from, to - from, false, NULL, 0);
+    }
+}
+
+
+// Adds a copy of text[0..len) (text that is not in the rope, e.g. a pending insert)
+void rope_snapshot_add_text(RopeSnapshot *snap, char *text, int len) {
+    if (len <= 0)
+        return;
+    char *copy = malloc(len);
+    if (copy == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, text, len);
+    snapshot_push(snap, copy, len, true, NULL, 0);
+}
+
+
+// Returns the text of a span; a cold leaf's block is decompressed into this thread's cache
+char *rope_snapshot_text(SnapshotSpan *span) {
+    if (span->cold)
+        return cold_text(span->cold) + span->offset;
+    return span->text;
+}
+
+
+// Frees the snapshot; once no snapshot is alive, the leaf texts set aside go back to the pool
+// (and the cold blocks set aside are freed)
+// Must run on the thread that edits ropes, after the snapshot's reader has finished
+void rope_snapshot_release(RopeSnapshot *snap) {
+    for (int i = 0; i < snap->count; i++)
+        if (snap->spans[i].owned)
+            free(snap->spans[i].text);
+    free(snap->spans);
+    snap->spans = NULL;
+    snap->count = snap->capacity = 0;
+    snap->total = 0;
+
+    if (--snapshot_pins > 0)
+        return;
+    for (int i = 0; i < deferred_count; i++) {
+        leaf_text_free(deferred_texts[i].text, deferred_texts[i].len);
+        cold_block_free(deferred_texts[i].cold);
+    }
+    free(deferred_texts);
+    deferred_texts = NULL;
+    deferred_count = deferred_capacity = 0;
+}
+
+
+// ========== Freezing ==========
+
+// Stretches shorter than this are left as they are (there is little to gain)
+#define COLD_MIN_RUN (COLD_BLOCK_SIZE / 4)
+
+// Blocks compressed by one worker pool job
+#define COLD_BATCH_BLOCKS 256
+
+// A block being frozen: the snapshot spans (one per leaf) it is made of
+typedef struct {
+    int first;        // First span
+    int count;        // Spans (leaves)
+    int len;          // Bytes
+    ColdBlock *cold;  // Compressed text, set by the job (NULL if it was cancelled first)
+} FreezeBlock;
+
+// One worker pool job: blocks [first, first + count)
+typedef struct {
+    WorkerJob job;  // Must come first: the pool hands this pointer back
+    RopeFreeze *freeze;
+    int first;
+    int count;
+} FreezeBatch;
+
+struct RopeFreeze {
+    WorkerGroup group;
+    RopeSnapshot snapshot;  // The leaves being compressed (their texts stay until the freeze ends)
+    FreezeBlock *blocks;
+    int block_count;
+    int block_capacity;
+    FreezeBatch *batches;
+    int batch_count;
+};
+
+
+// Checks whether bytes [start, start + len) overlap a hot range
+static bool freeze_is_hot(int start, int len, int hot[][2], int hot_count) {
+    for (int i = 0; i < hot_count; i++)
+        if (start < hot[i][1] && hot[i][0] < start + len)
+            return true;
+    return false;
+}
+
+
+// Ends the block being gathered: kept if long enough, otherwise its spans are dropped again
+static void freeze_close_block(RopeFreeze *freeze, FreezeBlock *block) {
+    if (block->count == 0)
+        return;
+
+    if (block->len < COLD_MIN_RUN) {
+        freeze->snapshot.count = block->first;
+        freeze->snapshot.total -= block->len;
+    } else {
+        if (freeze->block_count == freeze->block_capacity) {
+            freeze->block_capacity = freeze->block_capacity ? freeze->block_capacity * 2 : 64;
+            freeze->blocks = realloc(freeze->blocks, freeze->block_capacity * sizeof(FreezeBlock));
+            if (freeze->blocks == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        freeze->blocks[freeze->block_count++] = *block;
+    }
+    block->count = 0;
+    block->len = 0;
+}
+
+
+// Pool job: gathers each block of the batch from its leaves' texts and compresses it
+// Only reads the snapshot; the main thread installs the blocks in rope_freeze_finish()
+static void freeze_batch_worker(WorkerJob *job) {
+    FreezeBatch *batch = (FreezeBatch *)job;
+    RopeFreeze *freeze = batch->freeze;
+
+    // Blocks end once they reach COLD_BLOCK_SIZE, so one leaf more is the most they hold
+    int max = COLD_BLOCK_SIZE + CHUNK_SIZE;
+    char *text = malloc(max);
+    char *packed = malloc(compress_bound(max));
+    if (text == NULL || packed == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int b = batch->first; b < batch->first + batch->count; b++) {
+        if (worker_group_cancelled(&freeze->group))
+            break;
+
+        FreezeBlock *block = &freeze->blocks[b];
+        int len = 0;
+        for (int i = block->first; i < block->first + block->count; i++) {
+            SnapshotSpan *span = &freeze->snapshot.spans[i];
+            memcpy(text + len, span->text, span->len);
+            len += span->len;
+        }
+
+        int size = compress_block(text, len, packed);
+        bool compressed = size <= len / 8 * COLD_STORE_EIGHTHS;
+        if (!compressed)
+            size = len + 1;
+
+        ColdBlock *cold = malloc(sizeof(ColdBlock) + size);
+        if (cold == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        cold->id = 0;
+        cold->len = len;
+        cold->size = size;
+        cold->compressed = compressed;
+        if (compressed) {
+            memcpy(cold->data, packed, size);
+        } else {
+            memcpy(cold->data, text, len);
+            cold->data[len] = '\0';
+        }
+        block->cold = cold;
+        worker_group_advance(&freeze->group, len);
+    }
+
+    free(text);
+    free(packed);
+}
+
+
+// Waits for the jobs, then frees the blocks not installed, the snapshot and the freeze
+static void freeze_free(RopeFreeze *freeze) {
+    worker_group_wait(&freeze->group);
+    worker_group_free(&freeze->group);
+    for (int b = 0; b < freeze->block_count; b++)
+        free(freeze->blocks[b].cold);
+    rope_snapshot_release(&freeze->snapshot);
+    free(freeze->blocks);
+    free(freeze->batches);
+    free(freeze);
+}
+
+
+// Starts compressing every stretch of ordinary leaves outside the hot ranges
+// The stretches are cut into blocks of COLD_BLOCK_SIZE bytes (whole leaves, so no UTF-8
+// sequence is split) and queued on the worker pool COLD_BATCH_BLOCKS blocks per job
+RopeFreeze *rope_freeze_start(RopeNode *root, int hot[][2], int hot_count) {
+    RopeFreeze *freeze = calloc(1, sizeof(RopeFreeze));
+    if (freeze == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    rope_snapshot_init(&freeze->snapshot);
+
+    FreezeBlock block = { 0, 0, 0, NULL };
+    RopeIter it;
+    for (rope_iter_init(&it, root, 0); it.leaf; rope_iter_next(&it)) {
+        RopeNode *leaf = it.leaf;
+        if (leaf->cold || leaf->total_len > CHUNK_SIZE ||
+            freeze_is_hot(it.leaf_start, leaf->total_len, hot, hot_count)) {
+            freeze_close_block(freeze, &block);
+            continue;
+        }
+
+        if (block.count == 0)
+            block.first = freeze->snapshot.count;
+        snapshot_push(&freeze->snapshot, leaf->str, leaf->total_len, false, NULL, 0);
+        block.count++;
+        block.len += leaf->total_len;
+        if (block.len >= COLD_BLOCK_SIZE)
+            freeze_close_block(freeze, &block);
+    }
+    freeze_close_block(freeze, &block);
+
+    if (freeze->block_count == 0) {
+        freeze_free(freeze);
+        return NULL;
+    }
+
+    worker_group_init(&freeze->group, NULL, freeze);
+    worker_group_set_total(&freeze->group, freeze->snapshot.total);
+    freeze->batch_count = (freeze->block_count + COLD_BATCH_BLOCKS - 1) / COLD_BATCH_BLOCKS;
+    freeze->batches = calloc(freeze->batch_count, sizeof(FreezeBatch));
+    if (freeze->batches == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < freeze->batch_count; i++) {
+        FreezeBatch *batch = &freeze->batches[i];
+        batch->job.run = freeze_batch_worker;
+        batch->freeze = freeze;
+        batch->first = i * COLD_BATCH_BLOCKS;
+        batch->count = freeze->block_count - batch->first < COLD_BATCH_BLOCKS
+                           ? freeze->block_count - batch->first : COLD_BATCH_BLOCKS;
+        worker_submit(&freeze->group, &batch->job);
+    }
+    return freeze;
+}
+
+
+// Checks whether every job has finished
+bool rope_freeze_done(RopeFreeze *freeze) {
+    return worker_group_done(&freeze->group);
+}
+
+
+// Returns the percentage of the text compressed so far
+int rope_freeze_progress(RopeFreeze *freeze) {
+    return worker_group_percent(&freeze->group);
+}
+
+
+// Stops the jobs at their next block and frees the freeze
+void rope_freeze_cancel(RopeFreeze *freeze) {
+    worker_group_cancel(&freeze->group);
+    freeze_free(freeze);
+}
+
+
+// Hash table slot of a leaf text pointer
+static int freeze_slot(char *text, int bits) {
+    return (int)((uint32_t)((uintptr_t)text >> 4) * 2654435761u >> (32 - bits));
+}
+
+
+// Replaces the leaves of one block by a cold leaf holding its compressed text
+// The cold leaf's counts are the sums of the leaves' counts, so no text is measured again
+static RopeNode *freeze_install(FreezeBlock *block, RopeNode **leaves) {
+    RopeNode *node = node_alloc();
+    node->cold = block->cold;
+    node->cold->id = cold_next_id++;
+    block->cold = NULL;
+
+    for (int i = 0; i < block->count; i++) {
+        node->total_len += leaves[i]->total_len;
+        node->newlines += leaves[i]->newlines;
+        node->width += leaves[i]->width;
+        node->chars += leaves[i]->chars;
+    }
+    update_metadata(node);
+    return node;
+}
+
+
+// Installs the compressed blocks whose leaves are all still in the rope, in order
+// Edits made meanwhile replaced some leaves; their blocks are dropped. A block's leaves are
+// recognised by their text pointers: the snapshot keeps those texts from being reused
+RopeNode *rope_freeze_finish(RopeNode *root, RopeFreeze *freeze, long *frozen, long *stored) {
+    worker_group_wait(&freeze->group);
+    *frozen = 0;
+    *stored = 0;
+
+    // Blocks by the text of their first leaf (open addressing, at most half full)
+    SnapshotSpan *spans = freeze->snapshot.spans;
+    int bits = 4;
+    while ((1 << bits) < freeze->block_count * 2)
+        bits++;
+    int *slots = malloc((1 << bits) * sizeof(int));
+    if (slots == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int s = 0; s < (1 << bits); s++)
+        slots[s] = -1;
+    for (int b = 0; b < freeze->block_count; b++) {
+        int s = freeze_slot(spans[freeze->blocks[b].first].text, bits);
+        while (slots[s] != -1)
+            s = (s + 1) & ((1 << bits) - 1);
+        slots[s] = b;
+    }
+
+    LeafList out = { NULL, 0, 0 };    // Leaves of the new rope
+    LeafList run = { NULL, 0, 0 };    // Leaves matched so far of the block being followed
+    LeafList spare = { NULL, 0, 0 };  // Leaves replaced by cold leaves
+    FreezeBlock *current = NULL;
+
+    RopeIter it;
+    for (rope_iter_init(&it, root, 0); it.leaf; rope_iter_next(&it)) {
+        RopeNode *leaf = it.leaf;
+        leaf->parent = NULL;
+
+        // The next leaf of the block being followed
+        if (current) {
+            SnapshotSpan *span = &spans[current->first + run.count];
+            if (leaf->str == span->text && leaf->total_len == span->len) {
+                leaf_list_push(&run, leaf);
+                if (run.count == current->count) {
+                    leaf_list_push(&out, freeze_install(current, run.nodes));
+                    for (int i = 0; i < run.count; i++)
+                        leaf_list_push(&spare, run.nodes[i]);
+                    *frozen += current->len;
+                    *stored += out.nodes[out.count - 1]->cold->size;
+                    run.count = 0;
+                    current = NULL;
+                }
+                continue;
+            }
+
+            // An edit broke the stretch: its leaves stay as they are
+            for (int i = 0; i < run.count; i++)
+                leaf_list_push(&out, run.nodes[i]);
+            run.count = 0;
+            current = NULL;
+        }
+
+        // The first leaf of a block starts following it
+        int b = -1;
+        if (!leaf->cold)
+            for (int s = freeze_slot(leaf->str, bits); slots[s] != -1; s = (s + 1) & ((1 << bits) - 1))
+                if (spans[freeze->blocks[slots[s]].first].text == leaf->str) {
+                    b = slots[s];
+                    break;
+                }
+        if (b != -1 && freeze->blocks[b].cold) {
+            current = &freeze->blocks[b];
+            leaf_list_push(&run, leaf);
+            continue;
+        }
+
+        leaf_list_push(&out, leaf);
+    }
+    for (int i = 0; i < run.count; i++)
+        leaf_list_push(&out, run.nodes[i]);
+
+    // Replaced leaves are freed only after the old tree's internal nodes (which still point at them)
+    RopeNode *result = root;
+    if (spare.count > 0) {
+        free_internal_nodes(root);
+        for (int i = 0; i < spare.count; i++)
+            node_free(spare.nodes[i]);
+        result = build_rope_from_leaves(out.nodes, out.count);
+    }
+
+    free(slots);
+    free(out.nodes);
+    free(run.nodes);
+    free(spare.nodes);
+    freeze_free(freeze);
+
+    // The replaced leaves filled whole slabs (they were built in file order): give them back
+    if (*frozen > 0) {
+        pool_trim(&node_pool);
+        pool_trim(&text_pool);
+    }
+    return result;
+}
+
+
+// Turns a cold leaf back into a balanced subtree of ordinary leaves, freeing it
+static RopeNode *cold_thaw(RopeNode *leaf) {
+    LeafList leaves = { NULL, 0, 0 };
+    leaf_list_push_text(&leaves, rope_leaf_text(leaf), leaf->total_len);
+    RopeNode *tree = build_rope_from_leaves(leaves.nodes, leaves.count);
+    free(leaves.nodes);
+    node_free(leaf);
+    return tree;
+}
+
+
+// Replaces every cold leaf by ordinary leaves (compression turned off)
+RopeNode *rope_thaw(RopeNode *root) {
+    long bytes, stored;
+    rope_cold_stats(root, &bytes, &stored);
+    if (bytes == 0)
+        return root;
+
+    LeafList out = { NULL, 0, 0 };
+    LeafList spare = { NULL, 0, 0 };
+    RopeIter it;
+    for (rope_iter_init(&it, root, 0); it.leaf; rope_iter_next(&it)) {
+        RopeNode *leaf = it.leaf;
+        leaf->parent = NULL;
+        if (leaf->cold) {
+            leaf_list_push_text(&out, rope_leaf_text(leaf), leaf->total_len);
+            leaf_list_push(&spare, leaf);
+        } else {
+            leaf_list_push(&out, leaf);
+        }
+    }
+
+    free_internal_nodes(root);
+    for (int i = 0; i < spare.count; i++)
+        node_free(spare.nodes[i]);
+    RopeNode *result = build_rope_from_leaves(out.nodes, out.count);
+    free(out.nodes);
+    free(spare.nodes);
+    return result;
+}
+
+
+// Recursive helper for rope_cold_stats()
+static void cold_stats_rec(RopeNode *node, long *bytes, long *stored) {
+    if (node == NULL)
+        return;
+    if (node->cold) {
+        *bytes += node->total_len;
+        *stored += node->cold->size;
+    }
+    cold_stats_rec(node->left, bytes, stored);
+    cold_stats_rec(node->right, bytes, stored);
+}
+
+
+// Adds up the text in cold leaves and the size of their blocks
+void rope_cold_stats(RopeNode *root, long *bytes, long *stored) {
+    *bytes = 0;
+    *stored = 0;
+    cold_stats_rec(root, bytes, stored);
+}
+
+
+// ========== Loading ==========
+
+// Appends text[0..len) at the end of the rope (file growth in follow mode)
+// The new leaves form a balanced subtree that concat() joins along the right spine:
+// O(len + log n), and existing leaves are never split or copied
+RopeNode *rope_append(RopeNode *root, char *text, int len) {
+    LeafList leaves = { NULL, 0, 0 };
+    leaf_list_push_text(&leaves, text, len);
+
+    RopeNode *tail = build_rope_from_leaves(leaves.nodes, leaves.count);
+    free(leaves.nodes);
+    return concat(root, tail);
+}
+
+
+// Bytes hashed by the rolling hash that finds moved leaves again
+#define RELOAD_WINDOW 32
+
+// Multiplier of the rolling hash
+#define RELOAD_HASH_BASE 257u
+
+// Windows whose hash has these bits clear are anchors: leaves are indexed by their first
+// anchor, and changed text is looked up only at anchors (about one byte in 16). Anchors
+// depend on content alone, so a leaf that moved still has its anchor at the same offset
+#define RELOAD_ANCHOR_MASK 15u
+
+// Leaves sharing one anchor hash that are indexed (keeps repetitive text from going quadratic)
+#define RELOAD_MAX_SAME_HASH 8
+
+// Leaves past the expected one that are indexed when a lookup is needed; the reach grows by
+// one leaf per RELOAD_LOOKAHEAD_GROWTH unmatched bytes, so long deletions are found again
+#define RELOAD_LOOKAHEAD 1024
+#define RELOAD_LOOKAHEAD_GROWTH 16
+
+// Unmatched bytes after which the rest of the region is taken as new text
+// (bounds a rewritten file to roughly the cost of loading it)
+#define RELOAD_GIVE_UP (1 << 20)
+
+// Index of leaves by the hash of their first anchor (open addressing)
+// Slots also hold a hash of the leaf's last bytes, so repetitive text (log lines) that shares
+// the anchor rarely reaches a memcmp() on a leaf
+typedef struct {
+    uint32_t hash;
+    uint32_t tail;  // Hash of the last RELOAD_WINDOW bytes
+    int offset;     // Anchor offset inside the leaf
+    int len;
+    int leaf;       // Index in the leaf list (-1 = empty slot)
+} ReloadSlot;
+
+typedef struct {
+    ReloadSlot *slots;
+    int bits;           // 1 << bits slots
+    int filled;         // Slots in use
+    RopeNode **leaves;  // Old leaves in order
+    int count;
+    int indexed;        // Leaves before this one have been indexed or skipped
+    uint32_t weight;    // RELOAD_HASH_BASE to the power RELOAD_WINDOW - 1
+} ReloadIndex;
+
+
+// Hash of text[0..RELOAD_WINDOW)
+static uint32_t reload_hash(char *text) {
+    uint32_t h = 0;
+    for (int i = 0; i < RELOAD_WINDOW; i++)
+        h = h * RELOAD_HASH_BASE + (unsigned char)text[i];
+    return h;
+}
+
+
+// Hash of the window after moving it one byte past 'out' to take in 'in'
+// (weight = RELOAD_HASH_BASE to the power RELOAD_WINDOW - 1)
+static uint32_t reload_roll(uint32_t h, uint32_t weight, char out, char in) {
+    return (h - (unsigned char)out * weight) * RELOAD_HASH_BASE + (unsigned char)in;
+}
+
+
+// Home slot of a hash
+static int reload_slot(ReloadIndex *index, uint32_t h) {
+    return (int)((h * 2654435761u) >> (32 - index->bits));
+}
+
+
+// Allocates 1 << bits empty slots
+static void reload_index_alloc(ReloadIndex *index, int bits) {
+    index->bits = bits;
+    index->filled = 0;
+    index->slots = malloc(sizeof(ReloadSlot) << bits);
+    if (index->slots == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int s = 0; s < (1 << bits); s++)
+        index->slots[s].leaf = -1;
+}
+
+
+// Adds a slot entry, unless RELOAD_MAX_SAME_HASH leaves already share its hash
+static void reload_index_insert(ReloadIndex *index, ReloadSlot *entry) {
+    int mask = (1 << index->bits) - 1;
+    int same = 0;
+    int s = reload_slot(index, entry->hash);
+    while (index->slots[s].leaf != -1) {
+        if (index->slots[s].hash == entry->hash && ++same == RELOAD_MAX_SAME_HASH)
+            return;
+        s = (s + 1) & mask;
+    }
+    index->slots[s] = *entry;
+    index->filled++;
+}
+
+
+// Prepares an empty index over count leaves (filled on demand by reload_index_extend())
+// The table starts small and doubles, since usually only leaves near a few edits are indexed
+static void reload_index_init(ReloadIndex *index, RopeNode **leaves, int count) {
+    index->leaves = leaves;
+    index->count = count;
+    index->indexed = 0;
+
+    index->weight = 1;
+    for (int i = 1; i < RELOAD_WINDOW; i++)
+        index->weight *= RELOAD_HASH_BASE;
+
+    int bits = 4;
+    while ((1 << bits) < RELOAD_LOOKAHEAD * 2)
+        bits++;
+    reload_index_alloc(index, bits);
+}
+
+
+// Indexes leaves [from, until) not indexed yet by the hash of their first anchor
+// (leaves passed over in order are skipped, so a block moved backwards is rebuilt)
+static void reload_index_extend(ReloadIndex *index, int from, int until) {
+    if (until > index->count)
+        until = index->count;
+    if (index->indexed < from)
+        index->indexed = from;
+
+    for (; index->indexed < until; index->indexed++) {
+        int i = index->indexed;
+        char *str = rope_leaf_text(index->leaves[i]);
+        int len = index->leaves[i]->total_len;
+        if (len < RELOAD_WINDOW)
+            continue;
+
+        // First anchor; leaves without one can still be matched in order
+        int offset = 0;
+        uint32_t h = reload_hash(str);
+        while ((h & RELOAD_ANCHOR_MASK) != 0 && offset + RELOAD_WINDOW < len) {
+            h = reload_roll(h, index->weight, str[offset], str[offset + RELOAD_WINDOW]);
+            offset++;
+        }
+        if ((h & RELOAD_ANCHOR_MASK) != 0)
+            continue;
+
+        // Keep the table at most half full
+        if (index->filled * 2 >= (1 << index->bits)) {
+            ReloadSlot *old = index->slots;
+            int old_size = 1 << index->bits;
+            reload_index_alloc(index, index->bits + 1);
+            for (int s = 0; s < old_size; s++)
+                if (old[s].leaf != -1)
+                    reload_index_insert(index, &old[s]);
+            free(old);
+        }
+
+        ReloadSlot entry = { h, reload_hash(str + len - RELOAD_WINDOW), offset, len, i };
+        reload_index_insert(index, &entry);
+    }
+}
+
+
+// Finds an unused leaf whose anchor (hash h) is at text[pos] and which lies within text[from..len)
+// Returns its index and sets *start to where it begins (-1 if none)
+static int reload_index_find(ReloadIndex *index, uint32_t h, bool *used,
+                             char *text, int len, int pos, int from, int *start) {
+    int mask = (1 << index->bits) - 1;
+    for (int s = reload_slot(index, h); index->slots[s].leaf != -1; s = (s + 1) & mask) {
+        ReloadSlot *slot = &index->slots[s];
+        int at = pos - slot->offset;
+        if (slot->hash != h || at < from || at + slot->len > len || used[slot->leaf] ||
+            reload_hash(text + at + slot->len - RELOAD_WINDOW) != slot->tail)
+            continue;
+        if (memcmp(rope_leaf_text(index->leaves[slot->leaf]), text + at, slot->len) == 0) {
+            *start = at;
+            return slot->leaf;
+        }
+    }
+    return -1;
+}
+
+
+// Rebuilds a changed stretch of the rope as text[0..len), reusing its leaves wherever they moved
+// Leaves are matched in order; after a mismatch, leaves a little ahead are found again through
+// the anchors of a rolling hash (rsync-style, but sampled). Bytes no leaf covers become new leaves
+static RopeNode *reload_region(RopeNode *root, char *text, int len, int *kept) {
+    LeafList old = { NULL, 0, 0 };
+    RopeIter it;
+    if (root)
+        for (rope_iter_init(&it, root, 0); it.leaf; rope_iter_next(&it))
+            leaf_list_push(&old, it.leaf);
+
+    bool *used = calloc(old.count + 1, sizeof(bool));
+    if (used == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    ReloadIndex index;
+    reload_index_init(&index, old.nodes, old.count);
+
+    LeafList leaves = { NULL, 0, 0 };
+    int pos = 0;        // Next byte of the new text to match
+    int gap = 0;        // Start of the bytes not covered by a reused leaf
+    int next = 0;       // Old leaf expected at pos if the text is unchanged here
+    uint32_t h = 0;     // Rolling hash of text[hashed..hashed + RELOAD_WINDOW)
+    int hashed = -2;
+
+    while (pos < len && pos - gap < RELOAD_GIVE_UP) {
+        int match = -1;
+        int start = pos;
+
+        // Unchanged stretch: the next old leaf continues here
+        if (next < old.count && !used[next]) {
+            RopeNode *leaf = old.nodes[next];
+            if (leaf->total_len > 0 && leaf->total_len <= len - pos && rope_leaf_text(leaf)[0] == text[pos] &&
+                memcmp(rope_leaf_text(leaf), text + pos, leaf->total_len) == 0)
+                match = next;
+        }
+
+        // Otherwise, at an anchor, look for a leaf that has it
+        if (match == -1 && len - pos >= RELOAD_WINDOW) {
+            if (hashed == pos - 1)
+                h = reload_roll(h, index.weight, text[pos - 1], text[pos + RELOAD_WINDOW - 1]);
+            else
+                h = reload_hash(text + pos);
+            hashed = pos;
+            if ((h & RELOAD_ANCHOR_MASK) == 0) {
+                reload_index_extend(&index, next, next + RELOAD_LOOKAHEAD + (pos - gap) / RELOAD_LOOKAHEAD_GROWTH);
+                match = reload_index_find(&index, h, used, text, len, pos, gap, &start);
+            }
+        }
+
+        if (match == -1) {
+            pos++;
+            continue;
+        }
+
+        // New bytes before the reused leaf become leaves of their own
+        leaf_list_push_text(&leaves, text + gap, start - gap);
+        RopeNode *leaf = old.nodes[match];
+        used[match] = true;
+        leaf->parent = NULL;
+        leaf_list_push(&leaves, leaf);
+        (*kept)++;
+
+        pos = start + leaf->total_len;
+        gap = pos;
+        next = match + 1;
+    }
+    leaf_list_push_text(&leaves, text + gap, len - gap);
+
+    // Unused leaves are freed only after the old tree's internal nodes (which still point at them)
+    free_internal_nodes(root);
+    for (int i = 0; i < old.count; i++)
+        if (!used[i])
+            node_free(old.nodes[i]);
+    RopeNode *result = build_rope_from_leaves(leaves.nodes, leaves.count);
+
+    free(index.slots);
+    free(used);
+    free(old.nodes);
+    free(leaves.nodes);
+    return result;
+}
+
+
+// Replaces the rope's text with text[0..len) (the file as re-read after an outside change)
+// Whole leaves matching at the start and at the end are kept in their subtrees; the stretch
+// between them is split off and rebuilt by reload_region(). An unchanged file costs one
+// comparison pass, and a single changed region O(n) comparison + O(region + log n) rebuild
+RopeNode *rope_reload(RopeNode *root, char *text, int len, int *kept) {
+    int old_len = root ? root->total_len : 0;
+    RopeIter it;
+    *kept = 0;
+
+    // Leaves unchanged at the start
+    int head = 0;
+    if (root)
+        for (rope_iter_init(&it, root, 0); it.leaf; rope_iter_next(&it)) {
+            int n = it.leaf->total_len;
+            if (n > len - head || memcmp(rope_leaf_text(it.leaf), text + head, n) != 0)
+                break;
+            head += n;
+            (*kept)++;
+        }
+    if (head == old_len && head == len)
+        return root;
+
+    // Leaves unchanged at the end (not overlapping the start)
+    int tail = 0;
+    if (root && head < old_len)
+        for (rope_iter_init_back(&it, root, old_len); it.leaf; rope_iter_prev(&it)) {
+            int n = it.leaf->total_len;
+            if (n > old_len - head - tail || n > len - head - tail ||
+                memcmp(rope_leaf_text(it.leaf), text + len - tail - n, n) != 0)
+                break;
+            tail += n;
+            (*kept)++;
+        }
+
+    // Both cuts fall on leaf boundaries, so split() copies no text
+    RopeNode *left, *middle, *right;
+    split(root, head, &left, &middle);
+    split(middle, old_len - head - tail, &middle, &right);
+
+    middle = reload_region(middle, text + head, len - head - tail, kept);
+    return concat(concat(left, middle), right);
+}
+
+
+// Bytes read from the file per read call (cut into CHUNK_SIZE leaves afterwards)
+#define LOAD_BLOCK_SIZE (1 << 20)
+
+// Files of at least two ranges of this size are loaded by several threads, one range per job
+#define LOAD_RANGE_SIZE (32 << 20)
+
+
+// Leaves and UTF-8 errors of one byte range of the file being loaded
+// (a worker pool job when the file is loaded in parallel or in the background)
+struct LoadRange {
+    WorkerJob job;       // Must come first: the pool hands this pointer back
+    WorkerGroup group;   // Own group when loaded in the background (appended on its own)
+    int fd;              // File, read with pread() (shared by every range)
+    long from;           // File offset of the first byte
+    long to;             // End of the range (exclusive)
+    Pool *nodes;         // Pools the leaves come from: the shared ones, or this range's own
+    Pool *texts;
+    Pool own_nodes;      // A range loaded on a pool thread cannot use the shared pools
+    Pool own_texts;
+    LeafList leaves;     // Leaves in file order
+    RopeNode *root;      // Balanced tree over the leaves (parallel loading)
+    int invalid;         // Invalid UTF-8 bytes
+    long first_invalid;  // File offset of the first one (-1 if none)
+};
+
+
+// Cuts the first have bytes of block (at file offset 'offset') into leaves and checks them
+// Stops before a UTF-8 sequence that the next block completes; returns the bytes used
+static int load_block(LoadRange *range, char *block, int have, long offset) {
+    int len = utf8_complete_len(block, have);
+
+    int first;
+    int bad = utf8_validate(block, len, &first);
+    if (bad > 0 && range->first_invalid < 0)
+        range->first_invalid = offset + first;
+    range->invalid += bad;
+
+    leaf_list_push_text_in(&range->leaves, range->nodes, range->texts, block, len);
+    return len;
+}
+
+
+// Adds the partial sequence left at the end of the input as it is (malformed input)
+static void load_tail(LoadRange *range, char *block, int have, long offset) {
+    if (have == 0)
+        return;
+    if (range->first_invalid < 0)
+        range->first_invalid = offset;
+    range->invalid += have;
+    leaf_list_push_text_in(&range->leaves, range->nodes, range->texts, block, have);
+}
+
+
+// Moves a range boundary past UTF-8 continuation bytes (at most three), so a valid
+// sequence is never split between two ranges; both neighbours find the same boundary
+static long load_align(int fd, long pos, long size) {
+    char bytes[3];
+    ssize_t n = pos < size ? pread(fd, bytes, sizeof(bytes), pos) : 0;
+    for (int i = 0; i < n && utf8_is_continuation(bytes[i]); i++)
+        pos++;
+    return pos < size ? pos : size;
+}
+
+
+// Reads a range with pread() in LOAD_BLOCK_SIZE blocks into leaves from the range's pools
+// A short read (e.g. a file truncated meanwhile), or a cancel of the range's group
+// checked between blocks, ends the range early
+static void load_range_read(LoadRange *range) {
+    char *block = malloc(LOAD_BLOCK_SIZE);
+    if (block == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    long offset = range->from;  // file offset of block[0]
+    int have = 0;               // bytes in block, including a carried-over partial UTF-8 sequence
+    while (offset + have < range->to && !(range->job.group && worker_group_cancelled(range->job.group))) {
+        long want = range->to - offset - have;
+        if (want > LOAD_BLOCK_SIZE - have)
+            want = LOAD_BLOCK_SIZE - have;
+        ssize_t n = pread(range->fd, block + have, want, offset + have);
+        if (n <= 0)
+            break;
+        have += n;
+
+        int len = load_block(range, block, have, offset);
+        memmove(block, block + len, have - len);
+        offset += len;
+        have -= len;
+    }
+    load_tail(range, block, have, offset);
+    free(block);
+}
+
+
+// Pool job: reads one range and builds its subtree from the range's own pools
+static void load_range_worker(WorkerJob *job) {
+    LoadRange *range = (LoadRange *)job;
+    load_range_read(range);
+    range->root = build_tree_in(range->nodes, range->leaves.nodes, range->leaves.count);
+    free(range->leaves.nodes);
+}
+
+
+// Sets up a range whose leaves come from its own pools (it is loaded on a pool thread)
+static void load_range_init(LoadRange *range, int fd, long from, long to) {
+    range->job.run = load_range_worker;
+    range->fd = fd;
+    range->from = from;
+    range->to = to;
+    range->own_nodes = (Pool){ node_pool.slot_size, NULL, NULL, 0, 0 };
+    range->own_texts = (Pool){ text_pool.slot_size, NULL, NULL, 0, 0 };
+    range->nodes = &range->own_nodes;
+    range->texts = &range->own_texts;
+    range->first_invalid = -1;
+}
+
+
+// Hands a loaded range's unused pool slots to the shared pools (its tree is kept or freed)
+static void load_range_merge(LoadRange *range) {
+    pool_merge(&node_pool, &range->own_nodes);
+    pool_merge(&text_pool, &range->own_texts);
+}
+
+
+// Loads a large file with one pool job per LOAD_RANGE_SIZE bytes
+// Each job builds a balanced subtree from private pools; the subtrees are joined in
+// file order with concat() and the pools' unused slots handed to the shared pools
+static RopeNode *load_parallel(int fd, long size, Utf8Errors *errors) {
+    int count = (int)((size + LOAD_RANGE_SIZE - 1) / LOAD_RANGE_SIZE);
+    LoadRange *ranges = calloc(count, sizeof(LoadRange));
+    if (ranges == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    WorkerGroup group;
+    worker_group_init(&group, NULL, NULL);
+    for (int i = 0; i < count; i++) {
+        long from = i > 0 ? load_align(fd, (long)i * LOAD_RANGE_SIZE, size) : 0;
+        load_range_init(&ranges[i], fd, from, load_align(fd, (long)(i + 1) * LOAD_RANGE_SIZE, size));
+        worker_submit(&group, &ranges[i].job);
+    }
+    worker_group_wait(&group);
+    worker_group_free(&group);
+
+    RopeNode *root = NULL;
+    int invalid = 0;
+    long first_invalid = -1;
+    for (int i = 0; i < count; i++) {
+        root = concat(root, ranges[i].root);
+        load_range_merge(&ranges[i]);
+        if (first_invalid < 0)
+            first_invalid = ranges[i].first_invalid;
+        invalid += ranges[i].invalid;
+    }
+    free(ranges);
+
+    if (errors) {
+        errors->count = invalid;
+        errors->first = (int)first_invalid;
+    }
+    return root;
+}
+
+
+// Loads the file into a rope
+// The file is read in large blocks, validated as UTF-8, and cut into leaves that never
+// split a sequence; the leaves are then assembled into a balanced tree in one pass
+// Regular files of two LOAD_RANGE_SIZE ranges or more are split across the worker pool
+RopeNode *load_file(char *filename, Utf8Errors *errors) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        perror("Error opening file");
+        return NULL;
+    }
+
+    // Offsets and lengths in the rope are int
+    struct stat st;
+    bool stat_ok = fstat(fileno(fp), &st) == 0;
+    if (stat_ok && st.st_size > INT_MAX) {
+        fclose(fp);
+        errno = EFBIG;
+        perror("Error opening file");
+        return NULL;
+    }
+
+    if (stat_ok && S_ISREG(st.st_mode) &&
+        st.st_size >= 2L * LOAD_RANGE_SIZE && worker_thread_count() > 1) {
+        RopeNode *root = load_parallel(fileno(fp), (long)st.st_size, errors);
+        fclose(fp);
+        return root;
+    }
+
+    char *block = malloc(LOAD_BLOCK_SIZE);
+    if (block == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    LoadRange range = { .nodes = &node_pool, .texts = &text_pool, .first_invalid = -1 };
+    long offset = 0;       // file offset of block[0]
+    int have = 0;          // bytes in block, including a carried-over partial UTF-8 sequence
+
+    int n;
+    while ((n = fread(block + have, 1, LOAD_BLOCK_SIZE - have, fp)) > 0) {
+        have += n;
+
+        // The partial sequence starts the next block
+        int len = load_block(&range, block, have, offset);
+        memmove(block, block + len, have - len);
+        offset += len;
+        have -= len;
+    }
+    load_tail(&range, block, have, offset);
+
+    fclose(fp);
+    free(block);
+
+    if (errors) {
+        errors->count = range.invalid;
+        errors->first = (int)range.first_invalid;
+    }
+
+    RopeNode *root = build_rope_from_leaves(range.leaves.nodes, range.leaves.count);
+    free(range.leaves.nodes);
+    return root;
+}
+
+
+
+// Background range finished: nothing to do here, its completion only wakes the event loop,
+// which appends it with rope_load_poll()
+static void load_range_finished(WorkerGroup *group) {
+    (void)group;
+}
+
+
+// Loads a file; one of LOAD_LAZY_MIN bytes or more only up to LOAD_LAZY_FIRST bytes, the rest
+// being queued on the worker pool in LOAD_RANGE_SIZE ranges. The ranges are queued last first:
+// a pool thread takes its newest job first, so the ranges nearest the top of the file load first
+RopeNode *load_file_lazy(char *filename, RopeLoader *loader, Utf8Errors *errors) {
+    memset(loader, 0, sizeof(RopeLoader));
+    loader->fd = -1;
+    loader->first_invalid = -1;
+
+    // Small files load at once; load_file also reports the errors, including a file too
+    // large for int offsets (no background range is started for one)
+    struct stat st;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size < LOAD_LAZY_MIN ||
+        st.st_size > INT_MAX) {
+        if (fd != -1)
+            close(fd);
+        return load_file(filename, errors);
+    }
+
+    // The head is read here, with the shared pools (the main thread owns them)
+    long size = (long)st.st_size;
+    long first = load_align(fd, LOAD_LAZY_FIRST, size);
+    LoadRange head = { .fd = fd, .to = first, .nodes = &node_pool, .texts = &text_pool, .first_invalid = -1 };
+    load_range_read(&head);
+
+    RopeNode *root = build_rope_from_leaves(head.leaves.nodes, head.leaves.count);
+    free(head.leaves.nodes);
+    if (errors) {
+        errors->count = head.invalid;
+        errors->first = (int)head.first_invalid;
+    }
+
+    loader->fd = fd;
+    loader->size = size;
+    loader->appended = first;
+    loader->invalid = head.invalid;
+    loader->first_invalid = head.first_invalid;
+    loader->count = (int)((size - first + LOAD_RANGE_SIZE - 1) / LOAD_RANGE_SIZE);
+    loader->ranges = calloc(loader->count, sizeof(LoadRange));
+    if (loader->ranges == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < loader->count; i++) {
+        long from = i > 0 ? load_align(fd, first + (long)i * LOAD_RANGE_SIZE, size) : first;
+        long to = load_align(fd, first + (long)(i + 1) * LOAD_RANGE_SIZE, size);
+        load_range_init(&loader->ranges[i], fd, from, to);
+        worker_group_init(&loader->ranges[i].group, load_range_finished, loader);
+    }
+    for (int i = loader->count - 1; i >= 0; i--)
+        worker_submit(&loader->ranges[i].group, &loader->ranges[i].job);
+    return root;
+}
+
+
+// Closes the file and frees the ranges once every one was appended or dropped
+static void load_finish(RopeLoader *loader) {
+    free(loader->ranges);
+    loader->ranges = NULL;
+    loader->count = loader->next = 0;
+    close(loader->fd);
+    loader->fd = -1;
+}
+
+
+// Appends finished ranges in file order with concat(), stopping at the first still loading
+// (wait: waiting for it); a range's own UTF-8 errors are added to the loader's
+RopeNode *rope_load_poll(RopeNode *root, RopeLoader *loader, bool wait) {
+    while (loader->fd != -1 && loader->next < loader->count) {
+        LoadRange *range = &loader->ranges[loader->next];
+        if (!wait && !worker_group_done(&range->group))
+            break;
+
+        // Also takes a finished group off the completion queue before it is freed
+        worker_group_wait(&range->group);
+        worker_group_free(&range->group);
+
+        root = concat(root, range->root);
+        load_range_merge(range);
+        loader->appended = range->to;
+        if (loader->first_invalid < 0)
+            loader->first_invalid = range->first_invalid;
+        loader->invalid += range->invalid;
+        loader->next++;
+    }
+
+    if (loader->fd != -1 && loader->next == loader->count)
+        load_finish(loader);
+    return root;
+}
+
+
+// Returns true while part of the file is still loading
+bool rope_load_active(RopeLoader *loader) {
+    return loader->fd != -1;
+}
+
+
+// Returns the percentage of the file appended so far
+int rope_load_progress(RopeLoader *loader) {
+    if (loader->fd == -1 || loader->size <= 0)
+        return 100;
+    return (int)(loader->appended * 100 / loader->size);
+}
+
+
+// Returns the file bytes not appended yet
+long rope_load_pending(RopeLoader *loader) {
+    return loader->fd != -1 ? loader->size - loader->appended : 0;
+}
+
+
+// Cancels the ranges not appended yet, waits for them and frees what they built
+void rope_load_cancel(RopeLoader *loader) {
+    if (loader->fd == -1)
+        return;
+
+    for (int i = loader->next; i < loader->count; i++)
+        worker_group_cancel(&loader->ranges[i].group);
+    for (int i = loader->next; i < loader->count; i++) {
+        LoadRange *range = &loader->ranges[i];
+        worker_group_wait(&range->group);
+        worker_group_free(&range->group);
+        free_rope(range->root);
+        load_range_merge(range);
+    }
+    load_finish(loader);
+}
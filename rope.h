@@ -6,7 +6,16 @@
 // Macros
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define CHUNK_SIZE 128  // Size of text chunks stored in leaf nodes
+#define TAB_WIDTH 4     // Display columns taken by a tab
 
+// Stretches of unedited leaves away from every view can be frozen into cold leaves of about
+// COLD_BLOCK_SIZE bytes, each keeping its text as one compressed block (see rope_freeze_start)
+#define COLD_BLOCK_SIZE (64 << 10)
+
+// Decompressed cold blocks each thread keeps, most recently used first
+#define COLD_CACHE_BLOCKS 8
+
+typedef struct ColdBlock ColdBlock;
 
 // Rope node structure representing either an internal node or leaf node
 typedef struct RopeNode {
@@ -15,6 +24,9 @@ typedef struct RopeNode {
     char *str;         // Text content (only for leaf nodes)
     int height;        // Height of node (for AVL balancing)
     int newlines;      // Count of '\n' characters in subtree
+    int width;         // Display width of subtree (tabs count TAB_WIDTH columns)
+    int chars;         // Count of UTF-8 codepoints in subtree
+    ColdBlock *cold;   // Compressed text of a cold leaf (str is NULL; read it with rope_leaf_text)
 
     struct RopeNode *left;    // Left child
     struct RopeNode *right;   // Right child
@@ -22,6 +34,72 @@ typedef struct RopeNode {
 } RopeNode;
 
 
+// Maximum tree depth an iterator can track (AVL height stays far below this)
+#define ROPE_ITER_MAX_DEPTH 64
+
+// In-order iterator over the leaves of a rope (no parent pointers needed)
+// An iterator walks either forward (init/next) or backward (init_back/prev), not both
+typedef struct {
+    RopeNode *stack[ROPE_ITER_MAX_DEPTH];  // Subtrees still to be visited (right ones forward, left ones backward)
+    int depth;                             // Number of entries on stack
+    RopeNode *leaf;                        // Current leaf (NULL when exhausted)
+    int leaf_start;                        // Rope index of first character in leaf
+} RopeIter;
+
+
+// Line, width and codepoint counts of a piece of text (see measure_text)
+typedef struct {
+    int newlines;  // '\n' characters
+    int width;     // Display columns (same sum as char_width over every byte)
+    int chars;     // UTF-8 codepoints (bytes that are not continuation bytes)
+    int invalid;   // Bytes that are not part of a valid UTF-8 sequence
+} TextStats;
+
+// One piece of a snapshot's text (read it with rope_snapshot_text)
+typedef struct {
+    char *text;       // Bytes (not NUL-terminated); valid until the snapshot is released
+    int len;
+    bool owned;       // Copy made for the snapshot (freed with it) rather than part of a leaf
+    ColdBlock *cold;  // Block of a cold leaf the span is part of (text is NULL)
+    int offset;       // Where the span starts in the cold block's text
+} SnapshotSpan;
+
+// The text of a rope at one moment, as spans into its leaves
+// Another thread may read it while the rope goes on being edited (see rope_snapshot_init)
+typedef struct {
+    SnapshotSpan *spans;
+    int count;
+    int capacity;
+    long total;          // Bytes in all spans
+} RopeSnapshot;
+
+// Invalid UTF-8 found while loading a file
+typedef struct {
+    int count;  // Bytes that are not part of a valid UTF-8 sequence
+    int first;  // Offset of the first of them (-1 if the file is valid UTF-8)
+} Utf8Errors;
+
+// Files of at least LOAD_LAZY_MIN bytes are shown once their first LOAD_LAZY_FIRST bytes are
+// loaded; the rest is loaded by the worker pool and appended as it arrives (see load_file_lazy)
+#define LOAD_LAZY_MIN (128 << 20)
+#define LOAD_LAZY_FIRST (4 << 20)
+
+typedef struct LoadRange LoadRange;
+typedef struct RopeFreeze RopeFreeze;
+
+// The rest of a large file, loading in the background in file-order ranges
+typedef struct {
+    int fd;              // File being read (-1: nothing is loading)
+    long size;           // File size when loading started
+    long appended;       // File bytes in the rope so far
+    LoadRange *ranges;   // Ranges after the first LOAD_LAZY_FIRST bytes, one worker pool job each
+    int count;
+    int next;            // First range not appended yet (ranges finish in any order)
+    int invalid;         // Invalid UTF-8 bytes in the text appended so far
+    long first_invalid;  // File offset of the first one (-1 if none)
+} RopeLoader;
+
+
 // ========== Helper functions ==========
 
 // Check if a node is a leaf node
@@ -36,7 +114,7 @@ int string_length(char *str);
 // Count number of newlines in a string
 int count_newlines(char *str);
 
-// Recompute metadata (total_len, weight, height, newlines) for a node
+// Recompute metadata (total_len, weight, height, newlines, width, chars) for a node
 void update_metadata(RopeNode *node);
 
 // Allocate and copy a string
@@ -45,6 +123,42 @@ char *string_copy(char *src);
 // Extract substring of length n from start position
 char *substr(char *start, int n);
 
+// ========== UTF-8 helpers ==========
+
+// Check if a byte is a UTF-8 continuation byte (10xxxxxx)
+bool utf8_is_continuation(char c);
+
+// Length of the UTF-8 sequence started by lead byte c (1 for ASCII and invalid bytes)
+int utf8_seq_len(char c);
+
+// Decode the character at s (len bytes available); returns bytes consumed (malformed = 1, U+FFFD)
+int utf8_decode(char *s, int len, int *cp);
+
+// Display columns of a codepoint (TAB_WIDTH for tab, 0 for combining marks, 2 for wide characters)
+int codepoint_width(int cp);
+
+// Display width of the character starting at s (continuation bytes count 0)
+int char_width(char *s, int len);
+
+// Total display width of a string
+int count_display_width(char *str);
+
+// Number of UTF-8 codepoints in a string
+int count_codepoints(char *str);
+
+// Count newlines, display width, codepoints and invalid bytes of text[0..len) in one pass
+// (all-ASCII blocks are checked and counted 16 bytes at a time with SSE2, 8 without)
+void measure_text(char *text, int len, TextStats *stats);
+
+// Validate text[0..len): returns the number of invalid bytes and stores the offset of the first in *first (-1 if none)
+int utf8_validate(char *text, int len, int *first);
+
+// Length of text[0..len) without a UTF-8 sequence cut off at its end (completed by a later read)
+int utf8_complete_len(char *text, int len);
+
+// Length of the next leaf chunk of text: at most CHUNK_SIZE, never cutting a UTF-8 sequence
+int utf8_chunk_len(char *text, int len);
+
 // ========== Core rope operations ==========
 
 // Create a new leaf node with given text
@@ -70,8 +184,36 @@ void free_rope(RopeNode *root);
 
 // ========== File operations ==========
 
-// Load file into a rope structure
-RopeNode *load_file(char *filename);
+// Load file into a rope structure (leaves cut on UTF-8 boundaries)
+// Invalid UTF-8 is kept byte for byte and reported in *errors (may be NULL)
+RopeNode *load_file(char *filename, Utf8Errors *errors);
+
+// Load the start of a file of LOAD_LAZY_MIN bytes or more and queue the rest on the worker pool
+// (smaller files are loaded whole, leaving the loader idle); errors covers the part loaded now
+RopeNode *load_file_lazy(char *filename, RopeLoader *loader, Utf8Errors *errors);
+
+// Append the ranges that finished loading, in file order (wait: all of them); returns the new root
+// Once the last one is appended the loader is idle and holds the whole file's UTF-8 errors
+RopeNode *rope_load_poll(RopeNode *root, RopeLoader *loader, bool wait);
+
+// Check whether part of the file is still loading
+bool rope_load_active(RopeLoader *loader);
+
+// Percentage of the file in the rope
+int rope_load_progress(RopeLoader *loader);
+
+// File bytes not in the rope yet
+long rope_load_pending(RopeLoader *loader);
+
+// Stop loading and drop the ranges not appended yet
+void rope_load_cancel(RopeLoader *loader);
+
+// Append text[0..len) at the end of the rope in O(len + log n) (file growth in follow mode)
+RopeNode *rope_append(RopeNode *root, char *text, int len);
+
+// Replace the rope's text with text[0..len) (file changed on disk), reusing the old leaves
+// found again in it; returns the new root (old root must not be used), *kept = leaves reused
+RopeNode *rope_reload(RopeNode *root, char *text, int len, int *kept);
 
 // Save rope contents to file
 bool save_file(RopeNode *root, char *filename);
@@ -121,4 +263,120 @@ int get_line_length(RopeNode *root, int line);
 // Count total number of lines in rope
 int count_total_lines(RopeNode *root);
 
+// Get line number containing a character index (count of newlines before it)
+int get_line_from_pos(RopeNode *root, int idx);
+
+// Get display width of all text before idx (O(log n) via width metadata)
+int get_display_offset(RopeNode *root, int idx);
+
+// Get index of the character covering display offset target (inverse of get_display_offset)
+int find_display_offset(RopeNode *root, int target);
+
+// Get number of codepoints before idx (codepoint column = difference from line start)
+int get_char_offset(RopeNode *root, int idx);
+
+// Get index of codepoint number target (inverse of get_char_offset)
+int find_char_offset(RopeNode *root, int target);
+
+// Get start of the UTF-8 sequence containing idx
+int rope_char_start(RopeNode *root, int idx);
+
+// Get index after the character at idx (including following combining marks)
+int rope_next_char(RopeNode *root, int idx);
+
+// Get start of the character before idx (including its combining marks)
+int rope_prev_char(RopeNode *root, int idx);
+
+// ========== Leaf iteration ==========
+
+// Position iterator on the leaf containing idx
+void rope_iter_init(RopeIter *it, RopeNode *root, int idx);
+
+// Advance iterator to the next leaf (returns false when no leaves remain)
+bool rope_iter_next(RopeIter *it);
+
+// Position iterator for backward traversal on the leaf containing idx - 1
+void rope_iter_init_back(RopeIter *it, RopeNode *root, int idx);
+
+// Move backward iterator to the previous leaf (returns false when no leaves remain)
+bool rope_iter_prev(RopeIter *it);
+
+// Get position of the first '\n' at or after idx (rope length if none)
+int rope_find_newline(RopeNode *root, int idx);
+
+// Get position of the '\n' ending the line that contains idx, in O(log n) (rope length if none)
+int rope_line_end(RopeNode *root, int idx);
+
+// ========== Search ==========
+
+// Check whether pat occurs at idx (comparison may span several leaves)
+bool rope_match_at(RopeNode *root, int idx, char *pat);
+
+// Find first occurrence of pat starting at or after from (-1 if none)
+int rope_find(RopeNode *root, char *pat, int from);
+
+// Find first occurrence of pat starting in [from, limit) (-1 if none)
+// The match itself may extend past limit
+int rope_find_range(RopeNode *root, char *pat, int from, int limit);
+
+// Find last occurrence of pat starting before 'before' (-1 if none)
+int rope_rfind(RopeNode *root, char *pat, int before);
+
+// ========== Batch editing ==========
+
+// Build a balanced rope over an array of leaves in O(count) (leaves are adopted)
+RopeNode *build_rope_from_leaves(RopeNode **leaves, int count);
+
+// Replace sorted, non-overlapping ranges [starts[i], ends[i]) with replacement in one pass
+// Untouched leaves are reused; returns the new root (old root must not be used)
+RopeNode *rope_replace_ranges(RopeNode *root, int *starts, int *ends, int count, char *replacement);
+
+// ========== Snapshots ==========
+
+// Start an empty snapshot; leaf texts freed from now on are kept until it is released
+void rope_snapshot_init(RopeSnapshot *snap);
+
+// Add bytes [start, end) of the rope (leaf texts are referenced, not copied)
+void rope_snapshot_add(RopeSnapshot *snap, RopeNode *root, int start, int end);
+
+// Add a copy of text[0..len)
+void rope_snapshot_add_text(RopeSnapshot *snap, char *text, int len);
+
+// Text of a span (a cold leaf's is decompressed, as by rope_leaf_text)
+char *rope_snapshot_text(SnapshotSpan *span);
+
+// Free the snapshot (on the editing thread, once nothing reads it any more)
+void rope_snapshot_release(RopeSnapshot *snap);
+
+// ========== Cold leaves ==========
+
+// Text of a leaf (NUL-terminated); a cold leaf's block is decompressed into the calling
+// thread's cache, and the pointer stays valid until that thread has decompressed
+// COLD_CACHE_BLOCKS other blocks
+char *rope_leaf_text(RopeNode *leaf);
+
+// Start compressing the stretches of ordinary leaves outside every hot range [hot[i][0], hot[i][1])
+// on the worker pool (the leaves are pinned as by a snapshot); NULL if there are none
+RopeFreeze *rope_freeze_start(RopeNode *root, int hot[][2], int hot_count);
+
+// Check whether every block has been compressed
+bool rope_freeze_done(RopeFreeze *freeze);
+
+// Percentage of the text compressed so far
+int rope_freeze_progress(RopeFreeze *freeze);
+
+// Replace the compressed stretches that are still in the rope by cold leaves, waiting for the
+// compression if needed, and free the freeze; returns the new root (old root must not be used)
+// *frozen and *stored receive the bytes frozen and the bytes their blocks take
+RopeNode *rope_freeze_finish(RopeNode *root, RopeFreeze *freeze, long *frozen, long *stored);
+
+// Stop compressing and free the freeze (the rope is left as it was)
+void rope_freeze_cancel(RopeFreeze *freeze);
+
+// Replace every cold leaf by ordinary leaves; returns the new root (old root must not be used)
+RopeNode *rope_thaw(RopeNode *root);
+
+// Bytes of text held in cold leaves, and the bytes their blocks take
+void rope_cold_stats(RopeNode *root, long *bytes, long *stored);
+
 #endif
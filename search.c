@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "search.h"
+
+
+// Work description and results for one byte range of the rope (a worker pool job)
+typedef struct {
+    WorkerJob job;        // Must come first: the pool hands this pointer back
+    RopeNode *root;       // Rope being searched (read-only while workers run)
+    char *pat;            // Pattern
+    int len;              // Pattern length
+    int from;             // First match start this worker is responsible for
+    int to;               // End of range (exclusive) for match starts
+    MatchList *matches;   // Where to store positions (NULL = count only)
+    int count;            // Matches found in range
+    int first;            // First match in range (-1 if none)
+    int last;             // Last match in range (-1 if none)
+
+    // Shared state for search_find_first()
+    pthread_mutex_t *lock;  // Protects *best
+    int *best;              // Lowest range index that found a match so far
+    int index;              // This range's index
+} SearchRange;
+
+
+// One slice of a snapshot count (a worker pool job)
+struct CountSlice {
+    WorkerJob job;          // Must come first: the pool hands this pointer back
+    SnapshotCount *count;   // Count this slice belongs to
+    long from;              // Snapshot offset of the first byte counted
+    long to;                // End of the slice (exclusive); a match starting before it may run past it
+    int span;               // Span holding 'from'
+    int offset;             // Offset of 'from' in that span
+    TextCounts result;      // Counts of [from, to) and of the matches starting there
+    bool starts_in_word;    // First byte is not white space (its word may begin in the slice before)
+    bool ends_in_word;      // Last byte is not white space
+    long first;             // Start of the first match counted (-1 if none)
+    long last_end;          // End of the last match counted (-1 if none)
+};
+
+
+// Initializes an empty match list
+void match_list_init(MatchList *list) {
+    list->positions = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+
+// Frees match list storage
+void match_list_free(MatchList *list) {
+    free(list->positions);
+    match_list_init(list);
+}
+
+
+// Appends a position, growing the list by doubling
+void match_list_push(MatchList *list, int pos) {
+    if (list->count == list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 256;
+        int *positions = realloc(list->positions, new_capacity * sizeof(int));
+        // If realloc fails
+        if (positions == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        list->positions = positions;
+        list->capacity = new_capacity;
+    }
+
+    list->positions[list->count++] = pos;
+}
+
+
+// Returns how many threads to split a rope of this size across
+int search_thread_count(RopeNode *root) {
+    if (root == NULL || root->total_len < SEARCH_PARALLEL_MIN)
+        return 1;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+        cores = 1;
+    if (cores > SEARCH_MAX_THREADS)
+        cores = SEARCH_MAX_THREADS;
+
+    // Don't hand out ranges smaller than the parallel threshold
+    long max_by_size = root->total_len / SEARCH_PARALLEL_MIN;
+    return (int)(cores < max_by_size ? cores : max_by_size);
+}
+
+
+// Scans one range for all non-overlapping matches starting in [from, to)
+// Matches may extend past 'to' (the overlap into the next range)
+static void search_all_worker(WorkerJob *job) {
+    SearchRange *r = (SearchRange *)job;
+    r->count = 0;
+    r->first = -1;
+    r->last = -1;
+
+    int pos = r->from;
+    int match;
+    while ((match = rope_find_range(r->root, r->pat, pos, r->to)) != -1) {
+        if (r->first == -1)
+            r->first = match;
+        r->last = match;
+        r->count++;
+        if (r->matches)
+            match_list_push(r->matches, match);
+        pos = match + r->len;
+    }
+}
+
+
+// Scans one range slice by slice for its first match
+// Gives up as soon as a range earlier in the rope has reported a match
+static void search_first_worker(WorkerJob *job) {
+    SearchRange *r = (SearchRange *)job;
+    r->first = -1;
+
+    for (int pos = r->from; pos < r->to; pos += SEARCH_SLICE_SIZE) {
+        pthread_mutex_lock(r->lock);
+        bool beaten = *r->best < r->index;
+        pthread_mutex_unlock(r->lock);
+        if (beaten)
+            return;
+
+        int limit = pos + SEARCH_SLICE_SIZE < r->to ? pos + SEARCH_SLICE_SIZE : r->to;
+        int match = rope_find_range(r->root, r->pat, pos, limit);
+        if (match != -1) {
+            r->first = match;
+            pthread_mutex_lock(r->lock);
+            if (r->index < *r->best)
+                *r->best = r->index;
+            pthread_mutex_unlock(r->lock);
+            return;
+        }
+    }
+}
+
+
+// Splits [from, to) into n equal ranges and runs worker on each
+// Range 0 runs on the calling thread, the others as worker pool jobs (which the
+// calling thread helps with once its own range is done)
+static void search_run(SearchRange *ranges, int n, int from, int to, void (*worker)(WorkerJob *)) {
+    WorkerGroup group;
+    worker_group_init(&group, NULL, NULL);
+
+    long span = (long)to - from;
+    for (int i = 0; i < n; i++) {
+        ranges[i].from = from + (int)(span * i / n);
+        ranges[i].to = from + (int)(span * (i + 1) / n);
+        ranges[i].index = i;
+        ranges[i].job.run = worker;
+    }
+
+    for (int i = 1; i < n; i++)
+        worker_submit(&group, &ranges[i].job);
+
+    worker(&ranges[0].job);
+
+    worker_group_wait(&group);
+    worker_group_free(&group);
+}
+
+
+// Returns the first match at or after from, searching ranges of the rope in parallel
+int search_find_first(RopeNode *root, char *pat, int from) {
+    if (root == NULL || string_length(pat) == 0)
+        return -1;
+    if (from < 0)
+        from = 0;
+
+    int n = search_thread_count(root);
+    if (n <= 1 || root->total_len - from < SEARCH_PARALLEL_MIN)
+        return rope_find(root, pat, from);
+
+    // Most searches hit close to the cursor: try the first slice serially
+    int near = rope_find_range(root, pat, from, from + SEARCH_SLICE_SIZE);
+    if (near != -1)
+        return near;
+    from += SEARCH_SLICE_SIZE;
+
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    int best = n;
+    SearchRange ranges[SEARCH_MAX_THREADS];
+    for (int i = 0; i < n; i++) {
+        ranges[i].root = root;
+        ranges[i].pat = pat;
+        ranges[i].len = string_length(pat);
+        ranges[i].lock = &lock;
+        ranges[i].best = &best;
+    }
+
+    search_run(ranges, n, from, root->total_len, search_first_worker);
+    pthread_mutex_destroy(&lock);
+
+    return best < n ? ranges[best].first : -1;
+}
+
+
+// Collects (or counts) all non-overlapping matches, leftmost first
+// Ranges are scanned in parallel and merged in order; a range whose first match
+// overlaps the previous range's last match is rescanned from the end of that match
+int search_find_all(RopeNode *root, char *pat, MatchList *out) {
+    int len = string_length(pat);
+    if (root == NULL || len == 0)
+        return 0;
+
+    int n = search_thread_count(root);
+
+    SearchRange ranges[SEARCH_MAX_THREADS];
+    MatchList lists[SEARCH_MAX_THREADS];
+    for (int i = 0; i < n; i++) {
+        match_list_init(&lists[i]);
+        ranges[i].root = root;
+        ranges[i].pat = pat;
+        ranges[i].len = len;
+        ranges[i].matches = out ? &lists[i] : NULL;
+    }
+
+    search_run(ranges, n, 0, root->total_len, search_all_worker);
+
+    // Merge ranges in order
+    int total = 0;
+    int prev_end = 0;
+    for (int i = 0; i < n; i++) {
+        SearchRange *r = &ranges[i];
+
+        // Self-overlapping pattern across the boundary: redo this range serially
+        if (r->first != -1 && r->first < prev_end) {
+            r->from = prev_end;
+            if (r->matches)
+                r->matches->count = 0;
+            search_all_worker(&r->job);
+        }
+
+        if (out) {
+            for (int k = 0; k < lists[i].count; k++)
+                match_list_push(out, lists[i].positions[k]);
+        }
+
+        total += r->count;
+        if (r->last != -1)
+            prev_end = r->last + len;
+
+        match_list_free(&lists[i]);
+    }
+
+    return total;
+}
+
+
+// Counts all non-overlapping matches without storing positions
+int search_count_matches(RopeNode *root, char *pat) {
+    return search_find_all(root, pat, NULL);
+}
+
+
+// Scans one slice of a snapshot: lines, words and bytes of [from, to), and matches
+// starting there (leftmost first, non-overlapping) with the KMP automaton, reading past 'to'
+// only to complete a match begun inside. Progress and cancellation are checked
+// every SEARCH_SLICE_SIZE bytes
+static void count_scan(CountSlice *slice) {
+    SnapshotCount *count = slice->count;
+    RopeSnapshot *snap = &count->snapshot;
+    TextCounts *r = &slice->result;
+    memset(r, 0, sizeof(TextCounts));
+    slice->starts_in_word = false;
+    slice->first = -1;
+    slice->last_end = -1;
+
+    bool in_word = false;
+    bool stop = false;
+    int state = 0;           // Pattern bytes matched so far
+    long pos = slice->from;
+    long reported = pos;
+    int offset = slice->offset;
+    for (int span = slice->span; span < snap->count && !stop; span++, offset = 0) {
+        char *text = rope_snapshot_text(&snap->spans[span]);
+        int len = snap->spans[span].len;
+        for (int i = offset; i < len; i++, pos++) {
+            // Past the slice, and no partial match starts inside it
+            if (pos - state >= slice->to) {
+                stop = true;
+                break;
+            }
+
+            char c = text[i];
+            if (pos < slice->to) {
+                bool space = isspace((unsigned char)c);
+                if (c == '\n')
+                    r->lines++;
+                if (!space && !in_word)
+                    r->words++;
+                if (pos == slice->from)
+                    slice->starts_in_word = !space;
+                in_word = !space;
+            }
+
+            if (count->pat) {
+                while (state > 0 && c != count->pat[state])
+                    state = count->fail[state - 1];
+                if (c == count->pat[state])
+                    state++;
+                if (state == count->pat_len) {
+                    r->matches++;
+                    if (slice->first == -1)
+                        slice->first = pos + 1 - state;
+                    slice->last_end = pos + 1;
+                    state = 0;
+                }
+            }
+        }
+
+        long done = pos < slice->to ? pos : slice->to;
+        if (done - reported >= SEARCH_SLICE_SIZE) {
+            worker_group_advance(&count->group, done - reported);
+            reported = done;
+            if (worker_group_cancelled(&count->group))
+                stop = true;
+        }
+    }
+
+    long done = pos < slice->to ? pos : slice->to;
+    if (done > reported)
+        worker_group_advance(&count->group, done - reported);
+    r->bytes = done > slice->from ? done - slice->from : 0;
+    slice->ends_in_word = in_word;
+}
+
+
+// Pool job: counts one slice
+static void count_worker(WorkerJob *job) {
+    count_scan((CountSlice *)job);
+}
+
+
+// Starts counting a snapshot: one slice per COUNT_SLICE_SIZE bytes (at least one, so
+// an empty snapshot still finishes), each starting at the span holding its first byte
+void snapshot_count_start(SnapshotCount *count, RopeSnapshot *snap, char *pat,
+                          void (*finish)(WorkerGroup *group), void *data) {
+    count->snapshot = *snap;
+    count->pat = NULL;
+    count->pat_len = 0;
+    count->fail = NULL;
+    if (pat && string_length(pat) > 0) {
+        count->pat = string_copy(pat);
+        count->pat_len = string_length(pat);
+        count->fail = malloc(count->pat_len * sizeof(int));
+        if (count->fail == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+
+        // fail[i] = length of the longest proper border of pat[0..i]
+        count->fail[0] = 0;
+        for (int i = 1, k = 0; i < count->pat_len; i++) {
+            while (k > 0 && pat[i] != pat[k])
+                k = count->fail[k - 1];
+            if (pat[i] == pat[k])
+                k++;
+            count->fail[i] = k;
+        }
+    }
+
+    long total = snap->total;
+    count->slice_count = total > 0 ? (int)((total + COUNT_SLICE_SIZE - 1) / COUNT_SLICE_SIZE) : 1;
+    count->slices = malloc(count->slice_count * sizeof(CountSlice));
+    if (count->slices == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int span = 0;
+    long span_start = 0;
+    for (int i = 0; i < count->slice_count; i++) {
+        CountSlice *slice = &count->slices[i];
+        slice->count = count;
+        slice->from = (long)i * COUNT_SLICE_SIZE;
+        slice->to = slice->from + COUNT_SLICE_SIZE < total ? slice->from + COUNT_SLICE_SIZE : total;
+        while (span < snap->count && span_start + snap->spans[span].len <= slice->from)
+            span_start += snap->spans[span++].len;
+        slice->span = span;
+        slice->offset = (int)(slice->from - span_start);
+        slice->job.run = count_worker;
+    }
+
+    worker_group_init(&count->group, finish, data);
+    worker_group_set_total(&count->group, total);
+    count->running = true;
+    for (int i = 0; i < count->slice_count; i++)
+        worker_submit(&count->group, &count->slices[i].job);
+}
+
+
+// Returns the percentage of the snapshot counted so far
+int snapshot_count_progress(SnapshotCount *count) {
+    return worker_group_percent(&count->group);
+}
+
+
+// Asks the slices to stop at their next check
+void snapshot_count_cancel(SnapshotCount *count) {
+    worker_group_cancel(&count->group);
+}
+
+
+// Adds the slices up in order, then frees the count
+// A word cut by a slice boundary is counted once; a slice whose first match overlaps
+// the last match of the slice before (a self-overlapping pattern) has its matches recounted
+// from the end of that match, as search_find_all() does
+bool snapshot_count_finish(SnapshotCount *count, TextCounts *out) {
+    bool ok = !worker_group_cancelled(&count->group);
+
+    if (ok) {
+        memset(out, 0, sizeof(TextCounts));
+        long prev_end = 0;
+        bool prev_in_word = false;
+        for (int i = 0; i < count->slice_count; i++) {
+            CountSlice *slice = &count->slices[i];
+
+            if (slice->first != -1 && slice->first < prev_end) {
+                // Walk from the slice's own start to the span holding prev_end
+                CountSlice redo = *slice;
+                RopeSnapshot *snap = &count->snapshot;
+                long span_start = slice->from - slice->offset;
+                while (redo.span < snap->count && span_start + snap->spans[redo.span].len <= prev_end)
+                    span_start += snap->spans[redo.span++].len;
+                redo.from = prev_end;
+                redo.offset = (int)(prev_end - span_start);
+                count_scan(&redo);
+                slice->result.matches = redo.result.matches;
+                slice->last_end = redo.last_end;
+            }
+
+            out->lines += slice->result.lines;
+            out->words += slice->result.words;
+            out->bytes += slice->result.bytes;
+            out->matches += slice->result.matches;
+            if (prev_in_word && slice->starts_in_word)
+                out->words--;
+            prev_in_word = slice->ends_in_word;
+            if (slice->last_end != -1)
+                prev_end = slice->last_end;
+        }
+    }
+
+    free(count->slices);
+    free(count->fail);
+    free(count->pat);
+    count->slices = NULL;
+    count->fail = NULL;
+    count->pat = NULL;
+    rope_snapshot_release(&count->snapshot);
+    worker_group_free(&count->group);
+    count->running = false;
+    return ok;
+}
+
+
+// Cancels a running count and waits for its slices; its finish callback is not run
+void snapshot_count_abort(SnapshotCount *count) {
+    if (!count->running)
+        return;
+
+    snapshot_count_cancel(count);
+    worker_group_wait(&count->group);
+    snapshot_count_finish(count, NULL);
+}
@@ -0,0 +1,97 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "rope.h"
+#include "worker.h"
+
+// Upper bound on ranges (pool jobs) one search is split into
+#define SEARCH_MAX_THREADS 64
+
+// Ropes smaller than this are searched on the calling thread only
+#define SEARCH_PARALLEL_MIN (4 * 1024 * 1024)
+
+// Workers looking for the first match check for an earlier hit after each slice
+#define SEARCH_SLICE_SIZE (1024 * 1024)
+
+// Snapshot counts are split into slices of this many bytes, one pool job each
+#define COUNT_SLICE_SIZE (16 * 1024 * 1024)
+
+// Growable list of match positions (ascending)
+typedef struct {
+    int *positions;  // Start index of each match
+    int count;       // Number of matches
+    int capacity;    // Allocated slots
+} MatchList;
+
+// What a count of a text found: wc's three numbers, plus the matches of a pattern
+typedef struct {
+    long lines;    // Newline characters
+    long words;    // Runs of characters other than white space
+    long bytes;    // Bytes
+    long matches;  // Non-overlapping matches of the pattern (0 when none is counted)
+} TextCounts;
+
+typedef struct CountSlice CountSlice;
+
+// A count of a rope snapshot running on the worker pool, so the editor keeps taking keys
+// The snapshot is cut into slices counted in parallel; their totals are merged by
+// snapshot_count_finish() once the group is done (on the main thread)
+typedef struct {
+    bool running;            // Started and not finished yet
+    WorkerGroup group;       // Progress (bytes), cancellation and the finish callback
+    RopeSnapshot snapshot;   // Text being counted (pins the leaves it points into)
+    char *pat;               // Pattern whose matches are counted (NULL = none)
+    int pat_len;
+    int *fail;               // KMP failure table of pat
+    CountSlice *slices;      // One job per COUNT_SLICE_SIZE bytes
+    int slice_count;
+} SnapshotCount;
+
+// ========== Match lists ==========
+
+// Initialize an empty match list
+void match_list_init(MatchList *list);
+
+// Free match list storage
+void match_list_free(MatchList *list);
+
+// Append a position (grows the list by doubling)
+void match_list_push(MatchList *list, int pos);
+
+// ========== Parallel search ==========
+
+// Number of threads worth using for a rope of this size (1 for small ropes)
+int search_thread_count(RopeNode *root);
+
+// Find first occurrence of pat at or after from, splitting the rest of the rope across threads
+int search_find_first(RopeNode *root, char *pat, int from);
+
+// Collect all non-overlapping matches of pat in order (out = NULL only counts them)
+// Returns number of matches
+int search_find_all(RopeNode *root, char *pat, MatchList *out);
+
+// Count all non-overlapping matches of pat
+int search_count_matches(RopeNode *root, char *pat);
+
+// ========== Background counts ==========
+
+// Start counting lines, words, bytes and (if pat is not NULL) matches of pat in snap on the
+// worker pool; the count takes the snapshot over. finish(group) runs on the main thread from
+// worker_collect() once every slice is done, with group->data = data
+void snapshot_count_start(SnapshotCount *count, RopeSnapshot *snap, char *pat,
+                          void (*finish)(WorkerGroup *group), void *data);
+
+// Percentage of the snapshot counted so far
+int snapshot_count_progress(SnapshotCount *count);
+
+// Ask the slices to stop (the finish callback still runs, and reports the cancel)
+void snapshot_count_cancel(SnapshotCount *count);
+
+// Merge the slices of a finished count into out and free them and the snapshot
+// Returns false if the count was cancelled (out is then left alone)
+bool snapshot_count_finish(SnapshotCount *count, TextCounts *out);
+
+// Cancel a running count and wait for it, without its finish callback (e.g. closing the buffer)
+void snapshot_count_abort(SnapshotCount *count);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "view.h"
+
+/**
+ * Create a single view
+ * Position fields start at the top of the buffer
+ */
+ViewNode *view_create(void) {
+    ViewNode *view = calloc(1, sizeof(ViewNode));
+    if (!view) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    view->split = SPLIT_NONE;
+    return view;
+}
+
+/**
+ * Free a layout tree recursively
+ */
+void view_free(ViewNode *node) {
+    if (!node)
+        return;
+    view_free(node->first);
+    view_free(node->second);
+    free(node);
+}
+
+/**
+ * Split a view in two
+ * The node itself becomes the split; both halves start as copies of the view
+ * Returns the first (top / left) half
+ */
+ViewNode *view_split(ViewNode *view, SplitKind split) {
+    ViewNode *first = view_create();
+    ViewNode *second = view_create();
+
+    *first = *view;
+    first->parent = view;
+    *second = *first;
+
+    view->split = split;
+    view->first = first;
+    view->second = second;
+    return first;
+}
+
+/**
+ * Close a view: its sibling (view or subtree) takes over the parent's area
+ * Returns the first view of that sibling, or NULL if view is the only view
+ */
+ViewNode *view_close(ViewNode *view) {
+    ViewNode *parent = view->parent;
+    if (!parent)
+        return NULL;
+
+    ViewNode *sibling = parent->first == view ? parent->second : parent->first;
+
+    // Move the sibling into the parent node (keeps the grandparent's pointer valid)
+    ViewNode *grandparent = parent->parent;
+    *parent = *sibling;
+    parent->parent = grandparent;
+    if (parent->first)
+        parent->first->parent = parent;
+    if (parent->second)
+        parent->second->parent = parent;
+
+    free(sibling);
+    free(view);
+    return view_first(parent);
+}
+
+/**
+ * Assign screen rectangles to a subtree
+ * Halves get half of the area each, minus one row / column for the separator
+ */
+void view_layout(ViewNode *node, int row, int col, int height, int width) {
+    node->row = row;
+    node->col = col;
+    node->height = height > 0 ? height : 0;
+    node->width = width > 0 ? width : 0;
+
+    if (node->split == SPLIT_HORIZONTAL) {
+        int top = (height - 1) / 2;
+        view_layout(node->first, row, col, top, width);
+        view_layout(node->second, row + top + 1, col, height - top - 1, width);
+    } else if (node->split == SPLIT_VERTICAL) {
+        int left = (width - 1) / 2;
+        view_layout(node->first, row, col, height, left);
+        view_layout(node->second, row, col + left + 1, height, width - left - 1);
+    }
+}
+
+/**
+ * First view of a subtree (leftmost leaf)
+ */
+ViewNode *view_first(ViewNode *node) {
+    while (node->split != SPLIT_NONE)
+        node = node->first;
+    return node;
+}
+
+/**
+ * Next view in order: climb until coming from a first half, then descend the second half
+ */
+ViewNode *view_next(ViewNode *view) {
+    ViewNode *node = view;
+    while (node->parent && node->parent->second == node)
+        node = node->parent;
+    if (!node->parent)
+        return NULL;
+    return view_first(node->parent->second);
+}
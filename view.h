@@ -0,0 +1,55 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+// How a layout node divides its screen area
+typedef enum {
+    SPLIT_NONE,        // Leaf: a view of the buffer
+    SPLIT_HORIZONTAL,  // Two views stacked top / bottom
+    SPLIT_VERTICAL     // Two views side by side left / right
+} SplitKind;
+
+// Node of a buffer's window layout: either a view (leaf) or a split into two halves
+// Every view reads the buffer's one rope. The focused view's position lives in EditorState;
+// the others keep theirs here and are shifted as edits land before them.
+typedef struct ViewNode {
+    SplitKind split;           // SPLIT_NONE for a view
+    struct ViewNode *first;    // Top / left half (splits only)
+    struct ViewNode *second;   // Bottom / right half (splits only)
+    struct ViewNode *parent;   // Enclosing split (NULL for the root)
+    int cursor_line;           // Saved cursor line (views without focus)
+    int cursor_col;            // Saved cursor byte column (views without focus)
+    int top_line;              // Saved first visible line (views without focus)
+    int left_col;              // Saved first visible display column (views without focus)
+    int row;                   // Screen rectangle from the last view_layout()
+    int col;
+    int height;
+    int width;
+} ViewNode;
+
+// ========== Layout tree ==========
+
+// Create a single view covering the whole screen
+ViewNode *view_create(void);
+
+// Free a layout tree
+void view_free(ViewNode *node);
+
+// Split a view in two; returns the first half (the second starts as a copy of it)
+ViewNode *view_split(ViewNode *view, SplitKind split);
+
+// Close a view, giving its area to its sibling; returns the view that should get focus
+// (NULL if view is the only one)
+ViewNode *view_close(ViewNode *view);
+
+// Assign screen rectangles to every node (one separator row/column between halves)
+void view_layout(ViewNode *node, int row, int col, int height, int width);
+
+// ========== Traversal ==========
+
+// First view (leaf) of a subtree, in top-left to bottom-right order
+ViewNode *view_first(ViewNode *node);
+
+// View after the given one (NULL after the last)
+ViewNode *view_next(ViewNode *view);
+
+#endif
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "worker.h"
+
+// Jobs queued on one pool thread: the owner takes the newest from the bottom,
+// other threads steal the oldest from the top (a ring buffer behind a lock)
+typedef struct {
+    pthread_mutex_t lock;
+    WorkerJob **jobs;
+    int head;          // Oldest job (stolen first)
+    int count;
+    int capacity;
+} WorkerDeque;
+
+// The pool shared by every buffer (started on first submit)
+static struct {
+    bool started;
+    int count;                                // Deques (one per core)
+    int running;                              // Threads that could be started
+    pthread_t threads[WORKER_MAX_THREADS];
+    bool started_thread[WORKER_MAX_THREADS];  // threads[i] is running
+    WorkerDeque deques[WORKER_MAX_THREADS];   // One per pool thread
+    unsigned next;                            // Deque the next submitted job goes to
+    pthread_mutex_t lock;                     // Protects queued, stopping and done
+    pthread_cond_t wake;                      // Signalled when a job is queued
+    int queued;                               // Jobs in all deques
+    bool stopping;
+    WorkerGroup *done;                        // Completed groups for worker_collect()
+    int notify[2];                            // Pipe written when a group joins done
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .notify = { -1, -1 } };
+
+/**
+ * Append a job at the bottom of a deque (grows by doubling)
+ */
+static void worker_deque_push(WorkerDeque *deque, WorkerJob *job) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        int capacity = deque->capacity ? deque->capacity * 2 : 64;
+        WorkerJob **jobs = malloc(capacity * sizeof(WorkerJob *));
+        if (!jobs) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < deque->count; i++)
+            jobs[i] = deque->jobs[(deque->head + i) % deque->capacity];
+        free(deque->jobs);
+        deque->jobs = jobs;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+    deque->jobs[(deque->head + deque->count) % deque->capacity] = job;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+/**
+ * Take the newest job (owner) or the oldest one (thief); NULL if the deque is empty
+ * A thief with 'only' set takes the oldest job of that group (moving the head job into its slot)
+ */
+static WorkerJob *worker_deque_pop(WorkerDeque *deque, bool steal, WorkerGroup *only) {
+    WorkerJob *job = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (!steal && deque->count > 0) {
+        deque->count--;
+        job = deque->jobs[(deque->head + deque->count) % deque->capacity];
+    }
+    for (int i = 0; steal && !job && i < deque->count; i++) {
+        int slot = (deque->head + i) % deque->capacity;
+        if (only && deque->jobs[slot]->group != only)
+            continue;
+        job = deque->jobs[slot];
+        deque->jobs[slot] = deque->jobs[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+/**
+ * Find a job for pool thread self: its own deque first, then the other deques in turn
+ * A thread outside the pool (self = -1) waiting for a group only takes jobs of that group,
+ * so waiting for a short search never turns into running someone's long save
+ */
+static WorkerJob *worker_take(int self, WorkerGroup *only) {
+    WorkerJob *job = self >= 0 ? worker_deque_pop(&pool.deques[self], false, NULL) : NULL;
+    for (int i = 1; !job && i <= pool.count; i++)
+        job = worker_deque_pop(&pool.deques[(self + i + pool.count) % pool.count], true, only);
+
+    if (job) {
+        pthread_mutex_lock(&pool.lock);
+        pool.queued--;
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return job;
+}
+
+/**
+ * Run a job and count it off its group
+ * The last job of a group with a finish callback queues the group for worker_collect()
+ * before the group is seen as done, so a thread waiting for it can take it back off the queue
+ */
+static void worker_run(WorkerJob *job) {
+    WorkerGroup *group = job->group;
+    job->run(job);
+
+    bool notify = false;
+    pthread_mutex_lock(&group->lock);
+    if (group->pending == 1 && group->finish) {
+        pthread_mutex_lock(&pool.lock);
+        group->next_done = pool.done;
+        pool.done = group;
+        pthread_mutex_unlock(&pool.lock);
+        notify = true;
+    }
+    if (--group->pending == 0)
+        pthread_cond_broadcast(&group->done_cond);
+    pthread_mutex_unlock(&group->lock);
+
+    // Wake the event loop
+    char c = 0;
+    if (notify && write(pool.notify[1], &c, 1) < 0) {
+        // Pipe full: a wake-up is already pending
+    }
+}
+
+/**
+ * Pool thread: run jobs until the pool stops, sleeping while there are none
+ */
+static void *worker_main(void *arg) {
+    int self = (int)(long)arg;
+    for (;;) {
+        WorkerJob *job = worker_take(self, NULL);
+        if (job) {
+            worker_run(job);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        while (pool.queued == 0 && !pool.stopping)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        bool stop = pool.stopping && pool.queued == 0;
+        pthread_mutex_unlock(&pool.lock);
+        if (stop)
+            return NULL;
+    }
+}
+
+/**
+ * Threads the pool runs: one per core
+ */
+int worker_thread_count(void) {
+    if (pool.started)
+        return pool.count;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+        cores = 1;
+    if (cores > WORKER_MAX_THREADS)
+        cores = WORKER_MAX_THREADS;
+    return (int)cores;
+}
+
+/**
+ * Start one pool thread per core and the completion pipe
+ */
+static void worker_start(void) {
+    if (pipe(pool.notify) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(pool.notify[i], F_SETFL, fcntl(pool.notify[i], F_GETFL) | O_NONBLOCK);
+        fcntl(pool.notify[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    // Threads read count as soon as they start, so it is set first; the deque of a thread
+    // that could not be started is still emptied by the others stealing from it
+    pool.count = worker_thread_count();
+    for (int i = 0; i < pool.count; i++)
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    pool.running = 0;
+    for (int i = 0; i < pool.count; i++) {
+        pool.started_thread[i] = pthread_create(&pool.threads[i], NULL, worker_main, (void *)(long)i) == 0;
+        if (pool.started_thread[i])
+            pool.running++;
+    }
+    if (pool.running == 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    pool.started = true;
+}
+
+/**
+ * Initialize an empty group
+ */
+void worker_group_init(WorkerGroup *group, void (*finish)(WorkerGroup *group), void *data) {
+    group->finish = finish;
+    group->data = data;
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->done_cond, NULL);
+    group->pending = 0;
+    group->cancelled = false;
+    group->progress = 0;
+    group->total = 0;
+    group->next_done = NULL;
+}
+
+/**
+ * Free the group's lock and condition
+ */
+void worker_group_free(WorkerGroup *group) {
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->done_cond);
+}
+
+/**
+ * Check whether every submitted job has finished
+ */
+bool worker_group_done(WorkerGroup *group) {
+    pthread_mutex_lock(&group->lock);
+    bool done = group->pending == 0;
+    pthread_mutex_unlock(&group->lock);
+    return done;
+}
+
+/**
+ * Wait for the group, running its queued jobs instead of sleeping while there are some
+ * A group with a finish callback is taken back off the completion queue: its waiter handles it
+ */
+void worker_group_wait(WorkerGroup *group) {
+    while (!worker_group_done(group)) {
+        WorkerJob *job = pool.started ? worker_take(-1, group) : NULL;
+        if (job) {
+            worker_run(job);
+            continue;
+        }
+
+        // Every job of the group is running: sleep until the last one finishes
+        pthread_mutex_lock(&group->lock);
+        while (group->pending > 0)
+            pthread_cond_wait(&group->done_cond, &group->lock);
+        pthread_mutex_unlock(&group->lock);
+    }
+
+    if (group->finish) {
+        pthread_mutex_lock(&pool.lock);
+        for (WorkerGroup **link = &pool.done; *link; link = &(*link)->next_done) {
+            if (*link == group) {
+                *link = group->next_done;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+/**
+ * Ask the group's jobs to stop at their next check
+ */
+void worker_group_cancel(WorkerGroup *group) {
+    pthread_mutex_lock(&group->lock);
+    group->cancelled = true;
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Check whether the group was cancelled
+ */
+bool worker_group_cancelled(WorkerGroup *group) {
+    pthread_mutex_lock(&group->lock);
+    bool cancelled = group->cancelled;
+    pthread_mutex_unlock(&group->lock);
+    return cancelled;
+}
+
+/**
+ * Add units of work done
+ */
+void worker_group_advance(WorkerGroup *group, long amount) {
+    pthread_mutex_lock(&group->lock);
+    group->progress += amount;
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Set the units of work expected in all
+ */
+void worker_group_set_total(WorkerGroup *group, long total) {
+    pthread_mutex_lock(&group->lock);
+    group->total = total;
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Percentage of the total done so far (0 while the total is unknown)
+ */
+int worker_group_percent(WorkerGroup *group) {
+    pthread_mutex_lock(&group->lock);
+    long progress = group->progress;
+    long total = group->total;
+    pthread_mutex_unlock(&group->lock);
+
+    if (total <= 0)
+        return 0;
+    return progress >= total ? 100 : (int)(progress * 100 / total);
+}
+
+/**
+ * Queue job as part of group, spreading jobs over the pool threads' deques
+ */
+void worker_submit(WorkerGroup *group, WorkerJob *job) {
+    if (!pool.started)
+        worker_start();
+
+    job->group = group;
+    pthread_mutex_lock(&group->lock);
+    group->pending++;
+    pthread_mutex_unlock(&group->lock);
+
+    worker_deque_push(&pool.deques[pool.next++ % pool.count], job);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.queued++;
+    pthread_cond_signal(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * Completion pipe (-1 until the pool has been started)
+ */
+int worker_fd(void) {
+    return pool.notify[0];
+}
+
+/**
+ * Hand completed groups to their finish callbacks (on the main thread)
+ */
+void worker_collect(void) {
+    if (!pool.started)
+        return;
+
+    char drain[64];
+    while (read(pool.notify[0], drain, sizeof(drain)) > 0)
+        ;
+
+    pthread_mutex_lock(&pool.lock);
+    WorkerGroup *done = pool.done;
+    pool.done = NULL;
+    pthread_mutex_unlock(&pool.lock);
+
+    while (done) {
+        WorkerGroup *next = done->next_done;
+
+        // The last job queues its group before counting itself off: wait until it lets go
+        // of the group, so the callback may free or reuse it
+        pthread_mutex_lock(&done->lock);
+        while (done->pending > 0)
+            pthread_cond_wait(&done->done_cond, &done->lock);
+        pthread_mutex_unlock(&done->lock);
+
+        done->finish(done);
+        done = next;
+    }
+}
+
+/**
+ * Stop the pool threads once the queued jobs are done
+ */
+void worker_shutdown(void) {
+    if (!pool.started)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = true;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < pool.count; i++) {
+        if (pool.started_thread[i])
+            pthread_join(pool.threads[i], NULL);
+        pthread_mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].jobs);
+    }
+    close(pool.notify[0]);
+    close(pool.notify[1]);
+    pool.notify[0] = pool.notify[1] = -1;
+    pool.stopping = false;
+    pool.started = false;
+}
@@ -0,0 +1,80 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// Upper bound on pool threads (one per core is started)
+#define WORKER_MAX_THREADS 64
+
+// How often the status bar is redrawn while a group reports progress
+#define WORKER_PROGRESS_MS 100
+
+typedef struct WorkerGroup WorkerGroup;
+
+// One unit of work, embedded at the start of a caller's own struct
+typedef struct WorkerJob {
+    void (*run)(struct WorkerJob *job);  // Called once on a pool thread (or on a thread waiting for the group)
+    WorkerGroup *group;                  // Group the job counts towards
+} WorkerJob;
+
+// Jobs that make up one operation: its completion, progress and cancellation
+// A group with a finish callback is delivered back to the main thread by worker_collect()
+// and must stay alive until then; a group without one is waited for with worker_group_wait()
+struct WorkerGroup {
+    void (*finish)(WorkerGroup *group);  // Run on the main thread once every job is done (NULL = none)
+    void *data;                          // For the finish callback
+    pthread_mutex_t lock;                // Protects the fields below
+    pthread_cond_t done_cond;            // Signalled when pending reaches 0
+    int pending;                         // Jobs submitted but not finished
+    bool cancelled;                      // Jobs should stop early (they check worker_group_cancelled)
+    long progress;                       // Units of work done (e.g. bytes)
+    long total;                          // Units of work in all (0 = unknown)
+    WorkerGroup *next_done;              // Finished groups waiting for worker_collect()
+};
+
+// ========== Groups ==========
+
+// Initialize an empty group (finish may be NULL)
+void worker_group_init(WorkerGroup *group, void (*finish)(WorkerGroup *group), void *data);
+
+// Free the group's lock (it must be done)
+void worker_group_free(WorkerGroup *group);
+
+// Check whether every submitted job has finished
+bool worker_group_done(WorkerGroup *group);
+
+// Wait until every job has finished, running queued jobs meanwhile
+void worker_group_wait(WorkerGroup *group);
+
+// Ask the group's jobs to stop early
+void worker_group_cancel(WorkerGroup *group);
+
+// Check (from a job) whether the group was cancelled
+bool worker_group_cancelled(WorkerGroup *group);
+
+// Add units of work done (from a job) / set the total to expect
+void worker_group_advance(WorkerGroup *group, long amount);
+void worker_group_set_total(WorkerGroup *group, long total);
+
+// Percentage of the total done so far
+int worker_group_percent(WorkerGroup *group);
+
+// ========== Pool ==========
+
+// Threads the pool runs (or will run once started): one per core, at most WORKER_MAX_THREADS
+int worker_thread_count(void);
+
+// Queue job as part of group (the pool is started on first use)
+void worker_submit(WorkerGroup *group, WorkerJob *job);
+
+// Descriptor that becomes readable when a group with a finish callback has completed
+int worker_fd(void);
+
+// Run the finish callbacks of completed groups (main thread)
+void worker_collect(void);
+
+// Stop the pool threads (queued jobs are finished first)
+void worker_shutdown(void);
+
+#endif